@@ -1,2 +1,5 @@
 glslc src/Shaders/BlinnPhong.vert -o src/Shaders/vert.spv
+glslc src/Shaders/BlinnPhong.vert -DINSTANCED -o src/Shaders/vert_instanced.spv
+glslc src/Shaders/BlinnPhong.vert -DPACKED_VERTEX -o src/Shaders/vert_packed.spv
+glslc src/Shaders/BlinnPhong.vert -DPACKED_VERTEX -DINSTANCED -o src/Shaders/vert_packed_instanced.spv
 glslc src/Shaders/BlinnPhong.frag -o src/Shaders/frag.spv
@@ -0,0 +1,286 @@
+#include "../VPRenderer.hpp"
+
+#include <algorithm>
+#include <cmath>
+#include <fstream>
+#include <numeric>
+#include <cstdio>
+
+// Renders a synthetic scene for a fixed amount of frames and dumps the timings to JSON.
+// Usage: VPBenchmark [--objects N] [--lights M] [--materials K] [--frames F] [--warmup W]
+//                    [--mesh path] [--texture path] [--texture-budget MiB] [--out path] [--windowed]
+
+struct BenchmarkConfig
+{
+  uint32_t    objectCount   = 100;
+  uint32_t    lightCount    = 4;
+  uint32_t    materialCount = 4;
+  uint32_t    frameCount    = 500;
+  uint32_t    warmupFrames  = 50;
+  std::string meshPath      = "../Models/sphere.obj";
+  std::string texturePath   = "../Textures/ColorTestTex.png";
+  uint32_t    textureBudget = vpe::DEFAULT_TEXTURE_BUDGET / (1024 * 1024); // MiB
+  std::string outPath       = "benchmark.json";
+  bool        headless      = true;
+};
+
+struct Stats
+{
+  double min  = 0.0;
+  double mean = 0.0;
+  double p50  = 0.0;
+  double p90  = 0.0;
+  double p99  = 0.0;
+  double max  = 0.0;
+};
+
+static BenchmarkConfig parseArgs(const int _argc, char** _argv)
+{
+  BenchmarkConfig config;
+
+  for (int i=1; i<_argc; ++i)
+  {
+    const std::string arg(_argv[i]);
+    const bool        hasValue = i+1 < _argc;
+
+    if      (arg == "--windowed")                config.headless      = false;
+    else if (arg == "--objects"   && hasValue)   config.objectCount   = std::stoul(_argv[++i]);
+    else if (arg == "--lights"    && hasValue)   config.lightCount    = std::stoul(_argv[++i]);
+    else if (arg == "--materials" && hasValue)   config.materialCount = std::stoul(_argv[++i]);
+    else if (arg == "--frames"    && hasValue)   config.frameCount    = std::stoul(_argv[++i]);
+    else if (arg == "--warmup"    && hasValue)   config.warmupFrames  = std::stoul(_argv[++i]);
+    else if (arg == "--mesh"      && hasValue)   config.meshPath      = _argv[++i];
+    else if (arg == "--texture"   && hasValue)   config.texturePath   = _argv[++i];
+    else if (arg == "--texture-budget" && hasValue) config.textureBudget = std::stoul(_argv[++i]);
+    else if (arg == "--out"       && hasValue)   config.outPath       = _argv[++i];
+    else
+      throw std::runtime_error("ERROR: Unknown or incomplete argument " + arg);
+  }
+
+  // The default material always exists
+  config.materialCount = std::max(config.materialCount, 1u);
+
+  return config;
+}
+
+static Stats computeStats(std::vector<double> _samples)
+{
+  Stats result{};
+  if (_samples.empty()) return result;
+
+  std::sort(_samples.begin(), _samples.end());
+
+  // Nearest rank
+  auto percentile = [&_samples](const double _p)
+  {
+    const size_t rank = static_cast<size_t>( std::ceil(_p * _samples.size()) );
+    return _samples.at( std::min(std::max(rank, size_t(1)), _samples.size()) - 1 );
+  };
+
+  result.min  = _samples.front();
+  result.max  = _samples.back();
+  result.mean = std::accumulate(_samples.begin(), _samples.end(), 0.0) / _samples.size();
+  result.p50  = percentile(0.50);
+  result.p90  = percentile(0.90);
+  result.p99  = percentile(0.99);
+
+  return result;
+}
+
+// Quotes, backslashes (Windows paths) and control characters would break the JSON
+static std::string escapeJSON(const std::string& _value)
+{
+  std::string result;
+  result.reserve(_value.size());
+
+  for (const char c : _value)
+  {
+    switch (c)
+    {
+      case '"':  result += "\\\""; break;
+      case '\\': result += "\\\\"; break;
+      case '\n': result += "\\n";  break;
+      case '\r': result += "\\r";  break;
+      case '\t': result += "\\t";  break;
+      default:
+        if (static_cast<unsigned char>(c) < 0x20)
+        {
+          char code[8];
+          snprintf(code, sizeof(code), "\\u%04x", static_cast<unsigned char>(c));
+          result += code;
+        }
+        else result += c;
+        break;
+    }
+  }
+
+  return result;
+}
+
+static void writePhase(std::ofstream& _out, const char* _name, const std::vector<double>& _samples)
+{
+  const Stats stats = computeStats(_samples);
+
+  _out << "    \"" << _name << "\": {\n"
+       << "      \"min\": "  << stats.min  << ",\n"
+       << "      \"mean\": " << stats.mean << ",\n"
+       << "      \"p50\": "  << stats.p50  << ",\n"
+       << "      \"p90\": "  << stats.p90  << ",\n"
+       << "      \"p99\": "  << stats.p99  << ",\n"
+       << "      \"max\": "  << stats.max  << ",\n"
+       << "      \"frames\": [";
+
+  for (size_t i=0; i<_samples.size(); ++i)
+    _out << (i > 0 ? ", " : "") << _samples[i];
+
+  _out << "]\n    }";
+}
+
+static void writeJSON(const BenchmarkConfig&                _config,
+                      const std::vector<vpe::FrameTimings>& _timings,
+                      const vpe::DrawStats&                 _drawStats,
+                      const vpe::TextureStreamingStats&     _streamingStats)
+{
+  std::vector<double> sceneUpdate, renderCommands, fenceWait, total;
+  sceneUpdate.reserve(_timings.size());
+  renderCommands.reserve(_timings.size());
+  fenceWait.reserve(_timings.size());
+  total.reserve(_timings.size());
+
+  for (const auto& t : _timings)
+  {
+    sceneUpdate.push_back(t.sceneUpdate);
+    renderCommands.push_back(t.renderCommands);
+    fenceWait.push_back(t.fenceWait);
+    total.push_back(t.total);
+  }
+
+  std::ofstream out(_config.outPath);
+  if (!out.is_open())
+    throw std::runtime_error("ERROR: Couldn't open " + _config.outPath);
+
+  out << "{\n"
+      << "  \"config\": {\n"
+      << "    \"objects\": "   << _config.objectCount   << ",\n"
+      << "    \"lights\": "    << _config.lightCount    << ",\n"
+      << "    \"materials\": " << _config.materialCount << ",\n"
+      << "    \"frames\": "    << _config.frameCount    << ",\n"
+      << "    \"warmup\": "    << _config.warmupFrames  << ",\n"
+      << "    \"mesh\": \""    << escapeJSON(_config.meshPath) << "\",\n"
+      << "    \"textureBudget\": " << _config.textureBudget << ",\n"
+      << "    \"headless\": "  << (_config.headless ? "true" : "false") << "\n"
+      << "  },\n"
+      << "  \"unit\": \"ms\",\n"
+      << "  \"phases\": {\n";
+
+  writePhase(out, "sceneUpdate",    sceneUpdate);    out << ",\n";
+  writePhase(out, "renderCommands", renderCommands); out << ",\n";
+  writePhase(out, "fenceWait",      fenceWait);      out << ",\n";
+  writePhase(out, "total",          total);          out << "\n";
+
+  // The scene is static, so the last frame is representative
+  out << "  },\n"
+      << "  \"drawStats\": {\n"
+      << "    \"draws\": "           << _drawStats.draws           << ",\n"
+      << "    \"instances\": "       << _drawStats.instances       << ",\n"
+      << "    \"pipelineBinds\": "   << _drawStats.pipelineBinds   << ",\n"
+      << "    \"meshBinds\": "       << _drawStats.meshBinds       << ",\n"
+      << "    \"descriptorBinds\": " << _drawStats.descriptorBinds << ",\n"
+      << "    \"skippedBinds\": "    << _drawStats.skippedBinds    << ",\n"
+      << "    \"culledObjects\": "   << _drawStats.culledObjects   << ",\n"
+      << "    \"triangles\": "       << _drawStats.triangles       << "\n"
+      << "  },\n"
+      << "  \"textureStreaming\": {\n"
+      << "    \"streamed\": "     << _streamingStats.streamedCount << ",\n"
+      << "    \"residentSize\": " << _streamingStats.residentSize  << ",\n"
+      << "    \"loads\": "        << _streamingStats.loadCount     << ",\n"
+      << "    \"evictions\": "    << _streamingStats.evictionCount << "\n"
+      << "  }\n"
+      << "}\n";
+}
+
+static void buildScene(vpe::Renderer& _renderer, const BenchmarkConfig& _config)
+{
+  _renderer.setCamera(glm::vec3(0, 1, -4), vpe::FRONT, vpe::UP, 0.1f, 100.0f);
+
+  for (uint32_t i=0; i<_config.lightCount; ++i)
+  {
+    const float angle = glm::radians(360.0f * i / _config.lightCount);
+
+    vpe::Light light;
+    light.ubo.color     = glm::vec3(1);
+    light.ubo.position  = glm::vec3(3.0f * std::cos(angle), 2, 3.0f * std::sin(angle));
+    light.ubo.intensity = 2.0f / _config.lightCount;
+    _renderer.addLight(light);
+  }
+
+  std::vector<uint32_t> materials{vpe::DEFAULT_MATERIAL_IDX};
+  for (uint32_t i=1; i<_config.materialCount; ++i)
+    materials.push_back( _renderer.createMaterial(vpe::DEFAULT_VERT, vpe::DEFAULT_FRAG) );
+
+  for (const auto& matIdx : materials)
+    _renderer.setMaterialTexture(matIdx, _config.texturePath.c_str());
+
+  auto rotateCB = [](const float _deltaTime, vpe::Transform& _transform)
+  {
+    _transform.rotate( _deltaTime * glm::radians(90.0f) * vpe::UP );
+  };
+
+  // Square grid in front of the camera
+  const uint32_t side = static_cast<uint32_t>( std::ceil(std::sqrt(_config.objectCount)) );
+  for (uint32_t i=0; i<_config.objectCount; ++i)
+  {
+    const glm::vec3 position(2.0f * (i % side) - side + 1.0f,
+                             0,
+                             2.0f * (i / side));
+
+    const uint32_t objIdx = _renderer.createObject(_config.meshPath.c_str());
+    _renderer.transformObject(objIdx, position, vpe::TransformOperation::TRANSLATE);
+    _renderer.setObjMaterial(objIdx, materials.at(i % materials.size()));
+    _renderer.setObjUpdateCB(objIdx, rotateCB);
+  }
+}
+
+int main(int argc, char** argv)
+{
+  vpe::Renderer renderer;
+
+  try
+  {
+    const BenchmarkConfig config = parseArgs(argc, argv);
+
+    renderer.init(config.headless);
+    renderer.setTextureBudget(VkDeviceSize(config.textureBudget) * 1024 * 1024);
+    buildScene(renderer, config);
+
+    // Otherwise the first measured frames could still be missing meshes
+    renderer.waitForPendingLoads();
+    // Nor compiling pipelines
+    renderer.warmUpPipelines();
+
+    std::cout << "Benchmarking " << config.objectCount   << " objects, "
+                                 << config.lightCount    << " lights, "
+                                 << config.materialCount << " materials..." << std::endl;
+
+    // The first frames create the scheduled objects and record the commands
+    renderer.renderFrames(config.warmupFrames);
+
+    std::vector<vpe::FrameTimings> timings;
+    timings.reserve(config.frameCount);
+
+    renderer.renderFrames(config.frameCount,
+                          [&](const uint32_t){ timings.push_back(renderer.getLastFrameTimings()); });
+
+    writeJSON(config, timings, renderer.getLastDrawStats(), renderer.getTextureStreamingStats());
+    renderer.cleanUp();
+
+    std::cout << "Results written to " << config.outPath << std::endl;
+  }
+  catch(const std::exception& e)
+  {
+    std::cerr << e.what() << '\n';
+    return EXIT_FAILURE;
+  }
+
+  return EXIT_SUCCESS;
+}
@@ -13,43 +13,106 @@ void CommandBufferManager::createCommandPool(const uint32_t _queueFamilyIdx)
     throw std::runtime_error("ERROR: Failed to create command pool");
 }
 
-void CommandBufferManager::allocateNCommandBuffers(const uint32_t _num)
+void CommandBufferManager::createFramePools(const uint32_t _queueFamilyIdx,
+                                            const uint32_t _frameCount,
+                                            const uint32_t _secondarySlotCount)
 {
-  m_commandBuffers.resize(_num);
+  this->destroyFramePools();
 
-  // Allocate the buffers TODO: Refactor into own function
-  VkCommandBufferAllocateInfo allocInfo{};
-  allocInfo.sType              = VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO;
-  allocInfo.commandPool        = m_commandPool;
-  allocInfo.level              = VK_COMMAND_BUFFER_LEVEL_PRIMARY; // Can be submited to queue, but not called from other buffers
-  allocInfo.commandBufferCount = m_commandBuffers.size();
+  m_framePools.resize(_frameCount);
+  m_frameCommandBuffers.resize(_frameCount);
+
+  m_secondarySlotCount = _secondarySlotCount;
+  m_secondaryPools.resize(_frameCount * _secondarySlotCount);
+  m_secondaryCommandBuffers.resize(_frameCount * _secondarySlotCount);
 
-  if (vkAllocateCommandBuffers(*m_pLogicalDevice, &allocInfo, m_commandBuffers.data()) != VK_SUCCESS)
-    throw std::runtime_error("ERROR: VPCommandBufferManager::allocateNCommandBuffers - Failed!");
+  VkCommandPoolCreateInfo createInfo{};
+  createInfo.sType            = VK_STRUCTURE_TYPE_COMMAND_POOL_CREATE_INFO;
+  createInfo.queueFamilyIndex = _queueFamilyIdx;
+  createInfo.flags            = VK_COMMAND_POOL_CREATE_TRANSIENT_BIT; // Re-recorded every frame
+
+  for (uint32_t i=0; i<_frameCount; ++i)
+  {
+    if (vkCreateCommandPool(*m_pLogicalDevice, &createInfo, nullptr, &m_framePools.at(i)) != VK_SUCCESS)
+      throw std::runtime_error("ERROR: VPCommandBufferManager::createFramePools - Failed to create pool!");
+
+    VkCommandBufferAllocateInfo allocInfo{};
+    allocInfo.sType              = VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO;
+    allocInfo.commandPool        = m_framePools.at(i);
+    allocInfo.level              = VK_COMMAND_BUFFER_LEVEL_PRIMARY; // Can be submited to queue, but not called from other buffers
+    allocInfo.commandBufferCount = 1;
+
+    if (vkAllocateCommandBuffers(*m_pLogicalDevice, &allocInfo, &m_frameCommandBuffers.at(i)) != VK_SUCCESS)
+      throw std::runtime_error("ERROR: VPCommandBufferManager::createFramePools - Failed to allocate buffer!");
+  }
+
+  for (size_t i=0; i<m_secondaryPools.size(); ++i)
+  {
+    if (vkCreateCommandPool(*m_pLogicalDevice, &createInfo, nullptr, &m_secondaryPools.at(i)) != VK_SUCCESS)
+      throw std::runtime_error("ERROR: VPCommandBufferManager::createFramePools - Failed to create secondary pool!");
+
+    VkCommandBufferAllocateInfo allocInfo{};
+    allocInfo.sType              = VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO;
+    allocInfo.commandPool        = m_secondaryPools.at(i);
+    allocInfo.level              = VK_COMMAND_BUFFER_LEVEL_SECONDARY; // Executed from the frame's primary buffer
+    allocInfo.commandBufferCount = 1;
+
+    if (vkAllocateCommandBuffers(*m_pLogicalDevice, &allocInfo, &m_secondaryCommandBuffers.at(i)) != VK_SUCCESS)
+      throw std::runtime_error("ERROR: VPCommandBufferManager::createFramePools - Failed to allocate secondary buffer!");
+  }
 }
 
-void CommandBufferManager::beginRecordingCommand(const uint32_t _idx,
-                                                 const VkCommandBufferUsageFlags _flags)
+// The frame's previous submission MUST be finished (i.e. its fence waited)
+void CommandBufferManager::beginFrameCommand(const uint32_t _frameIdx)
 {
-  if (_idx >= m_commandBuffers.size()) return;
+  if (_frameIdx >= m_framePools.size()) return;
+
+  vkResetCommandPool(*m_pLogicalDevice, m_framePools.at(_frameIdx), 0);
+
+  for (uint32_t slot=0; slot<m_secondarySlotCount; ++slot)
+    vkResetCommandPool(*m_pLogicalDevice, m_secondaryPools.at(_frameIdx * m_secondarySlotCount + slot), 0);
 
   VkCommandBufferBeginInfo beginInfo{};
   beginInfo.sType            = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO;
-  beginInfo.flags            = _flags;
+  beginInfo.flags            = VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT;
   beginInfo.pInheritanceInfo = nullptr; // Only relevant for secondary command buffers
 
-  if (vkBeginCommandBuffer(m_commandBuffers.at(_idx), &beginInfo) != VK_SUCCESS)
-    throw std::runtime_error("ERROR: VPCommandBufferManager::beginRecordingCommand - Failed!");
+  if (vkBeginCommandBuffer(m_frameCommandBuffers.at(_frameIdx), &beginInfo) != VK_SUCCESS)
+    throw std::runtime_error("ERROR: VPCommandBufferManager::beginFrameCommand - Failed!");
 }
 
-void CommandBufferManager::endRecordingCommand(const uint32_t _idx)
+void CommandBufferManager::endFrameCommand(const uint32_t _frameIdx)
 {
-  if (_idx >= m_commandBuffers.size()) return;
+  if (_frameIdx >= m_frameCommandBuffers.size()) return;
 
-  vkCmdEndRenderPass(m_commandBuffers.at(_idx));
+  vkCmdEndRenderPass(m_frameCommandBuffers.at(_frameIdx));
 
-  if (vkEndCommandBuffer(m_commandBuffers.at(_idx)) != VK_SUCCESS)
-    throw std::runtime_error("ERROR: VPCommandBufferManager::endRecordingCommand - Failed!");
+  if (vkEndCommandBuffer(m_frameCommandBuffers.at(_frameIdx)) != VK_SUCCESS)
+    throw std::runtime_error("ERROR: VPCommandBufferManager::endFrameCommand - Failed!");
+}
+
+VkCommandBuffer& CommandBufferManager::beginSecondaryCommand(const uint32_t                         _frameIdx,
+                                                            const uint32_t                         _slot,
+                                                            const VkCommandBufferInheritanceInfo& _inheritanceInfo)
+{
+  VkCommandBuffer& commandBuffer = this->getSecondaryBuffer(_frameIdx, _slot);
+
+  VkCommandBufferBeginInfo beginInfo{};
+  beginInfo.sType            = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO;
+  beginInfo.flags            = VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT |
+                               VK_COMMAND_BUFFER_USAGE_RENDER_PASS_CONTINUE_BIT; // Entirely inside a render pass
+  beginInfo.pInheritanceInfo = &_inheritanceInfo;
+
+  if (vkBeginCommandBuffer(commandBuffer, &beginInfo) != VK_SUCCESS)
+    throw std::runtime_error("ERROR: VPCommandBufferManager::beginSecondaryCommand - Failed!");
+
+  return commandBuffer;
+}
+
+void CommandBufferManager::endSecondaryCommand(const uint32_t _frameIdx, const uint32_t _slot)
+{
+  if (vkEndCommandBuffer(this->getSecondaryBuffer(_frameIdx, _slot)) != VK_SUCCESS)
+    throw std::runtime_error("ERROR: VPCommandBufferManager::endSecondaryCommand - Failed!");
 }
 
 VkCommandBuffer CommandBufferManager::beginSingleTimeCommand()
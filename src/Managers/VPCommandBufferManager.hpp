@@ -22,48 +22,86 @@ public:
 
   VkDevice* m_pLogicalDevice;
 
-  inline void             setQueue(VkQueue* _queue)           { m_pQueue = _queue; }
-  inline size_t           getCommandBufferCount()             { return m_commandBuffers.size(); }
-  inline VkCommandBuffer& getBufferAt(const uint32_t _idx)    { return m_commandBuffers.at(_idx); }
+  inline void             setQueue(VkQueue* _queue)               { m_pQueue = _queue; }
+  inline size_t           getFrameCount()                         { return m_frameCommandBuffers.size(); }
+  inline VkCommandBuffer& getFrameBuffer(const uint32_t _frameIdx) { return m_frameCommandBuffers.at(_frameIdx); }
+  inline uint32_t         getSecondarySlotCount()                 { return m_secondarySlotCount; }
+  inline VkCommandBuffer& getSecondaryBuffer(const uint32_t _frameIdx, const uint32_t _slot)
+  {
+    return m_secondaryCommandBuffers.at(_frameIdx * m_secondarySlotCount + _slot);
+  }
 
   void createCommandPool(const uint32_t _queueFamilyIdx);
 
-  void allocateNCommandBuffers(const uint32_t _num);
-  void beginRecordingCommand(const uint32_t _idx, const VkCommandBufferUsageFlags _flags=0);
-  void endRecordingCommand(const uint32_t _idx);
+  // One transient pool (and primary buffer) per frame in flight.
+  // The whole pool is reset every time its frame is recorded again, so nothing accumulates.
+  // Each frame also gets _secondarySlotCount pools with a secondary buffer each, so that many
+  // threads can record in parallel (command pools can't be used by several threads at once).
+  void createFramePools(const uint32_t _queueFamilyIdx,
+                        const uint32_t _frameCount,
+                        const uint32_t _secondarySlotCount = 0);
+  void beginFrameCommand(const uint32_t _frameIdx);
+  void endFrameCommand(const uint32_t _frameIdx);
+
+  // Safe to call from any thread as long as no other one is using the same slot.
+  // The secondary pools are reset by beginFrameCommand, so call it first.
+  VkCommandBuffer& beginSecondaryCommand(const uint32_t                         _frameIdx,
+                                         const uint32_t                         _slot,
+                                         const VkCommandBufferInheritanceInfo& _inheritanceInfo);
+  void             endSecondaryCommand(const uint32_t _frameIdx, const uint32_t _slot);
 
   VkCommandBuffer beginSingleTimeCommand();
   void            endSingleTimeCommand(VkCommandBuffer& _commandBuffer);
   void            endSingleTimeCommand(VkCommandBuffer& _commandBuffer,
                                        VkQueue* _queue);
 
-  inline void freeBuffers()
-  {
-    vkFreeCommandBuffers(*m_pLogicalDevice,
-                         m_commandPool,
-                         m_commandBuffers.size(),
-                         m_commandBuffers.data());
-  }
-
   inline void destroyCommandPool()
   {
     vkDestroyCommandPool(*m_pLogicalDevice, m_commandPool, nullptr);
     m_commandPool = VK_NULL_HANDLE;
   }
 
+  inline void destroyFramePools()
+  {
+    // Their buffers are freed alongside them
+    for (auto& pool : m_framePools)
+      vkDestroyCommandPool(*m_pLogicalDevice, pool, nullptr);
+
+    for (auto& pool : m_secondaryPools)
+      vkDestroyCommandPool(*m_pLogicalDevice, pool, nullptr);
+
+    m_framePools.clear();
+    m_frameCommandBuffers.clear();
+    m_secondaryPools.clear();
+    m_secondaryCommandBuffers.clear();
+    m_secondarySlotCount = 0;
+  }
+
   inline void cleanUp()
   {
     if (m_commandPool != VK_NULL_HANDLE) destroyCommandPool();
+    destroyFramePools();
     m_pLogicalDevice = nullptr;
     m_pQueue         = nullptr;
   }
 
 private:
-  CommandBufferManager() : m_pLogicalDevice(nullptr), m_commandPool(VK_NULL_HANDLE) {}
+  CommandBufferManager() :
+    m_pLogicalDevice(nullptr),
+    m_commandPool(VK_NULL_HANDLE),
+    m_secondarySlotCount(0)
+  {}
   ~CommandBufferManager() {}
 
-  VkCommandPool                m_commandPool;
-  std::vector<VkCommandBuffer> m_commandBuffers; // Destroyed alongside m_commandPool
+  VkCommandPool                m_commandPool; // Single time commands
+
+  std::vector<VkCommandPool>   m_framePools;
+  std::vector<VkCommandBuffer> m_frameCommandBuffers; // Destroyed alongside m_framePools
+
+  // Indexed [frame * m_secondarySlotCount + slot]
+  uint32_t                     m_secondarySlotCount;
+  std::vector<VkCommandPool>   m_secondaryPools;
+  std::vector<VkCommandBuffer> m_secondaryCommandBuffers; // Destroyed alongside m_secondaryPools
 
   VkQueue*  m_pQueue; // Implicitly destroyed alongside m_logicalDevice
 };
@@ -94,7 +94,8 @@ namespace deviceManagement
   }
 
   VkDevice createLogicalDevice(const VkPhysicalDevice& _physicalDevice,
-                               const QueueFamilyIndices_t& _queueFamilyIndices)
+                               const QueueFamilyIndices_t& _queueFamilyIndices,
+                               const std::vector<const char*>& _extensions)
   {
     VkDevice result        = VK_NULL_HANDLE;
     float    queuePriority = 1.0;
@@ -102,7 +103,9 @@ namespace deviceManagement
     // How many queues we want for a single family (for now just one with graphics capabilities)
     std::vector<VkDeviceQueueCreateInfo> queueCreateInfos{};
     std::set<uint32_t> uniqueQueueFamilies = {_queueFamilyIndices.graphicsFamily.value(),
-                                              _queueFamilyIndices.presentFamily.value()};
+                                              _queueFamilyIndices.presentFamily.value(),
+                                              _queueFamilyIndices.transferFamily.value_or(
+                                                _queueFamilyIndices.graphicsFamily.value())};
 
     for(uint32_t queueFamily : uniqueQueueFamilies)
     {
@@ -115,8 +118,13 @@ namespace deviceManagement
       queueCreateInfos.emplace_back(queueCreateInfo);
     }
 
+    VkPhysicalDeviceFeatures supportedFeatures;
+    vkGetPhysicalDeviceFeatures(_physicalDevice, &supportedFeatures);
+
     VkPhysicalDeviceFeatures deviceFeatures{};
-    deviceFeatures.samplerAnisotropy = VK_TRUE;
+    deviceFeatures.samplerAnisotropy    = VK_TRUE;
+    // Optional, the BC .vptex files fall back to their source images without it
+    deviceFeatures.textureCompressionBC = supportedFeatures.textureCompressionBC;
 
     VkPhysicalDeviceDescriptorIndexingFeaturesEXT indexingFeatures{};
     indexingFeatures.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_DESCRIPTOR_INDEXING_FEATURES_EXT;
@@ -128,9 +136,9 @@ namespace deviceManagement
     createInfo.queueCreateInfoCount    = queueCreateInfos.size();
     createInfo.pEnabledFeatures        = &deviceFeatures;
     createInfo.pNext                   = &indexingFeatures;
-    createInfo.ppEnabledExtensionNames = DEVICE_EXTENSIONS.data();
+    createInfo.ppEnabledExtensionNames = _extensions.data();
     // NOTE: enabledExtensionCount and ppEnabledLayerNames are ignored in modern Vulkan implementations
-    createInfo.enabledExtensionCount   = DEVICE_EXTENSIONS.size();
+    createInfo.enabledExtensionCount   = _extensions.size();
     if (ENABLE_VALIDATION_LAYERS)
     {
       createInfo.enabledLayerCount     = VALIDATION_LAYERS.size();
@@ -185,6 +193,10 @@ namespace deviceManagement
 
     std::cout << "Using Vulkan API version: " << properties.apiVersion << std::endl;
 
+    // Without a surface there's nothing to present to, so the swapchain isn't needed
+    if (_surface == VK_NULL_HANDLE)
+      return features.samplerAnisotropy && queueFamiliesIndices.isComplete();
+
     bool swapChainSupported = false;
     if (checkExtensionSupport(_device))
     {
@@ -213,24 +225,51 @@ namespace deviceManagement
     std::vector<VkQueueFamilyProperties> queueFamilies(queueFamilyCount);
     vkGetPhysicalDeviceQueueFamilyProperties(_device, &queueFamilyCount, queueFamilies.data());
 
+    std::optional<uint32_t> dedicatedTransferFamily;
+    std::optional<uint32_t> asyncTransferFamily;
+
     VkBool32 presentSupport = false;
     int i=0;
     for (const auto& family : queueFamilies)
     {
-      if (family.queueFlags & VK_QUEUE_GRAPHICS_BIT) result.graphicsFamily = i;
+      if (!result.isComplete())
+      {
+        if (family.queueFlags & VK_QUEUE_GRAPHICS_BIT) result.graphicsFamily = i;
 
-      vkGetPhysicalDeviceSurfaceSupportKHR(_device, i, _surface, &presentSupport);
-      if (presentSupport) result.presentFamily = i;
+        if (_surface == VK_NULL_HANDLE)
+          result.presentFamily = result.graphicsFamily;
+        else
+        {
+          vkGetPhysicalDeviceSurfaceSupportKHR(_device, i, _surface, &presentSupport);
+          if (presentSupport) result.presentFamily = i;
+        }
+      }
 
-      if (result.isComplete()) break;
+      // A transfer only family is usually backed by the DMA engines, so it can run alongside rendering
+      const bool isTransfer     = family.queueFlags & VK_QUEUE_TRANSFER_BIT;
+      const bool isGraphics     = family.queueFlags & VK_QUEUE_GRAPHICS_BIT;
+      const bool isCompute      = family.queueFlags & VK_QUEUE_COMPUTE_BIT;
+      const bool isTransferOnly = isTransfer && !isGraphics && !isCompute;
+
+      if (isTransferOnly && !dedicatedTransferFamily.has_value()) dedicatedTransferFamily = i;
+      if (isTransfer && !isGraphics && !asyncTransferFamily.has_value()) asyncTransferFamily = i;
 
       ++i;
     }
 
+    // Graphics queues always support transfers, so that's the fallback
+    if (dedicatedTransferFamily.has_value())
+      result.transferFamily = dedicatedTransferFamily;
+    else if (asyncTransferFamily.has_value())
+      result.transferFamily = asyncTransferFamily;
+    else
+      result.transferFamily = result.graphicsFamily;
+
     return result;
   }
 
-  bool checkExtensionSupport(const VkPhysicalDevice& _device)
+  bool checkExtensionSupport(const VkPhysicalDevice& _device,
+                             const std::vector<const char*>& _extensions)
   {
     uint32_t extensionCount = 0;
     vkEnumerateDeviceExtensionProperties(_device, nullptr, &extensionCount, nullptr);
@@ -239,14 +278,14 @@ namespace deviceManagement
     vkEnumerateDeviceExtensionProperties(_device, nullptr, &extensionCount, availableExtensions.data());
 
     extensionCount = 0;
-    for (const char* extensionName : DEVICE_EXTENSIONS)
+    for (const char* extensionName : _extensions)
     {
       for (const VkExtensionProperties& extension : availableExtensions)
         if (!strcmp(extensionName, extension.extensionName))
           ++extensionCount;
     }
 
-    return extensionCount == DEVICE_EXTENSIONS.size();
+    return extensionCount == _extensions.size();
   }
 
   bool checkValidationSupport()
@@ -24,11 +24,15 @@ namespace deviceManagement
 {
   const std::vector<const char*> VALIDATION_LAYERS = { "VK_LAYER_KHRONOS_validation" };
   const std::vector<const char*> DEVICE_EXTENSIONS = { VK_KHR_SWAPCHAIN_EXTENSION_NAME };
+  const std::vector<const char*> HEADLESS_DEVICE_EXTENSIONS = {};
+  // Enabled only where supported
+  const std::vector<const char*> OPTIONAL_DEVICE_EXTENSIONS = { VK_EXT_PIPELINE_CREATION_FEEDBACK_EXTENSION_NAME };
 
   typedef struct
   {
     std::optional<uint32_t> graphicsFamily;
     std::optional<uint32_t> presentFamily;
+    std::optional<uint32_t> transferFamily; // Optional, the graphics family if there's no better one
 
     bool isComplete() const
     {
@@ -47,7 +51,8 @@ namespace deviceManagement
 
   void       populateDebugMessenger(VkDebugUtilsMessengerCreateInfoEXT& _createInfo);
   bool       isDeviceSuitable(const VkPhysicalDevice& _device, const VkSurfaceKHR& _surface);
-  bool       checkExtensionSupport(const VkPhysicalDevice& _device);
+  bool       checkExtensionSupport(const VkPhysicalDevice& _device,
+                                   const std::vector<const char*>& _extensions = DEVICE_EXTENSIONS);
   bool       checkValidationSupport();
   VkInstance createVulkanInstance(const std::vector<const char*>& _extensions);
 
@@ -56,9 +61,13 @@ namespace deviceManagement
   VkPhysicalDevice getPhysicalDevice(const VkInstance& _vkInstance,
                                      const VkSurfaceKHR& _surface);
 
+  // Headless devices (no surface) don't need the swapchain extension
   VkDevice createLogicalDevice(const VkPhysicalDevice& _physicalDevice,
-                               const QueueFamilyIndices_t& _queueFamilyIndices);
+                               const QueueFamilyIndices_t& _queueFamilyIndices,
+                               const std::vector<const char*>& _extensions = DEVICE_EXTENSIONS);
 
+  // If _surface is VK_NULL_HANDLE (headless), the present family is the graphics one.
+  // The transfer family is a transfer only one if available, then any non graphics one, then the graphics one.
   QueueFamilyIndices_t findQueueFamilies(const VkPhysicalDevice& _device,
                                          const VkSurfaceKHR& _surface);
 
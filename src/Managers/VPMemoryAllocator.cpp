@@ -0,0 +1,381 @@
+#include "VPMemoryAllocator.hpp"
+
+namespace vpe
+{
+static inline VkDeviceSize alignUp(const VkDeviceSize _value, const VkDeviceSize _alignment)
+{
+  return (_value + _alignment - 1) / _alignment * _alignment;
+}
+
+// Both offsets fall in the same bufferImageGranularity page
+static inline bool onSamePage(const VkDeviceSize _offsetA,
+                              const VkDeviceSize _offsetB,
+                              const VkDeviceSize _pageSize)
+{
+  return _offsetA / _pageSize == _offsetB / _pageSize;
+}
+
+void MemoryAllocator::init(VkPhysicalDevice* _pPhysicalDevice, VkDevice* _pLogicalDevice)
+{
+  m_pPhysicalDevice = _pPhysicalDevice;
+  m_pLogicalDevice  = _pLogicalDevice;
+
+  VkPhysicalDeviceProperties properties{};
+  vkGetPhysicalDeviceProperties(*m_pPhysicalDevice, &properties);
+  m_bufferImageGranularity = std::max<VkDeviceSize>(properties.limits.bufferImageGranularity, 1);
+  m_nonCoherentAtomSize    = std::max<VkDeviceSize>(properties.limits.nonCoherentAtomSize, 1);
+
+  vkGetPhysicalDeviceMemoryProperties(*m_pPhysicalDevice, &m_memoryProperties);
+  m_blocks.resize(m_memoryProperties.memoryTypeCount);
+}
+
+uint32_t MemoryAllocator::findMemoryType(const uint32_t              _typeFilter,
+                                         const VkMemoryPropertyFlags _properties)
+{
+  for (uint32_t i=0; i<m_memoryProperties.memoryTypeCount; ++i)
+  {
+    // ALL the requested properties must be supported, not just any of them
+    if (_typeFilter & (1 << i) &&
+        (m_memoryProperties.memoryTypes[i].propertyFlags & _properties) == _properties)
+    {
+      return i;
+    }
+  }
+
+  throw std::runtime_error("ERROR: MemoryAllocator::findMemoryType - Failed!");
+}
+
+VkDeviceSize MemoryAllocator::getBlockSize(const uint32_t _memoryTypeIdx) const
+{
+  const uint32_t     heapIdx  = m_memoryProperties.memoryTypes[_memoryTypeIdx].heapIndex;
+  const VkDeviceSize heapSize = m_memoryProperties.memoryHeaps[heapIdx].size;
+
+  // Don't let a single block take a big chunk of small heaps
+  return std::min(DEFAULT_MEMORY_BLOCK_SIZE, heapSize / 8);
+}
+
+MemoryBlock* MemoryAllocator::createBlock(const uint32_t _memoryTypeIdx, const VkDeviceSize _size)
+{
+  VkMemoryAllocateInfo allocInfo{};
+  allocInfo.sType           = VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_INFO;
+  allocInfo.allocationSize  = _size;
+  allocInfo.memoryTypeIndex = _memoryTypeIdx;
+
+  VkDeviceMemory memory = VK_NULL_HANDLE;
+  if (vkAllocateMemory(*m_pLogicalDevice, &allocInfo, nullptr, &memory) != VK_SUCCESS)
+    return nullptr;
+
+  const VkMemoryPropertyFlags flags = m_memoryProperties.memoryTypes[_memoryTypeIdx].propertyFlags;
+
+  auto pBlock = std::make_unique<MemoryBlock>();
+  pBlock->memory        = memory;
+  pBlock->size          = _size;
+  pBlock->memoryTypeIdx = _memoryTypeIdx;
+  pBlock->isCoherent    = flags & VK_MEMORY_PROPERTY_HOST_COHERENT_BIT;
+  pBlock->ranges.emplace(0, MemoryBlock::Range{_size, true, ResourceType::LINEAR});
+
+  // Map once and keep it that way, mapping is expensive and a VkDeviceMemory can't be mapped twice
+  if (flags & VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT &&
+      vkMapMemory(*m_pLogicalDevice, memory, 0, VK_WHOLE_SIZE, 0, &pBlock->pMapped) != VK_SUCCESS)
+  {
+    vkFreeMemory(*m_pLogicalDevice, memory, nullptr);
+    throw std::runtime_error("ERROR: MemoryAllocator::createBlock - Failed to map memory!");
+  }
+
+  m_blocks.at(_memoryTypeIdx).push_back( std::move(pBlock) );
+
+  return m_blocks.at(_memoryTypeIdx).back().get();
+}
+
+void MemoryAllocator::destroyBlock(MemoryBlock* _pBlock)
+{
+  auto& blocks = m_blocks.at(_pBlock->memoryTypeIdx);
+
+  for (auto it = blocks.begin(); it != blocks.end(); ++it)
+  {
+    if (it->get() != _pBlock) continue;
+
+    // Freeing the memory implicitly unmaps it
+    vkFreeMemory(*m_pLogicalDevice, _pBlock->memory, nullptr);
+    blocks.erase(it);
+    return;
+  }
+}
+
+bool MemoryAllocator::tryAllocateFromBlock(MemoryBlock&       _block,
+                                           const VkDeviceSize _size,
+                                           const VkDeviceSize _alignment,
+                                           const ResourceType _type,
+                                           MemoryAllocation&  _result)
+{
+  const VkDeviceSize pageSize = m_bufferImageGranularity;
+
+  // First fit
+  for (auto it = _block.ranges.begin(); it != _block.ranges.end(); ++it)
+  {
+    if (!it->second.isFree || it->second.size < _size) continue;
+
+    const VkDeviceSize rangeStart = it->first;
+    const VkDeviceSize rangeEnd   = rangeStart + it->second.size;
+
+    VkDeviceSize offset = alignUp(rangeStart, _alignment);
+
+    // Free ranges are always coalesced, so the neighbours (if any) are in use
+    if (pageSize > 1 && it != _block.ranges.begin())
+    {
+      const auto& prev = *std::prev(it);
+      if (prev.second.type != _type &&
+          onSamePage(prev.first + prev.second.size - 1, offset, pageSize))
+      {
+        offset = alignUp(offset, pageSize);
+      }
+    }
+
+    if (offset + _size > rangeEnd) continue;
+
+    const auto next = std::next(it);
+    if (pageSize > 1 && next != _block.ranges.end() &&
+        next->second.type != _type &&
+        onSamePage(offset + _size - 1, next->first, pageSize))
+    {
+      continue;
+    }
+
+    // Split the free range into [padding][allocation][tail]
+    const VkDeviceSize padding = offset - rangeStart;
+    const VkDeviceSize tail    = rangeEnd - (offset + _size);
+
+    if (padding > 0)
+      it->second.size = padding;
+    else
+      _block.ranges.erase(it);
+
+    _block.ranges.emplace(offset, MemoryBlock::Range{_size, false, _type});
+
+    if (tail > 0)
+      _block.ranges.emplace(offset + _size, MemoryBlock::Range{tail, true, _type});
+
+    _result.memory        = _block.memory;
+    _result.offset        = offset;
+    _result.size          = _size;
+    _result.memoryTypeIdx = _block.memoryTypeIdx;
+    _result.pBlock        = &_block;
+    _result.pMapped       = _block.pMapped ? static_cast<char*>(_block.pMapped) + offset : nullptr;
+
+    return true;
+  }
+
+  return false;
+}
+
+MemoryAllocation MemoryAllocator::allocate(const VkMemoryRequirements& _requirements,
+                                           const VkMemoryPropertyFlags _properties,
+                                           const ResourceType          _type)
+{
+  if (m_pLogicalDevice == nullptr)
+    throw std::runtime_error("ERROR: MemoryAllocator::allocate - Not initialized!");
+
+  MemoryAllocation result{};
+
+  const uint32_t     memoryTypeIdx = this->findMemoryType(_requirements.memoryTypeBits, _properties);
+  const VkDeviceSize blockSize     = this->getBlockSize(memoryTypeIdx);
+  const VkDeviceSize alignment     = std::max<VkDeviceSize>(_requirements.alignment, 1);
+
+  // Big resources get their own memory so they don't waste (or fragment) the shared blocks
+  if (_requirements.size > blockSize / 2)
+  {
+    MemoryBlock* pBlock = this->createBlock(memoryTypeIdx, _requirements.size);
+    if (pBlock == nullptr)
+      throw std::runtime_error("ERROR: MemoryAllocator::allocate - Failed allocating dedicated memory!");
+
+    pBlock->isDedicated = true;
+    this->tryAllocateFromBlock(*pBlock, _requirements.size, alignment, _type, result);
+    return result;
+  }
+
+  for (auto& pBlock : m_blocks.at(memoryTypeIdx))
+  {
+    if (pBlock->isDedicated) continue;
+
+    if (this->tryAllocateFromBlock(*pBlock, _requirements.size, alignment, _type, result))
+      return result;
+  }
+
+  MemoryBlock* pBlock = this->createBlock(memoryTypeIdx, blockSize);
+
+  // Fall back to a block just big enough if the heap is running out
+  if (pBlock == nullptr)
+    pBlock = this->createBlock(memoryTypeIdx, _requirements.size);
+
+  if (pBlock == nullptr ||
+      !this->tryAllocateFromBlock(*pBlock, _requirements.size, alignment, _type, result))
+  {
+    throw std::runtime_error("ERROR: MemoryAllocator::allocate - Failed allocating memory!");
+  }
+
+  return result;
+}
+
+void MemoryAllocator::free(MemoryAllocation& _allocation)
+{
+  if (!_allocation.isValid()) return;
+
+  MemoryBlock& block = *_allocation.pBlock;
+
+  auto it = block.ranges.find(_allocation.offset);
+  if (it == block.ranges.end() || it->second.isFree)
+  {
+    std::cout << "WARNING: MemoryAllocator::free - Unknown allocation or double free!" << std::endl;
+    return;
+  }
+
+  it->second.isFree = true;
+
+  // Coalesce with the neighbours
+  auto next = std::next(it);
+  if (next != block.ranges.end() && next->second.isFree)
+  {
+    it->second.size += next->second.size;
+    block.ranges.erase(next);
+  }
+
+  if (it != block.ranges.begin())
+  {
+    auto prev = std::prev(it);
+    if (prev->second.isFree)
+    {
+      prev->second.size += it->second.size;
+      block.ranges.erase(it);
+    }
+  }
+
+  _allocation = MemoryAllocation{};
+
+  if (!block.isEmpty()) return;
+
+  // Keep one empty shared block around per memory type to avoid thrashing
+  size_t sharedBlocks = 0;
+  for (const auto& pBlock : m_blocks.at(block.memoryTypeIdx))
+    if (!pBlock->isDedicated) ++sharedBlocks;
+
+  if (block.isDedicated || sharedBlocks > 1)
+    this->destroyBlock(&block);
+}
+
+MemoryAllocation MemoryAllocator::allocateForBuffer(const VkBuffer&             _buffer,
+                                                    const VkMemoryPropertyFlags _properties)
+{
+  VkMemoryRequirements memReq;
+  vkGetBufferMemoryRequirements(*m_pLogicalDevice, _buffer, &memReq);
+
+  MemoryAllocation result = this->allocate(memReq, _properties, ResourceType::LINEAR);
+
+  vkBindBufferMemory(*m_pLogicalDevice, _buffer, result.memory, result.offset);
+
+  return result;
+}
+
+MemoryAllocation MemoryAllocator::allocateForImage(const VkImage&              _image,
+                                                   const VkMemoryPropertyFlags _properties,
+                                                   const VkImageTiling         _tiling)
+{
+  VkMemoryRequirements memReq;
+  vkGetImageMemoryRequirements(*m_pLogicalDevice, _image, &memReq);
+
+  const ResourceType type = _tiling == VK_IMAGE_TILING_OPTIMAL ? ResourceType::OPTIMAL
+                                                               : ResourceType::LINEAR;
+
+  MemoryAllocation result = this->allocate(memReq, _properties, type);
+
+  vkBindImageMemory(*m_pLogicalDevice, _image, result.memory, result.offset);
+
+  return result;
+}
+
+void MemoryAllocator::flush(const MemoryAllocation& _allocation,
+                            const VkDeviceSize      _offset,
+                            const VkDeviceSize      _size)
+{
+  if (!_allocation.isMapped() || _allocation.pBlock->isCoherent) return;
+
+  const VkDeviceSize size  = _size == VK_WHOLE_SIZE ? _allocation.size - _offset : _size;
+  const VkDeviceSize start = _allocation.offset + _offset;
+
+  // The range must be aligned to nonCoherentAtomSize (or reach the end of the memory)
+  VkMappedMemoryRange range{};
+  range.sType  = VK_STRUCTURE_TYPE_MAPPED_MEMORY_RANGE;
+  range.memory = _allocation.memory;
+  range.offset = start / m_nonCoherentAtomSize * m_nonCoherentAtomSize;
+  range.size   = std::min(alignUp(start + size, m_nonCoherentAtomSize),
+                          _allocation.pBlock->size) - range.offset;
+
+  vkFlushMappedMemoryRanges(*m_pLogicalDevice, 1, &range);
+}
+
+MemoryAllocatorStats MemoryAllocator::getStats() const
+{
+  MemoryAllocatorStats stats{};
+
+  for (const auto& blocks : m_blocks)
+  {
+    for (const auto& pBlock : blocks)
+    {
+      ++stats.blockCount;
+      if (pBlock->isDedicated) ++stats.dedicatedCount;
+      stats.bytesReserved += pBlock->size;
+
+      for (const auto& range : pBlock->ranges)
+      {
+        if (range.second.isFree)
+        {
+          ++stats.freeRangeCount;
+        }
+        else
+        {
+          ++stats.allocationCount;
+          stats.bytesUsed += range.second.size;
+        }
+      }
+    }
+  }
+
+  return stats;
+}
+
+void MemoryAllocator::printStats() const
+{
+  const auto stats = this->getStats();
+
+  std::cout << "NOTE: MemoryAllocator - "
+            << stats.allocationCount << " allocations in "
+            << stats.blockCount      << " blocks ("
+            << stats.dedicatedCount  << " dedicated), "
+            << stats.bytesUsed       << "/"
+            << stats.bytesReserved   << " bytes used, "
+            << stats.freeRangeCount  << " free ranges."
+            << std::endl;
+}
+
+void MemoryAllocator::cleanUp()
+{
+  if (m_pLogicalDevice == nullptr) return;
+
+  const auto stats = this->getStats();
+  if (stats.allocationCount > 0)
+  {
+    std::cout << "WARNING: MemoryAllocator::cleanUp - "
+              << stats.allocationCount << " allocations were never freed!" << std::endl;
+  }
+
+  for (auto& blocks : m_blocks)
+  {
+    for (auto& pBlock : blocks)
+      vkFreeMemory(*m_pLogicalDevice, pBlock->memory, nullptr);
+
+    blocks.clear();
+  }
+
+  m_pLogicalDevice  = nullptr;
+  m_pPhysicalDevice = nullptr;
+}
+}
@@ -0,0 +1,147 @@
+#ifndef VP_MEMORY_ALLOCATOR_HPP
+#define VP_MEMORY_ALLOCATOR_HPP
+
+#include <vulkan/vulkan.h>
+
+#include <stdexcept>
+#include <iostream>
+#include <vector>
+#include <map>
+#include <algorithm>
+#include <memory>
+
+namespace vpe
+{
+constexpr VkDeviceSize DEFAULT_MEMORY_BLOCK_SIZE = 64 * 1024 * 1024; // 64MiB
+
+// Resources of different types that share a page of size bufferImageGranularity may alias
+enum class ResourceType
+{
+  LINEAR,  // Buffers and linear images
+  OPTIMAL  // Optimal tiling images
+};
+
+struct MemoryBlock;
+
+// A range inside a (shared) VkDeviceMemory block. Bind resources at memory + offset.
+struct MemoryAllocation
+{
+  VkDeviceMemory memory        = VK_NULL_HANDLE;
+  VkDeviceSize   offset        = 0;
+  VkDeviceSize   size          = 0;
+  uint32_t       memoryTypeIdx = UINT32_MAX;
+  MemoryBlock*   pBlock        = nullptr;
+  void*          pMapped       = nullptr; // Host visible memory stays mapped for its whole lifetime
+
+  inline bool isValid()  const { return pBlock != nullptr; }
+  inline bool isMapped() const { return pMapped != nullptr; }
+
+  // Direct pointer for bulk writes. Non coherent memory must be flushed afterwards.
+  template<typename T>
+  inline T* getMapped() const { return static_cast<T*>(pMapped); }
+};
+
+struct MemoryAllocatorStats
+{
+  size_t       blockCount      = 0; // Actual vkAllocateMemory calls alive
+  size_t       dedicatedCount  = 0; // Blocks with a single big allocation
+  size_t       allocationCount = 0;
+  size_t       freeRangeCount  = 0;
+  VkDeviceSize bytesReserved   = 0; // Device memory owned by the blocks
+  VkDeviceSize bytesUsed       = 0; // Sum of the allocations' sizes
+};
+
+// A VkDeviceMemory of a single memory type, split in contiguous ranges (used or free).
+struct MemoryBlock
+{
+  struct Range
+  {
+    VkDeviceSize size;
+    bool         isFree;
+    ResourceType type;
+  };
+
+  VkDeviceMemory memory        = VK_NULL_HANDLE;
+  VkDeviceSize   size          = 0;
+  uint32_t       memoryTypeIdx = UINT32_MAX;
+  bool           isDedicated   = false;
+  bool           isCoherent    = false;
+  void*          pMapped       = nullptr; // Whole block, only if host visible
+
+  // Ordered by offset and covering the whole block, so neighbours are adjacent in memory
+  std::map<VkDeviceSize, Range> ranges;
+
+  inline bool isEmpty() const { return ranges.size() == 1 && ranges.begin()->second.isFree; }
+};
+
+class MemoryAllocator
+{
+public:
+  MemoryAllocator(MemoryAllocator const&) = delete;
+  void operator=(MemoryAllocator const&)  = delete;
+
+  static inline MemoryAllocator& getInstance()
+  {
+    static MemoryAllocator instance;
+    return instance;
+  }
+
+  void init(VkPhysicalDevice* _pPhysicalDevice, VkDevice* _pLogicalDevice);
+
+  uint32_t findMemoryType(const uint32_t _typeFilter, const VkMemoryPropertyFlags _properties);
+
+  MemoryAllocation allocate(const VkMemoryRequirements& _requirements,
+                            const VkMemoryPropertyFlags _properties,
+                            const ResourceType          _type);
+
+  void free(MemoryAllocation& _allocation);
+
+  // Shortcuts that allocate AND bind
+  MemoryAllocation allocateForBuffer(const VkBuffer& _buffer, const VkMemoryPropertyFlags _properties);
+  MemoryAllocation allocateForImage(const VkImage&              _image,
+                                    const VkMemoryPropertyFlags _properties,
+                                    const VkImageTiling         _tiling = VK_IMAGE_TILING_OPTIMAL);
+
+  // Makes host writes visible to the device. Does nothing on coherent memory.
+  void flush(const MemoryAllocation& _allocation,
+             const VkDeviceSize      _offset = 0,
+             const VkDeviceSize      _size   = VK_WHOLE_SIZE);
+
+  MemoryAllocatorStats getStats() const;
+  void                 printStats() const;
+
+  void cleanUp();
+
+private:
+  MemoryAllocator() :
+    m_pPhysicalDevice(nullptr),
+    m_pLogicalDevice(nullptr),
+    m_bufferImageGranularity(1),
+    m_nonCoherentAtomSize(1),
+    m_memoryProperties{}
+  {}
+  ~MemoryAllocator() {}
+
+  VkPhysicalDevice* m_pPhysicalDevice;
+  VkDevice*         m_pLogicalDevice;
+
+  VkDeviceSize                     m_bufferImageGranularity;
+  VkDeviceSize                     m_nonCoherentAtomSize;
+  VkPhysicalDeviceMemoryProperties m_memoryProperties;
+
+  // Indexed by memory type
+  std::vector<std::vector<std::unique_ptr<MemoryBlock>>> m_blocks;
+
+  VkDeviceSize getBlockSize(const uint32_t _memoryTypeIdx) const;
+
+  MemoryBlock* createBlock(const uint32_t _memoryTypeIdx, const VkDeviceSize _size);
+  void         destroyBlock(MemoryBlock* _pBlock);
+
+  bool tryAllocateFromBlock(MemoryBlock&        _block,
+                            const VkDeviceSize  _size,
+                            const VkDeviceSize  _alignment,
+                            const ResourceType  _type,
+                            MemoryAllocation&   _result);
+};
+}
+#endif
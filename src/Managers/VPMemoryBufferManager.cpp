@@ -1,30 +1,19 @@
 #include "VPMemoryBufferManager.hpp"
+#include "VPUploadBatcher.hpp"
 
 namespace vpe
 {
 uint32_t MemoryBufferManager::findMemoryType(const uint32_t _typeFilter,
                                              const VkMemoryPropertyFlags _properties)
 {
-  VkPhysicalDeviceMemoryProperties availableMemoryProperties;
-  vkGetPhysicalDeviceMemoryProperties(*m_pPhysicalDevice, &availableMemoryProperties);
-
-  for (size_t i=0; i<availableMemoryProperties.memoryTypeCount; ++i)
-  {
-    if (_typeFilter & (1 << i) &&
-        availableMemoryProperties.memoryTypes[i].propertyFlags & _properties)
-    {
-      return i;
-    }
-  }
-
-  throw std::runtime_error("ERROR: VPMemoryBufferManager::findMemoryType - Failed!");
+  return MemoryAllocator::getInstance().findMemoryType(_typeFilter, _properties);
 }
 
 void MemoryBufferManager::createBuffer(const VkDeviceSize          _size,
                                        const VkBufferUsageFlags    _usage,
                                        const VkMemoryPropertyFlags _properties,
                                              VkBuffer*             _pBuffer,
-                                             VkDeviceMemory*       _pBufferMemory)
+                                             MemoryAllocation*     _pBufferMemory)
 {
   if (!m_pLogicalDevice || !m_pPhysicalDevice || !_pBuffer || !_pBufferMemory || _size == 0) return;
 
@@ -37,66 +26,56 @@ void MemoryBufferManager::createBuffer(const VkDeviceSize          _size,
   if (vkCreateBuffer(*m_pLogicalDevice, &bufferInfo, nullptr, _pBuffer) != VK_SUCCESS)
     throw std::runtime_error("ERROR: createBuffer - Failed!");
 
-  // Allocate memory
-  VkMemoryRequirements memReq;
-  vkGetBufferMemoryRequirements(*m_pLogicalDevice, *_pBuffer, &memReq);
-
-  VkMemoryAllocateInfo allocInfo{};
-  allocInfo.sType           = VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_INFO;
-  allocInfo.allocationSize  = memReq.size;
-  allocInfo.memoryTypeIndex = findMemoryType(memReq.memoryTypeBits,
-                                                  _properties);
+  // Sub-allocated from a shared block and bound
+  *_pBufferMemory = MemoryAllocator::getInstance().allocateForBuffer(*_pBuffer, _properties);
+}
 
-  if (vkAllocateMemory(*m_pLogicalDevice, &allocInfo, nullptr, _pBufferMemory) != VK_SUCCESS)
-    throw std::runtime_error("ERROR: createBuffer - Failed allocating memory!");
+void MemoryBufferManager::destroyBuffer(VkBuffer& _buffer, MemoryAllocation& _bufferMemory)
+{
+  vkDestroyBuffer(*m_pLogicalDevice, _buffer, nullptr);
+  MemoryAllocator::getInstance().free(_bufferMemory);
 
-  vkBindBufferMemory(*m_pLogicalDevice, *_pBuffer, *_pBufferMemory, 0);
+  _buffer = VK_NULL_HANDLE;
 }
 
+// Recorded into the current upload batch. It's visible to anything submitted after UploadBatcher::submit().
 void MemoryBufferManager::copyBuffer(const VkBuffer& _src,
                                            VkBuffer& _dst,
                                      const VkDeviceSize _size)
 {
-  CommandBufferManager& commandBufferManager = CommandBufferManager::getInstance();
-
-  // We can't copy to the GPU buffer directly, so we'll use a command buffer
-  VkCommandBuffer commandBuffer = commandBufferManager.beginSingleTimeCommand();
-
-  VkBufferCopy copyRegion{};
-  copyRegion.srcOffset = 0;
-  copyRegion.dstOffset = 0;
-  copyRegion.size      = _size;
-
-  vkCmdCopyBuffer(commandBuffer, _src, _dst, 1, &copyRegion);
-
-  commandBufferManager.endSingleTimeCommand(commandBuffer);
+  // Without knowing how the buffer will be used, make it visible to any read
+  UploadBatcher::getInstance().uploadBuffer(_src,
+                                            _dst,
+                                            _size,
+                                            VK_PIPELINE_STAGE_ALL_COMMANDS_BIT,
+                                            VK_ACCESS_MEMORY_READ_BIT);
 }
 
 void MemoryBufferManager::fillBuffer(VkBuffer*             _dst,
-                                     void*                 _content,
-                                     VkDeviceMemory&       _memory,
+                                     const void*           _content,
+                                     MemoryAllocation&     _memory,
                                      const VkDeviceSize    _size,
                                      VkBufferUsageFlags    _usage,
                                      VkMemoryPropertyFlags _properties)
 {
-  VkBuffer       stagingBuffer;
-  VkDeviceMemory stagingMemory;
-
-  createBuffer(_size,
-               VK_IMAGE_USAGE_TRANSFER_SRC_BIT,
-               VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT |
-               VK_MEMORY_PROPERTY_HOST_COHERENT_BIT,
-               &stagingBuffer,
-               &stagingMemory);
-
-  copyToBufferMemory(_content, stagingMemory, _size);
-
   createBuffer(_size, _usage, _properties, _dst, &_memory);
 
-  copyBuffer(stagingBuffer, *_dst, _size);
+  VkPipelineStageFlags dstStage  = VK_PIPELINE_STAGE_ALL_COMMANDS_BIT;
+  VkAccessFlags        dstAccess = VK_ACCESS_MEMORY_READ_BIT;
+
+  if (_usage & VK_BUFFER_USAGE_VERTEX_BUFFER_BIT)
+  {
+    dstStage  = VK_PIPELINE_STAGE_VERTEX_INPUT_BIT;
+    dstAccess = VK_ACCESS_VERTEX_ATTRIBUTE_READ_BIT;
+  }
+  else if (_usage & VK_BUFFER_USAGE_INDEX_BUFFER_BIT)
+  {
+    dstStage  = VK_PIPELINE_STAGE_VERTEX_INPUT_BIT;
+    dstAccess = VK_ACCESS_INDEX_READ_BIT;
+  }
 
-  vkDestroyBuffer(*m_pLogicalDevice, stagingBuffer, nullptr);
-  vkFreeMemory(*m_pLogicalDevice, stagingMemory, nullptr);
+  // Goes through the shared staging ring, no staging buffer of its own
+  UploadBatcher::getInstance().stageBuffer(_content, _size, *_dst, dstStage, dstAccess);
 }
 
 VkDescriptorPool MemoryBufferManager::createDescriptorPool(VkDescriptorPoolSize* _poolSizes,
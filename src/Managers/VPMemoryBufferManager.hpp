@@ -9,6 +9,7 @@
 #include <cstring>
 
 #include "VPCommandBufferManager.hpp"
+#include "VPMemoryAllocator.hpp"
 
 namespace vpe
 {
@@ -22,16 +23,17 @@ public:
     return instance;
   }
 
-  inline void copyToBufferMemory(void* _src,
-                                 VkDeviceMemory& _dstMemory,
-                                 const VkDeviceSize _size,
-                                 const VkDeviceSize _offset=0,
-                                 const VkMemoryMapFlags _flags=0)
+  // For bulk writes, write straight into _dstMemory.getMapped() instead
+  inline void copyToBufferMemory(const void*             _src,
+                                 const MemoryAllocation& _dstMemory,
+                                 const VkDeviceSize      _size,
+                                 const VkDeviceSize      _offset=0)
   {
-    void* data;
-    vkMapMemory(*m_pLogicalDevice, _dstMemory, _offset, _size, _flags, &data);
-    memcpy(data, _src, _size);
-    vkUnmapMemory(*m_pLogicalDevice, _dstMemory);
+    if (!_dstMemory.isMapped())
+      throw std::runtime_error("ERROR: copyToBufferMemory - The memory is not host visible!");
+
+    memcpy(_dstMemory.getMapped<char>() + _offset, _src, _size);
+    MemoryAllocator::getInstance().flush(_dstMemory, _offset, _size);
   }
 
   VkDevice*         m_pLogicalDevice;
@@ -44,13 +46,15 @@ public:
                     const VkBufferUsageFlags    _usage,
                     const VkMemoryPropertyFlags _properties,
                           VkBuffer*             _buffer,
-                          VkDeviceMemory*       _bufferMemory);
+                          MemoryAllocation*     _bufferMemory);
+
+  void destroyBuffer(VkBuffer& _buffer, MemoryAllocation& _bufferMemory);
 
   void copyBuffer(const VkBuffer& _srcBuffer, VkBuffer& _dst, const VkDeviceSize _size);
 
   void fillBuffer(VkBuffer*             _dst,
-                  void*                 _content,
-                  VkDeviceMemory&       _memory,
+                  const void*           _content,
+                  MemoryAllocation&     _memory,
                   const VkDeviceSize    _size,
                   VkBufferUsageFlags    _usage,
                   VkMemoryPropertyFlags _properties);
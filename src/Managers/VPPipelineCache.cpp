@@ -0,0 +1,172 @@
+#include "VPPipelineCache.hpp"
+#include "../VPHash.hpp"
+#include "../VPMappedFile.hpp"
+
+#include <fstream>
+#include <filesystem>
+
+namespace vpe
+{
+void PipelineCache::init(VkDevice*               _pLogicalDevice,
+                         const VkPhysicalDevice& _physicalDevice,
+                         const bool              _hasCreationFeedback)
+{
+  m_pLogicalDevice      = _pLogicalDevice;
+  m_hasCreationFeedback = _hasCreationFeedback;
+  m_stats               = PipelineCacheStats{};
+
+  vkGetPhysicalDeviceProperties(_physicalDevice, &m_properties);
+
+  const std::vector<char> data = this->loadData();
+  m_loadedSize = data.size();
+
+  VkPipelineCacheCreateInfo cacheInfo{};
+  cacheInfo.sType           = VK_STRUCTURE_TYPE_PIPELINE_CACHE_CREATE_INFO;
+  cacheInfo.initialDataSize = data.size();
+  cacheInfo.pInitialData    = data.empty() ? nullptr : data.data();
+
+  if (vkCreatePipelineCache(*m_pLogicalDevice, &cacheInfo, nullptr, &m_cache) != VK_SUCCESS)
+  {
+    // The driver rejected the blob. Starting empty is always valid.
+    std::cout << "WARNING: PipelineCache::init - Couldn't use " << PIPELINE_CACHE_PATH << ". Starting empty." << std::endl;
+
+    cacheInfo.initialDataSize = 0;
+    cacheInfo.pInitialData    = nullptr;
+    m_loadedSize              = 0;
+
+    if (vkCreatePipelineCache(*m_pLogicalDevice, &cacheInfo, nullptr, &m_cache) != VK_SUCCESS)
+      throw std::runtime_error("ERROR: PipelineCache::init - Failed to create the pipeline cache!");
+  }
+
+  if (m_loadedSize > 0)
+    std::cout << "NOTE: PipelineCache::init - Loaded " << m_loadedSize << " bytes from " << PIPELINE_CACHE_PATH << std::endl;
+}
+
+std::vector<char> PipelineCache::loadData() const
+{
+  std::vector<char> result;
+
+  const MappedFile file(PIPELINE_CACHE_PATH);
+  if (!file.isValid() || file.size() < sizeof(Header)) return result;
+
+  Header header;
+  memcpy(&header, file.data(), sizeof(Header));
+
+  if (header.magic         != PIPELINE_CACHE_MAGIC        ||
+      header.version       != PIPELINE_CACHE_VERSION      ||
+      header.vendorID      != m_properties.vendorID       ||
+      header.deviceID      != m_properties.deviceID       ||
+      header.driverVersion != m_properties.driverVersion  ||
+      memcmp(header.pipelineCacheUUID, m_properties.pipelineCacheUUID, VK_UUID_SIZE) != 0)
+  {
+    std::cout << "NOTE: PipelineCache::loadData - " << PIPELINE_CACHE_PATH
+              << " was written by another device or driver. Ignoring it." << std::endl;
+    return result;
+  }
+
+  const char* pData = file.data<char>(sizeof(Header));
+
+  if (header.dataSize != file.size() - sizeof(Header) || fnv1a(pData, header.dataSize) != header.dataHash)
+  {
+    std::cout << "WARNING: PipelineCache::loadData - " << PIPELINE_CACHE_PATH << " is corrupt. Ignoring it." << std::endl;
+    return result;
+  }
+
+  result.assign(pData, pData + header.dataSize);
+
+  return result;
+}
+
+void PipelineCache::recordCreation(const VkPipelineCreationFeedbackEXT* _pFeedback, const double _durationMs)
+{
+  ++m_stats.created;
+  m_stats.durationMs += _durationMs;
+
+  if (_pFeedback == nullptr || (_pFeedback->flags & VK_PIPELINE_CREATION_FEEDBACK_VALID_BIT_EXT) == 0)
+    ++m_stats.unknown;
+  else if (_pFeedback->flags & VK_PIPELINE_CREATION_FEEDBACK_APPLICATION_PIPELINE_CACHE_HIT_BIT_EXT)
+    ++m_stats.hits;
+  else
+    ++m_stats.misses;
+}
+
+bool PipelineCache::save() const
+{
+  if (m_cache == VK_NULL_HANDLE) return false;
+
+  size_t dataSize = 0;
+  if (vkGetPipelineCacheData(*m_pLogicalDevice, m_cache, &dataSize, nullptr) != VK_SUCCESS || dataSize == 0)
+    return false;
+
+  std::vector<char> data(dataSize);
+  if (vkGetPipelineCacheData(*m_pLogicalDevice, m_cache, &dataSize, data.data()) != VK_SUCCESS)
+    return false;
+
+  Header header{};
+  header.magic         = PIPELINE_CACHE_MAGIC;
+  header.version       = PIPELINE_CACHE_VERSION;
+  header.vendorID      = m_properties.vendorID;
+  header.deviceID      = m_properties.deviceID;
+  header.driverVersion = m_properties.driverVersion;
+  header.dataSize      = dataSize;
+  header.dataHash      = fnv1a(data.data(), dataSize);
+  memcpy(header.pipelineCacheUUID, m_properties.pipelineCacheUUID, VK_UUID_SIZE);
+
+  const std::filesystem::path path(PIPELINE_CACHE_PATH);
+  std::error_code error;
+  std::filesystem::create_directories(path.parent_path(), error);
+  if (error)
+  {
+    std::cout << "WARNING: PipelineCache::save - Couldn't create the cache folder: " << error.message() << std::endl;
+    return false;
+  }
+
+  const std::string tmpPath = path.string() + ".tmp";
+  {
+    std::ofstream file(tmpPath, std::ios::binary | std::ios::trunc);
+    file.write(reinterpret_cast<const char*>(&header), sizeof(Header));
+    file.write(data.data(), dataSize);
+
+    if (!file.good())
+    {
+      std::cout << "WARNING: PipelineCache::save - Failed writing " << tmpPath << std::endl;
+      return false;
+    }
+  }
+
+  std::filesystem::rename(tmpPath, path, error);
+  if (error)
+  {
+    std::cout << "WARNING: PipelineCache::save - Couldn't move " << tmpPath << ": " << error.message() << std::endl;
+    std::filesystem::remove(tmpPath, error);
+    return false;
+  }
+
+  return true;
+}
+
+void PipelineCache::printStats() const
+{
+  std::cout << "NOTE: PipelineCache - " << m_stats.created << " pipelines created in "
+            << m_stats.durationMs << "ms";
+
+  if (m_hasCreationFeedback)
+    std::cout << ". Cache hits: " << m_stats.hits << ", misses: " << m_stats.misses
+              << " (" << m_stats.getHitRate() * 100.0f << "% hit rate)";
+  else
+    std::cout << ". No creation feedback, hits unknown";
+
+  std::cout << ". Started with " << m_loadedSize << " cached bytes." << std::endl;
+}
+
+void PipelineCache::cleanUp()
+{
+  if (m_cache == VK_NULL_HANDLE) return;
+
+  this->printStats();
+  this->save();
+
+  vkDestroyPipelineCache(*m_pLogicalDevice, m_cache, nullptr);
+  m_cache = VK_NULL_HANDLE;
+}
+}
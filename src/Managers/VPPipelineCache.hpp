@@ -0,0 +1,102 @@
+#ifndef VP_PIPELINE_CACHE_HPP
+#define VP_PIPELINE_CACHE_HPP
+
+#include <vulkan/vulkan.h>
+
+#include <iostream>
+#include <stdexcept>
+#include <cstring>
+#include <vector>
+
+namespace vpe
+{
+// Relative to the working directory, like the mesh cache
+const char* const PIPELINE_CACHE_PATH = "../Cache/pipelines.vppso";
+
+constexpr uint32_t PIPELINE_CACHE_MAGIC   = 0x4F535056; // "VPSO"
+constexpr uint32_t PIPELINE_CACHE_VERSION = 1;
+
+// Hits and misses of the pipeline creations. Only known with VK_EXT_pipeline_creation_feedback.
+struct PipelineCacheStats
+{
+  uint32_t created    = 0;
+  uint32_t hits       = 0;
+  uint32_t misses     = 0;
+  uint32_t unknown    = 0; // No feedback
+  double   durationMs = 0.0;
+
+  inline float getHitRate() const
+  {
+    const uint32_t known = hits + misses;
+    return known > 0 ? float(hits) / known : 0.0f;
+  }
+};
+
+// A single VkPipelineCache for every pipeline, loaded from disk on init and saved on cleanUp.
+// The driver validates its own blob too, but some silently accept (or crash on) stale data,
+// so the file is rejected unless it was written by the same device and driver.
+class PipelineCache
+{
+public:
+  PipelineCache(PipelineCache const&) = delete;
+  void operator=(PipelineCache const&) = delete;
+
+  static inline PipelineCache& getInstance()
+  {
+    static PipelineCache instance;
+    return instance;
+  }
+
+  // _hasCreationFeedback: VK_EXT_pipeline_creation_feedback was enabled on the device
+  void init(VkDevice* _pLogicalDevice, const VkPhysicalDevice& _physicalDevice, const bool _hasCreationFeedback);
+
+  inline VkPipelineCache getCache()              const { return m_cache; }
+  inline bool            hasCreationFeedback()   const { return m_hasCreationFeedback; }
+  inline const PipelineCacheStats& getStats()    const { return m_stats; }
+
+  // _pFeedback: the pipeline's VkPipelineCreationFeedbackEXT, nullptr without the extension
+  void recordCreation(const VkPipelineCreationFeedbackEXT* _pFeedback, const double _durationMs);
+
+  // Written aside and renamed, like the mesh cache
+  bool save() const;
+
+  void printStats() const;
+
+  // Saves it first
+  void cleanUp();
+
+private:
+  // Followed by the driver's blob
+  struct Header
+  {
+    uint32_t magic;
+    uint32_t version;
+    uint32_t vendorID;
+    uint32_t deviceID;
+    uint32_t driverVersion;
+    uint8_t  pipelineCacheUUID[VK_UUID_SIZE];
+    uint64_t dataSize;
+    uint64_t dataHash;
+  };
+
+  PipelineCache() :
+    m_pLogicalDevice(nullptr),
+    m_properties{},
+    m_cache(VK_NULL_HANDLE),
+    m_hasCreationFeedback(false),
+    m_loadedSize(0)
+  {}
+  ~PipelineCache() {}
+
+  VkDevice*                  m_pLogicalDevice;
+  VkPhysicalDeviceProperties m_properties;
+  VkPipelineCache            m_cache;
+  bool                       m_hasCreationFeedback;
+  size_t                     m_loadedSize;
+  PipelineCacheStats         m_stats;
+
+  // Empty if there's no file or it's not valid for this device
+  std::vector<char> loadData() const;
+};
+}
+#endif
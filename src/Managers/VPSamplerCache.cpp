@@ -0,0 +1,82 @@
+#include "VPSamplerCache.hpp"
+#include "VPMemoryBufferManager.hpp"
+#include "../VPHash.hpp"
+
+#include <algorithm>
+
+namespace vpe
+{
+SamplerState::SamplerState(const VkSamplerCreateInfo& _info) :
+  flags(_info.flags),
+  magFilter(_info.magFilter),
+  minFilter(_info.minFilter),
+  mipmapMode(_info.mipmapMode),
+  addressModeU(_info.addressModeU),
+  addressModeV(_info.addressModeV),
+  addressModeW(_info.addressModeW),
+  mipLodBias(_info.mipLodBias),
+  anisotropyEnable(_info.anisotropyEnable),
+  maxAnisotropy(_info.anisotropyEnable ? _info.maxAnisotropy : 0.0f), // Ignored when disabled
+  compareEnable(_info.compareEnable),
+  compareOp(_info.compareEnable ? _info.compareOp : VK_COMPARE_OP_NEVER), // Ignored when disabled
+  minLod(_info.minLod),
+  maxLod(_info.maxLod),
+  borderColor(_info.borderColor),
+  unnormalizedCoordinates(_info.unnormalizedCoordinates)
+{}
+
+size_t SamplerCache::StateHash::operator()(const SamplerState& _state) const
+{
+  return static_cast<size_t>( fnv1a(_state) );
+}
+
+VkSampler SamplerCache::get(const VkSamplerCreateInfo& _info)
+{
+  if (_info.pNext != nullptr)
+    throw std::runtime_error("ERROR: SamplerCache::get - Sampler create info chains aren't supported!");
+
+  auto& bufferManager = MemoryBufferManager::getInstance();
+
+  if (m_maxAnisotropy == 0.0f)
+  {
+    VkPhysicalDeviceProperties properties{};
+    vkGetPhysicalDeviceProperties(*bufferManager.m_pPhysicalDevice, &properties);
+    m_maxAnisotropy = properties.limits.maxSamplerAnisotropy;
+  }
+
+  VkSamplerCreateInfo info = _info;
+  info.maxAnisotropy       = std::min(info.maxAnisotropy, m_maxAnisotropy);
+
+  ++m_requestCount;
+
+  const SamplerState state(info);
+  const auto it = m_samplers.find(state);
+  if (it != m_samplers.end()) return it->second;
+
+  VkSampler sampler = VK_NULL_HANDLE;
+  if (vkCreateSampler(*bufferManager.m_pLogicalDevice, &info, nullptr, &sampler) != VK_SUCCESS)
+    throw std::runtime_error("ERROR: SamplerCache::get - Failed to create the sampler!");
+
+  m_samplers.emplace(state, sampler);
+
+  return sampler;
+}
+
+void SamplerCache::cleanUp()
+{
+  if (!m_samplers.empty())
+  {
+    std::cout << "NOTE: SamplerCache - " << m_requestCount << " sampler requests, "
+              << m_samplers.size() << " samplers." << std::endl;
+  }
+
+  const VkDevice& logicalDevice = *MemoryBufferManager::getInstance().m_pLogicalDevice;
+
+  for (auto& stateAndSampler : m_samplers)
+    vkDestroySampler(logicalDevice, stateAndSampler.second, nullptr);
+
+  m_samplers.clear();
+  m_maxAnisotropy = 0.0f;
+  m_requestCount  = 0;
+}
+}
@@ -0,0 +1,76 @@
+#ifndef VP_SAMPLER_CACHE_HPP
+#define VP_SAMPLER_CACHE_HPP
+
+#include <vulkan/vulkan.h>
+
+#include <iostream>
+#include <stdexcept>
+#include <cstring>
+#include <unordered_map>
+
+namespace vpe
+{
+// Every field of a VkSamplerCreateInfo but the structure type and the chain, without padding
+struct SamplerState
+{
+  uint32_t flags;
+  uint32_t magFilter;
+  uint32_t minFilter;
+  uint32_t mipmapMode;
+  uint32_t addressModeU;
+  uint32_t addressModeV;
+  uint32_t addressModeW;
+  float    mipLodBias;
+  uint32_t anisotropyEnable;
+  float    maxAnisotropy;
+  uint32_t compareEnable;
+  uint32_t compareOp;
+  float    minLod;
+  float    maxLod;
+  uint32_t borderColor;
+  uint32_t unnormalizedCoordinates;
+
+  explicit SamplerState(const VkSamplerCreateInfo& _info);
+
+  inline bool operator==(const SamplerState& _other) const { return memcmp(this, &_other, sizeof(SamplerState)) == 0; }
+};
+
+// One VkSampler per distinct sampler state, shared by every image using it.
+// Drivers only allow a few thousand samplers (maxSamplerAllocationCount) but there are just a handful of states.
+// The samplers live until cleanUp. Not thread safe, the images are created on the main thread.
+class SamplerCache
+{
+public:
+  SamplerCache(SamplerCache const&) = delete;
+  void operator=(SamplerCache const&) = delete;
+
+  static inline SamplerCache& getInstance()
+  {
+    static SamplerCache instance;
+    return instance;
+  }
+
+  // The anisotropy is clamped to the device's limit first. Extension chains (pNext) aren't supported.
+  VkSampler get(const VkSamplerCreateInfo& _info);
+
+  inline size_t getRequestCount() const { return m_requestCount; }
+  inline size_t getSamplerCount() const { return m_samplers.size(); }
+
+  // Nothing can be using them anymore
+  void cleanUp();
+
+private:
+  struct StateHash
+  {
+    size_t operator()(const SamplerState& _state) const;
+  };
+
+  SamplerCache() : m_maxAnisotropy(0.0f), m_requestCount(0) {}
+  ~SamplerCache() {}
+
+  std::unordered_map<SamplerState, VkSampler, StateHash> m_samplers;
+  float                                                  m_maxAnisotropy; // 0 until the device is queried
+  size_t                                                 m_requestCount;
+};
+}
+#endif
@@ -0,0 +1,82 @@
+#include "VPShaderRegistry.hpp"
+#include "VPMemoryBufferManager.hpp"
+#include "../VPResourcesLoader.hpp"
+#include "../VPHash.hpp"
+
+namespace vpe
+{
+const Shader& ShaderRegistry::load(const char* _path)
+{
+  const auto it = m_shadersByPath.find(_path);
+  if (it != m_shadersByPath.end() && it->second != nullptr) return *it->second;
+
+  // Also retries the optional files that were missing before
+  return *this->add(_path);
+}
+
+const Shader* ShaderRegistry::tryLoad(const char* _path)
+{
+  const auto it = m_shadersByPath.find(_path);
+  if (it != m_shadersByPath.end()) return it->second;
+
+  if (!std::ifstream(_path).good())
+  {
+    m_shadersByPath.emplace(_path, nullptr);
+    return nullptr;
+  }
+
+  return this->add(_path);
+}
+
+const Shader* ShaderRegistry::add(const std::string& _path)
+{
+  std::vector<char> code = resourcesLoader::parseShaderFile(_path.c_str());
+  ++m_fileReadCount;
+
+  const uint64_t hash = fnv1a(code.data(), code.size());
+
+  // Same contents under another path (a copy, a symlink...)
+  auto& pShader = m_shaders[hash];
+  if (pShader == nullptr)
+  {
+    pShader = std::make_unique<Shader>();
+    pShader->hash   = hash;
+    pShader->code   = std::move(code);
+    pShader->module = VK_NULL_HANDLE;
+
+    VkShaderModuleCreateInfo createInfo{};
+    createInfo.sType    = VK_STRUCTURE_TYPE_SHADER_MODULE_CREATE_INFO;
+    createInfo.codeSize = pShader->code.size();
+    createInfo.pCode    = reinterpret_cast<const uint32_t*>(pShader->code.data());
+
+    const VkDevice& logicalDevice = *MemoryBufferManager::getInstance().m_pLogicalDevice;
+    if (vkCreateShaderModule(logicalDevice, &createInfo, nullptr, &pShader->module) != VK_SUCCESS)
+    {
+      m_shaders.erase(hash);
+      throw std::runtime_error("ERROR: ShaderRegistry::add - Failed to create the shader module!");
+    }
+  }
+
+  m_shadersByPath[_path] = pShader.get();
+
+  return pShader.get();
+}
+
+void ShaderRegistry::cleanUp()
+{
+  if (!m_shaders.empty())
+  {
+    std::cout << "NOTE: ShaderRegistry - " << m_fileReadCount << " shader files read, "
+              << m_shaders.size() << " shader modules." << std::endl;
+  }
+
+  const VkDevice& logicalDevice = *MemoryBufferManager::getInstance().m_pLogicalDevice;
+
+  for (auto& hashAndShader : m_shaders)
+    vkDestroyShaderModule(logicalDevice, hashAndShader.second->module, nullptr);
+
+  m_shaders.clear();
+  m_shadersByPath.clear();
+  m_fileReadCount = 0;
+}
+}
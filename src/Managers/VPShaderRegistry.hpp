@@ -0,0 +1,58 @@
+#ifndef VP_SHADER_REGISTRY_HPP
+#define VP_SHADER_REGISTRY_HPP
+
+#include <vulkan/vulkan.h>
+
+#include <string>
+#include <vector>
+#include <memory>
+#include <unordered_map>
+
+namespace vpe
+{
+struct Shader
+{
+  uint64_t          hash;   // Of the SPIR-V, identical blobs are the same Shader
+  std::vector<char> code;
+  VkShaderModule    module; // Alive until ShaderRegistry::cleanUp
+};
+
+// Loads each SPIR-V file once and keeps a single VkShaderModule per distinct blob.
+// Materials only hold pointers to the shaders, which stay valid until cleanUp.
+// Not thread safe, materials are created on the main thread.
+class ShaderRegistry
+{
+public:
+  ShaderRegistry(ShaderRegistry const&) = delete;
+  void operator=(ShaderRegistry const&) = delete;
+
+  static inline ShaderRegistry& getInstance()
+  {
+    static ShaderRegistry instance;
+    return instance;
+  }
+
+  // The file is only read the first time its path is requested. Throws if it can't be read.
+  const Shader& load(const char* _path);
+
+  // For optional variants. nullptr if the file doesn't exist.
+  const Shader* tryLoad(const char* _path);
+
+  inline size_t getFileReadCount() const { return m_fileReadCount; }
+  inline size_t getModuleCount()   const { return m_shaders.size(); }
+
+  // The pipelines created with them keep working
+  void cleanUp();
+
+private:
+  ShaderRegistry() : m_fileReadCount(0) {}
+  ~ShaderRegistry() {}
+
+  std::unordered_map<std::string, const Shader*>       m_shadersByPath; // nullptr for missing optional files
+  std::unordered_map<uint64_t, std::unique_ptr<Shader>> m_shaders;
+  size_t                                                m_fileReadCount;
+
+  const Shader* add(const std::string& _path);
+};
+}
+#endif
@@ -0,0 +1,64 @@
+#include "VPStagingRing.hpp"
+
+namespace vpe
+{
+void StagingRing::create(VkDevice* _pLogicalDevice, const VkDeviceSize _size)
+{
+  if (this->isValid()) return;
+
+  m_pLogicalDevice = _pLogicalDevice;
+  m_size           = _size;
+  m_head           = 0;
+  m_tail           = 0;
+
+  VkBufferCreateInfo bufferInfo{};
+  bufferInfo.sType       = VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO;
+  bufferInfo.size        = m_size;
+  bufferInfo.usage       = VK_BUFFER_USAGE_TRANSFER_SRC_BIT;
+  bufferInfo.sharingMode = VK_SHARING_MODE_EXCLUSIVE; // Only ever read by the upload queue
+
+  if (vkCreateBuffer(*m_pLogicalDevice, &bufferInfo, nullptr, &m_buffer) != VK_SUCCESS)
+    throw std::runtime_error("ERROR: StagingRing::create - Failed to create the buffer!");
+
+  m_memory = MemoryAllocator::getInstance().allocateForBuffer(m_buffer,
+                                                              VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT |
+                                                              VK_MEMORY_PROPERTY_HOST_COHERENT_BIT);
+
+  if (!m_memory.isMapped())
+    throw std::runtime_error("ERROR: StagingRing::create - The memory is not host visible!");
+}
+
+bool StagingRing::tryAllocate(const VkDeviceSize _size, const VkDeviceSize _alignment, VkDeviceSize& _offset)
+{
+  if (_size == 0 || _size > m_size) return false;
+
+  // Aligned inside the buffer, the size doesn't have to be a multiple of the alignment
+  const VkDeviceSize headOffset = m_head % m_size;
+  VkDeviceSize       offset     = (headOffset + _alignment - 1) / _alignment * _alignment;
+
+  // It would straddle the end of the buffer, so skip the leftover and start from the beginning
+  if (offset + _size > m_size) offset = m_size;
+
+  const VkDeviceSize start = m_head + (offset - headOffset);
+
+  if (start + _size - m_tail > m_size) return false;
+
+  m_head  = start + _size;
+  _offset = start % m_size;
+
+  return true;
+}
+
+void StagingRing::cleanUp()
+{
+  if (!this->isValid()) return;
+
+  vkDestroyBuffer(*m_pLogicalDevice, m_buffer, nullptr);
+  MemoryAllocator::getInstance().free(m_memory);
+
+  m_buffer = VK_NULL_HANDLE;
+  m_size   = 0;
+  m_head   = 0;
+  m_tail   = 0;
+}
+}
@@ -0,0 +1,67 @@
+#ifndef VP_STAGING_RING_HPP
+#define VP_STAGING_RING_HPP
+
+#include <vulkan/vulkan.h>
+
+#include <stdexcept>
+
+#include "VPMemoryAllocator.hpp"
+
+namespace vpe
+{
+constexpr VkDeviceSize DEFAULT_STAGING_RING_SIZE = 32 * 1024 * 1024; // 32MiB
+
+// A single persistently mapped, host visible buffer that every upload stages its data in.
+// Allocations are carved from the head. Space is given back from the tail, in order, once the GPU
+// is done reading it (see UploadBatcher, which tracks it with the batches' fences).
+//
+// Positions are absolute byte counters that only grow. The offset inside the buffer is position % size.
+class StagingRing
+{
+public:
+  StagingRing() :
+    m_pLogicalDevice(nullptr),
+    m_buffer(VK_NULL_HANDLE),
+    m_memory(),
+    m_size(0),
+    m_head(0),
+    m_tail(0)
+  {}
+
+  ~StagingRing() { this->cleanUp(); }
+
+  void create(VkDevice* _pLogicalDevice, const VkDeviceSize _size = DEFAULT_STAGING_RING_SIZE);
+
+  // Returns false if there's not enough contiguous space left. Never wraps an allocation.
+  bool tryAllocate(const VkDeviceSize _size, const VkDeviceSize _alignment, VkDeviceSize& _offset);
+
+  // Everything allocated before _position is no longer in use
+  inline void release(const VkDeviceSize _position)
+  {
+    if (_position > m_head)
+      throw std::runtime_error("ERROR: StagingRing::release - Releasing past the head!");
+
+    m_tail = std::max(m_tail, _position);
+  }
+
+  inline void* getMapped(const VkDeviceSize _offset) const { return m_memory.getMapped<char>() + _offset; }
+
+  inline const VkBuffer& getBuffer()   const { return m_buffer; }
+  inline VkDeviceSize    getSize()     const { return m_size; }
+  inline VkDeviceSize    getHead()     const { return m_head; }
+  inline VkDeviceSize    getUsedSize() const { return m_head - m_tail; }
+  inline bool            isEmpty()     const { return m_head == m_tail; }
+  inline bool            isValid()     const { return m_buffer != VK_NULL_HANDLE; }
+
+  void cleanUp();
+
+private:
+  VkDevice*        m_pLogicalDevice;
+  VkBuffer         m_buffer;
+  MemoryAllocation m_memory;
+  VkDeviceSize     m_size;
+  VkDeviceSize     m_head;
+  VkDeviceSize     m_tail;
+};
+}
+#endif
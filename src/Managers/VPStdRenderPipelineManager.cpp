@@ -1,31 +1,17 @@
 #include "VPStdRenderPipelineManager.hpp"
+#include "VPPipelineCache.hpp"
+
+#include <chrono>
 
 namespace vpe
 {
-VkShaderModule StdRenderPipelineManager::createShaderModule(const std::vector<char>& _code)
-{
-  const VkDevice& logicalDevice = *MemoryBufferManager::getInstance().m_pLogicalDevice;
-
-  VkShaderModule result{};
-
-  VkShaderModuleCreateInfo createInfo{};
-  createInfo.sType    = VK_STRUCTURE_TYPE_SHADER_MODULE_CREATE_INFO;
-  createInfo.codeSize = _code.size();
-  createInfo.pCode    = reinterpret_cast<const uint32_t*>(_code.data());
-
-  if (vkCreateShaderModule(logicalDevice, &createInfo, nullptr, &result) != VK_SUCCESS)
-    throw std::runtime_error("ERROR: Failed to create shader module!");
-
-  return result;
-}
-
 void StdRenderPipelineManager::createLayout(const size_t _lightCount)
 {
   const VkDevice& logicalDevice = *MemoryBufferManager::getInstance().m_pLogicalDevice;
 
   VkDescriptorSetLayoutBinding mvpLayoutBinding{};
   mvpLayoutBinding.binding            = 0;
-  mvpLayoutBinding.descriptorType     = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER;
+  mvpLayoutBinding.descriptorType     = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER_DYNAMIC; // Per frame region
   mvpLayoutBinding.descriptorCount    = 1;
   mvpLayoutBinding.stageFlags         = VK_SHADER_STAGE_VERTEX_BIT | VK_SHADER_STAGE_FRAGMENT_BIT;
   mvpLayoutBinding.pImmutableSamplers = nullptr; // Only relevant for image sampling
@@ -53,12 +39,21 @@ void StdRenderPipelineManager::createLayout(const size_t _lightCount)
   normalMapSamplerLayoutBinding.stageFlags         = VK_SHADER_STAGE_FRAGMENT_BIT;
   normalMapSamplerLayoutBinding.pImmutableSamplers = nullptr;
 
+  // Per instance data of the instanced draws
+  VkDescriptorSetLayoutBinding instancesLayoutBinding{};
+  instancesLayoutBinding.binding            = 4;
+  instancesLayoutBinding.descriptorType     = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER_DYNAMIC; // Per frame region
+  instancesLayoutBinding.descriptorCount    = 1;
+  instancesLayoutBinding.stageFlags         = VK_SHADER_STAGE_VERTEX_BIT;
+  instancesLayoutBinding.pImmutableSamplers = nullptr;
+
   std::array<VkDescriptorSetLayoutBinding, BINDING_COUNT> bindings =
   {
     mvpLayoutBinding,
     lightsLayoutBinding,
     textureSamplerLayoutBinding,
-    normalMapSamplerLayoutBinding
+    normalMapSamplerLayoutBinding,
+    instancesLayoutBinding
   };
 
   VkDescriptorSetLayoutCreateInfo dsLayoutInfo{};
@@ -107,27 +102,32 @@ void StdRenderPipelineManager::createDescriptorSet(VkDescriptorSet* _pDescriptor
 void StdRenderPipelineManager::updateObjDescriptorSet(std::vector<VkBuffer>& _UBOs,
                                                       const size_t _lightCount,
                                                       const DescriptorFlags _flags,
-                                                      StdRenderableObject* _obj)
+                                                      StdRenderableObject* _obj,
+                                                      const uint32_t _region,
+                                                      const VkDeviceSize _mvpnStride,
+                                                      const VkDeviceSize _instancesRange)
 {
-  if (_obj == nullptr) return;
+  if (_obj == nullptr || _region >= _obj->m_descriptorSets.size()) return;
 
-  const VkDevice& logicalDevice = *MemoryBufferManager::getInstance().m_pLogicalDevice;
+  const VkDevice&        logicalDevice = *MemoryBufferManager::getInstance().m_pLogicalDevice;
+  const VkDescriptorSet& descriptorSet = _obj->m_descriptorSets.at(_region);
 
   std::vector<VkWriteDescriptorSet>   descriptorWrites{};
   VkDescriptorBufferInfo              mvpnInfo{};
   VkDescriptorImageInfo               textureInfo{};
   VkDescriptorImageInfo               normalMapInfo{};
+  VkDescriptorBufferInfo              instancesInfo{};
   std::vector<VkDescriptorBufferInfo> lightsInfo{};
 
   if (_flags & DescriptorFlags::MATRICES)
   {
     mvpnInfo.buffer = _UBOs.at(0);
-    mvpnInfo.offset = _obj->m_UBOoffsetIdx * sizeof(ModelViewProjNormalUBO);
+    mvpnInfo.offset = _obj->m_UBOoffsetIdx * _mvpnStride; // Relative to the frame's region
     mvpnInfo.range  = sizeof(ModelViewProjNormalUBO);
 
     auto ds = this->createWriteDescriptorSet(DescriptorFlags::MATRICES,
                                              0, 1,
-                                             _obj->m_descriptorSet,
+                                             descriptorSet,
                                              &mvpnInfo);
     descriptorWrites.push_back(ds);
   }
@@ -144,7 +144,7 @@ void StdRenderPipelineManager::updateObjDescriptorSet(std::vector<VkBuffer>& _UB
 
     auto ds = this->createWriteDescriptorSet(DescriptorFlags::LIGHTS,
                                              1, lightsInfo.size(),
-                                             _obj->m_descriptorSet,
+                                             descriptorSet,
                                              lightsInfo.data());
     descriptorWrites.push_back(ds);
   }
@@ -157,7 +157,7 @@ void StdRenderPipelineManager::updateObjDescriptorSet(std::vector<VkBuffer>& _UB
 
     auto ds = this->createWriteDescriptorSet(DescriptorFlags::TEXTURE,
                                              2, 1,
-                                             _obj->m_descriptorSet,
+                                             descriptorSet,
                                              &textureInfo);
     descriptorWrites.push_back(ds);
   }
@@ -170,11 +170,24 @@ void StdRenderPipelineManager::updateObjDescriptorSet(std::vector<VkBuffer>& _UB
 
     auto ds = this->createWriteDescriptorSet(DescriptorFlags::NORMAL_MAP,
                                              3, 1,
-                                             _obj->m_descriptorSet,
+                                             descriptorSet,
                                              &normalMapInfo);
     descriptorWrites.push_back(ds);
   }
 
+  if (_flags & DescriptorFlags::INSTANCES && _instancesRange > 0)
+  {
+    instancesInfo.buffer = _UBOs.at(2);
+    instancesInfo.offset = 0; // Relative to the frame's region
+    instancesInfo.range  = _instancesRange;
+
+    auto ds = this->createWriteDescriptorSet(DescriptorFlags::INSTANCES,
+                                             4, 1,
+                                             descriptorSet,
+                                             &instancesInfo);
+    descriptorWrites.push_back(ds);
+  }
+
   vkUpdateDescriptorSets(logicalDevice,
                          descriptorWrites.size(),
                          descriptorWrites.data(),
@@ -201,8 +214,17 @@ StdRenderPipelineManager::createWriteDescriptorSet(const DescriptorFlags _type,
 
   switch (_type)
   {
-    case DescriptorFlags::LIGHTS:
     case DescriptorFlags::MATRICES:
+      result.descriptorType = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER_DYNAMIC;
+      result.pBufferInfo    = std::any_cast<VkDescriptorBufferInfo*>(_pInfo);
+      break;
+
+    case DescriptorFlags::INSTANCES:
+      result.descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER_DYNAMIC;
+      result.pBufferInfo    = std::any_cast<VkDescriptorBufferInfo*>(_pInfo);
+      break;
+
+    case DescriptorFlags::LIGHTS:
     case DescriptorFlags::MATERIAL_DATA:
       result.descriptorType = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER;
       result.pBufferInfo    = std::any_cast<VkDescriptorBufferInfo*>(_pInfo);
@@ -251,18 +273,25 @@ void StdRenderPipelineManager::updateViewportState(const VkExtent2D& _extent,
   m_viewportState.pScissors     = &_scissor;
 }
 
-void StdRenderPipelineManager::createPipeline(const VkExtent2D& _extent, const StdMaterial& _material)
+void StdRenderPipelineManager::createPipeline(const VkExtent2D&  _extent,
+                                              const StdMaterial& _material,
+                                              const bool         _instanced)
 {
   const VkDevice& logicalDevice = *MemoryBufferManager::getInstance().m_pLogicalDevice;
 
   VkPipeline newPipeline = VK_NULL_HANDLE;
 
-  auto bindingDescription    = Vertex::getBindingDescription();
-  auto attributeDescriptions = Vertex::getAttributeDescriptions();
+  auto bindingDescription    = vpe::getBindingDescription(_material.vertexFormat);
+  auto attributeDescriptions = vpe::getAttributeDescriptions(_material.vertexFormat);
 
   // PROGRAMMABLE STAGES //
-  VkShaderModule vertShaderMod = createShaderModule(_material.vertShaderCode);
-  VkShaderModule fragShaderMod = createShaderModule(_material.fragShaderCode);
+  if (_instanced && !_material.supportsInstancing())
+    throw std::runtime_error("ERROR: VPStdRenderPipeline::createPipeline - The material has no instanced variant!");
+
+  // Owned by the ShaderRegistry, shared with every other pipeline using them
+  VkShaderModule vertShaderMod = _instanced ? _material.pInstancedVertShader->module :
+                                              _material.pVertShader->module;
+  VkShaderModule fragShaderMod = _material.pFragShader->module;
 
   // Assign the shaders to the proper stage
   VkPipelineShaderStageCreateInfo vertShaderStageInfo{};
@@ -368,17 +397,31 @@ void StdRenderPipelineManager::createPipeline(const VkExtent2D& _extent, const S
   pipelineInfo.renderPass          = m_renderPass;
   pipelineInfo.subpass             = 0;
 
-  if (vkCreateGraphicsPipelines(logicalDevice, VK_NULL_HANDLE, 1, &pipelineInfo,
+  auto& pipelineCache = PipelineCache::getInstance();
+
+  // Tells whether the pipeline cache had it
+  VkPipelineCreationFeedbackEXT           feedback{};
+  VkPipelineCreationFeedbackCreateInfoEXT feedbackInfo{};
+  feedbackInfo.sType                     = VK_STRUCTURE_TYPE_PIPELINE_CREATION_FEEDBACK_CREATE_INFO_EXT;
+  feedbackInfo.pPipelineCreationFeedback = &feedback;
+  if (pipelineCache.hasCreationFeedback()) pipelineInfo.pNext = &feedbackInfo;
+
+  const auto startTime = std::chrono::high_resolution_clock::now();
+
+  if (vkCreateGraphicsPipelines(logicalDevice, pipelineCache.getCache(), 1, &pipelineInfo,
                                 nullptr, &newPipeline)
       != VK_SUCCESS)
   {
     throw std::runtime_error("ERROR: Failed creating the graphics pipeline!");
   }
 
-  // CLEANING //
-  vkDestroyShaderModule(logicalDevice, vertShaderMod, nullptr);
-  vkDestroyShaderModule(logicalDevice, fragShaderMod, nullptr);
+  pipelineCache.recordCreation(pipelineCache.hasCreationFeedback() ? &feedback : nullptr,
+                               std::chrono::duration<double, std::milli>
+                                 (std::chrono::high_resolution_clock::now() - startTime).count());
 
-  m_pipelinePool.emplace(_material.hash, newPipeline);
+  if (_instanced)
+    m_instancedPipelinePool.emplace(_material.hash, newPipeline);
+  else
+    m_pipelinePool.emplace(_material.hash, newPipeline);
 }
 }
\ No newline at end of file
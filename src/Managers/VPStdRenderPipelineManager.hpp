@@ -12,10 +12,13 @@
 
 #include "../VPStdRenderableObject.hpp"
 #include "../VPLight.hpp"
+#include "VPUniformArena.hpp"
 
 namespace vpe
 {
-constexpr uint8_t BINDING_COUNT = 4;
+constexpr uint8_t BINDING_COUNT = 5;
+// Matrices and instances. Bound with one offset each, in binding order.
+constexpr uint8_t DYNAMIC_BINDING_COUNT = 2;
 
 enum DescriptorFlags : uint8_t
 {
@@ -25,6 +28,7 @@ enum DescriptorFlags : uint8_t
   LIGHTS        = 1 << 2,
   TEXTURE       = 1 << 3,
   NORMAL_MAP    = 1 << 4,
+  INSTANCES     = 1 << 5,
   ALL           = 0xFF
 };
 
@@ -58,26 +62,32 @@ public:
     vkDestroyPipelineLayout(logicalDevice, m_pipelineLayout, nullptr);
   }
 
-  void createPipeline(const VkExtent2D& _extent, const StdMaterial& _material);
+  // Instanced pipelines use the material's instanced vertex shader variant
+  void createPipeline(const VkExtent2D& _extent, const StdMaterial& _material, const bool _instanced = false);
 
   void createDescriptorSet(VkDescriptorSet* _pDescriptorSet);
+  // The matrices are bound as dynamic UBOs: _mvpnStride apart inside a frame's region.
+  // The instances (_UBOs[2]) as a dynamic SSBO covering a whole region of _instancesRange bytes.
+  // Only the object's set of _region is written, the GPU must be done with it.
   void updateObjDescriptorSet(std::vector<VkBuffer>& _UBOs,
                               const size_t _lightCount,
                               const DescriptorFlags _flags,
-                              StdRenderableObject* _obj);
+                              StdRenderableObject* _obj,
+                              const uint32_t _region,
+                              const VkDeviceSize _mvpnStride = sizeof(ModelViewProjNormalUBO),
+                              const VkDeviceSize _instancesRange = 0);
 
   void updateViewportState(const VkExtent2D& _extent, VkViewport& _viewport, VkRect2D& _scissor);
 
-  static VkShaderModule createShaderModule(const std::vector<char>& _code);
-
-  static inline std::vector<VkVertexInputAttributeDescription> getAttributeDescriptions()
+  static inline std::vector<VkVertexInputAttributeDescription>
+  getAttributeDescriptions(const VertexFormat _format = VertexFormat::FULL)
   {
-    return Vertex::getAttributeDescriptions();
+    return vpe::getAttributeDescriptions(_format);
   }
 
-  static inline VkVertexInputBindingDescription getBindingDescription()
+  static inline VkVertexInputBindingDescription getBindingDescription(const VertexFormat _format = VertexFormat::FULL)
   {
-    return Vertex::getBindingDescription();
+    return vpe::getBindingDescription(_format);
   }
 
   inline void freeObjDescriptorSet(VkDescriptorSet* _pDescriptorSet)
@@ -98,12 +108,31 @@ public:
     this->cleanUp();
   }
 
-  inline VkPipeline& getOrCreatePipeline(const VkExtent2D& _extent, const StdMaterial& _material)
+  inline VkPipeline& getOrCreatePipeline(const VkExtent2D& _extent,
+                                         const StdMaterial& _material,
+                                         const bool         _instanced = false)
   { // TODO: Use the layout alongside the material as hash
-    if (m_pipelinePool.count(_material.hash) == 0)
-      createPipeline(_extent, _material);
+    auto& pool = _instanced ? m_instancedPipelinePool : m_pipelinePool;
+
+    if (pool.count(_material.hash) == 0)
+      createPipeline(_extent, _material, _instanced);
 
-    return m_pipelinePool.at(_material.hash);
+    return pool.at(_material.hash);
+  }
+
+  // Creates the pipelines of every material (and their instanced variants) up front, so the first
+  // frames don't stall compiling them
+  inline void warmUp(const VkExtent2D& _extent, const std::vector<std::shared_ptr<StdMaterial>>& _materials)
+  {
+    for (const auto& pMaterial : _materials)
+    {
+      if (pMaterial == nullptr) continue;
+
+      this->getOrCreatePipeline(_extent, *pMaterial);
+
+      if (pMaterial->supportsInstancing())
+        this->getOrCreatePipeline(_extent, *pMaterial, true);
+    }
   }
 
   inline VkPipelineLayout& getPipelineLayout() { return m_pipelineLayout; }
@@ -121,12 +150,14 @@ public:
     }
 
     m_descriptorPoolSizes = {};
-    m_descriptorPoolSizes[0].type            = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER;
+    m_descriptorPoolSizes[0].type            = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER_DYNAMIC;
     m_descriptorPoolSizes[0].descriptorCount = _objCount;
     m_descriptorPoolSizes[1].type            = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER;
     m_descriptorPoolSizes[1].descriptorCount = std::max(_lightCount * _objCount, _objCount);
     m_descriptorPoolSizes[2].type            = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
     m_descriptorPoolSizes[2].descriptorCount = IMAGES_PER_MATERIAL * _objCount;
+    m_descriptorPoolSizes[3].type            = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER_DYNAMIC;
+    m_descriptorPoolSizes[3].descriptorCount = _objCount;
 
     m_descriptorPool = bufferManager.createDescriptorPool(m_descriptorPoolSizes.data(),
                                                           m_descriptorPoolSizes.size());
@@ -139,7 +170,11 @@ public:
     for (auto& pair : m_pipelinePool)
       vkDestroyPipeline(logicalDevice, pair.second, nullptr);
 
+    for (auto& pair : m_instancedPipelinePool)
+      vkDestroyPipeline(logicalDevice, pair.second, nullptr);
+
     m_pipelinePool.clear();
+    m_instancedPipelinePool.clear();
   }
 
 private:
@@ -149,9 +184,10 @@ private:
   VkPipelineViewportStateCreateInfo      m_viewportState;
   VkPipelineLayout                       m_pipelineLayout;
   std::unordered_map<size_t, VkPipeline> m_pipelinePool;
+  std::unordered_map<size_t, VkPipeline> m_instancedPipelinePool;
 
   VkDescriptorSetLayout                  m_descriptorSetLayout;
-  std::array<VkDescriptorPoolSize, 3>    m_descriptorPoolSizes;
+  std::array<VkDescriptorPoolSize, 4>    m_descriptorPoolSizes;
   VkDescriptorPool                       m_descriptorPool;
 
   void createLayout(const size_t _lightCount);
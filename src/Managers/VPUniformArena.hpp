@@ -0,0 +1,116 @@
+#ifndef VP_UNIFORM_ARENA_HPP
+#define VP_UNIFORM_ARENA_HPP
+
+#include <vulkan/vulkan.h>
+
+#include "VPMemoryBufferManager.hpp"
+
+namespace vpe
+{
+// Persistently mapped uniform buffer split in N identical regions, one per frame that can be
+// in flight. Each frame writes only its own region and binds it through a dynamic offset,
+// so the CPU never overwrites data the GPU may still be reading.
+//
+// | region 0: elem 0 | elem 1 | ... | region 1: elem 0 | elem 1 | ... | ...
+//
+// With VK_BUFFER_USAGE_STORAGE_BUFFER_BIT the elements are tightly packed (a std430 array)
+// and only the regions are aligned, to minStorageBufferOffsetAlignment.
+class UniformArena
+{
+public:
+  UniformArena() :
+    m_buffer(VK_NULL_HANDLE),
+    m_memory(),
+    m_elementStride(0),
+    m_elementCount(0),
+    m_regionSize(0),
+    m_regionCount(0)
+  {}
+
+  ~UniformArena() { this->destroy(); }
+
+  // Both the elements and the regions are aligned to minUniformBufferOffsetAlignment,
+  // so the descriptors can point at any element and be offset to any region.
+  inline void create(const VkDeviceSize       _elementSize,
+                     const size_t             _elementCount,
+                     const uint32_t           _regionCount,
+                     const VkBufferUsageFlags _usage = VK_BUFFER_USAGE_UNIFORM_BUFFER_BIT)
+  {
+    this->destroy();
+
+    if (_elementSize == 0 || _elementCount == 0 || _regionCount == 0) return;
+
+    auto& bufferManager = MemoryBufferManager::getInstance();
+
+    VkPhysicalDeviceProperties properties{};
+    vkGetPhysicalDeviceProperties(*bufferManager.m_pPhysicalDevice, &properties);
+
+    const bool isStorage = _usage & VK_BUFFER_USAGE_STORAGE_BUFFER_BIT;
+
+    const VkDeviceSize alignment = std::max<VkDeviceSize>(isStorage ?
+                                                            properties.limits.minStorageBufferOffsetAlignment :
+                                                            properties.limits.minUniformBufferOffsetAlignment,
+                                                          1);
+
+    m_elementStride = isStorage ? _elementSize : alignUp(_elementSize, alignment);
+    m_elementCount  = _elementCount;
+    m_regionSize    = alignUp(m_elementStride * _elementCount, alignment);
+    m_regionCount   = _regionCount;
+
+    bufferManager.createBuffer(m_regionSize * m_regionCount,
+                               _usage,
+                               VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT |
+                                 VK_MEMORY_PROPERTY_HOST_COHERENT_BIT,
+                               &m_buffer,
+                               &m_memory);
+  }
+
+  inline void destroy()
+  {
+    if (m_buffer == VK_NULL_HANDLE) return;
+
+    MemoryBufferManager::getInstance().destroyBuffer(m_buffer, m_memory);
+
+    m_elementStride = 0;
+    m_elementCount  = 0;
+    m_regionSize    = 0;
+    m_regionCount   = 0;
+  }
+
+  template<typename T>
+  inline T* getElement(const uint32_t _region, const size_t _idx)
+  {
+    return reinterpret_cast<T*>(m_memory.getMapped<char>() +
+                                _region * m_regionSize +
+                                _idx * m_elementStride);
+  }
+
+  inline void flushRegion(const uint32_t _region)
+  {
+    MemoryAllocator::getInstance().flush(m_memory, _region * m_regionSize, m_regionSize);
+  }
+
+  inline bool         isValid()                           const { return m_buffer != VK_NULL_HANDLE; }
+  inline VkBuffer     getBuffer()                         const { return m_buffer; }
+  inline VkDeviceSize getElementStride()                  const { return m_elementStride; }
+  inline size_t       getElementCount()                   const { return m_elementCount; }
+  inline uint32_t     getRegionCount()                    const { return m_regionCount; }
+  inline VkDeviceSize getRegionSize()                     const { return m_regionSize; }
+  inline uint32_t     getDynamicOffset(const uint32_t _r) const { return _r * m_regionSize; }
+
+private:
+  VkBuffer         m_buffer;
+  MemoryAllocation m_memory;
+
+  VkDeviceSize m_elementStride;
+  size_t       m_elementCount;
+  VkDeviceSize m_regionSize;
+  uint32_t     m_regionCount;
+
+  static inline VkDeviceSize alignUp(const VkDeviceSize _value, const VkDeviceSize _alignment)
+  {
+    return (_value + _alignment - 1) / _alignment * _alignment;
+  }
+};
+}
+#endif
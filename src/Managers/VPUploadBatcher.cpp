@@ -0,0 +1,587 @@
+#include "VPUploadBatcher.hpp"
+
+namespace vpe
+{
+void UploadBatcher::init(VkDevice*      _pLogicalDevice,
+                         const uint32_t _transferFamily,
+                         VkQueue*       _pTransferQueue,
+                         const uint32_t _graphicsFamily,
+                         VkQueue*       _pGraphicsQueue)
+{
+  m_pLogicalDevice = _pLogicalDevice;
+  m_transferFamily = _transferFamily;
+  m_pTransferQueue = _pTransferQueue;
+  m_graphicsFamily = _graphicsFamily;
+  m_pGraphicsQueue = _pGraphicsQueue;
+
+  m_stagingRing.create(m_pLogicalDevice);
+
+  if (this->hasDedicatedTransferQueue())
+    std::cout << "NOTE: UploadBatcher::init - Using queue family " << m_transferFamily << " for uploads." << std::endl;
+}
+
+UploadBatcher::Batch UploadBatcher::createBatch()
+{
+  Batch result{};
+
+  VkCommandPoolCreateInfo poolInfo{};
+  poolInfo.sType = VK_STRUCTURE_TYPE_COMMAND_POOL_CREATE_INFO;
+  poolInfo.flags = VK_COMMAND_POOL_CREATE_TRANSIENT_BIT; // Reset every time the batch is reused
+
+  VkCommandBufferAllocateInfo allocInfo{};
+  allocInfo.sType              = VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO;
+  allocInfo.level              = VK_COMMAND_BUFFER_LEVEL_PRIMARY;
+  allocInfo.commandBufferCount = 1;
+
+  poolInfo.queueFamilyIndex = m_graphicsFamily;
+  if (vkCreateCommandPool(*m_pLogicalDevice, &poolInfo, nullptr, &result.graphicsPool) != VK_SUCCESS)
+    throw std::runtime_error("ERROR: UploadBatcher::createBatch - Failed to create the graphics pool!");
+
+  allocInfo.commandPool = result.graphicsPool;
+  if (vkAllocateCommandBuffers(*m_pLogicalDevice, &allocInfo, &result.graphicsCmd) != VK_SUCCESS)
+    throw std::runtime_error("ERROR: UploadBatcher::createBatch - Failed to allocate the graphics buffer!");
+
+  if (this->hasDedicatedTransferQueue())
+  {
+    poolInfo.queueFamilyIndex = m_transferFamily;
+    if (vkCreateCommandPool(*m_pLogicalDevice, &poolInfo, nullptr, &result.transferPool) != VK_SUCCESS)
+      throw std::runtime_error("ERROR: UploadBatcher::createBatch - Failed to create the transfer pool!");
+
+    allocInfo.commandPool = result.transferPool;
+    if (vkAllocateCommandBuffers(*m_pLogicalDevice, &allocInfo, &result.transferCmd) != VK_SUCCESS)
+      throw std::runtime_error("ERROR: UploadBatcher::createBatch - Failed to allocate the transfer buffer!");
+
+    VkSemaphoreCreateInfo semaphoreInfo{};
+    semaphoreInfo.sType = VK_STRUCTURE_TYPE_SEMAPHORE_CREATE_INFO;
+
+    if (vkCreateSemaphore(*m_pLogicalDevice, &semaphoreInfo, nullptr, &result.copiesDone) != VK_SUCCESS)
+      throw std::runtime_error("ERROR: UploadBatcher::createBatch - Failed to create the semaphore!");
+  }
+  else
+    result.transferCmd = result.graphicsCmd;
+
+  VkFenceCreateInfo fenceInfo{};
+  fenceInfo.sType = VK_STRUCTURE_TYPE_FENCE_CREATE_INFO;
+
+  if (vkCreateFence(*m_pLogicalDevice, &fenceInfo, nullptr, &result.fence) != VK_SUCCESS)
+    throw std::runtime_error("ERROR: UploadBatcher::createBatch - Failed to create the fence!");
+
+  return result;
+}
+
+void UploadBatcher::destroyBatch(Batch& _batch)
+{
+  auto& bufferManager = MemoryBufferManager::getInstance();
+
+  for (auto& staging : _batch.stagingBuffers)
+    bufferManager.destroyBuffer(staging.first, staging.second);
+  _batch.stagingBuffers.clear();
+
+  // Their command buffers are freed alongside them
+  if (_batch.transferPool != VK_NULL_HANDLE) vkDestroyCommandPool(*m_pLogicalDevice, _batch.transferPool, nullptr);
+  if (_batch.graphicsPool != VK_NULL_HANDLE) vkDestroyCommandPool(*m_pLogicalDevice, _batch.graphicsPool, nullptr);
+  if (_batch.copiesDone   != VK_NULL_HANDLE) vkDestroySemaphore(*m_pLogicalDevice, _batch.copiesDone, nullptr);
+  if (_batch.fence        != VK_NULL_HANDLE) vkDestroyFence(*m_pLogicalDevice, _batch.fence, nullptr);
+
+  _batch = Batch{};
+}
+
+void UploadBatcher::beginBatch()
+{
+  if (m_isRecording) return;
+
+  this->collect();
+
+  if (m_freeBatches.empty())
+    m_recordingBatch = this->createBatch();
+  else
+  {
+    m_recordingBatch = std::move(m_freeBatches.back());
+    m_freeBatches.pop_back();
+  }
+
+  VkCommandBufferBeginInfo beginInfo{};
+  beginInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO;
+  beginInfo.flags = VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT;
+
+  if (vkBeginCommandBuffer(m_recordingBatch.graphicsCmd, &beginInfo) != VK_SUCCESS)
+    throw std::runtime_error("ERROR: UploadBatcher::beginBatch - Failed!");
+
+  if (this->hasDedicatedTransferQueue() &&
+      vkBeginCommandBuffer(m_recordingBatch.transferCmd, &beginInfo) != VK_SUCCESS)
+  {
+    throw std::runtime_error("ERROR: UploadBatcher::beginBatch - Failed!");
+  }
+
+  m_isRecording = true;
+}
+
+VkCommandBuffer& UploadBatcher::getGraphicsCommand()
+{
+  this->beginBatch();
+  return m_recordingBatch.graphicsCmd;
+}
+
+void UploadBatcher::uploadBuffer(const VkBuffer&            _src,
+                                 const VkBuffer&            _dst,
+                                 const VkDeviceSize         _size,
+                                 const VkPipelineStageFlags _dstStage,
+                                 const VkAccessFlags        _dstAccess,
+                                 const VkDeviceSize         _srcOffset,
+                                 const VkDeviceSize         _dstOffset)
+{
+  this->beginBatch();
+
+  VkBufferCopy copyRegion{};
+  copyRegion.srcOffset = _srcOffset;
+  copyRegion.dstOffset = _dstOffset;
+  copyRegion.size      = _size;
+
+  vkCmdCopyBuffer(m_recordingBatch.transferCmd, _src, _dst, 1, &copyRegion);
+
+  VkBufferMemoryBarrier barrier{};
+  barrier.sType               = VK_STRUCTURE_TYPE_BUFFER_MEMORY_BARRIER;
+  barrier.buffer              = _dst;
+  barrier.offset              = _dstOffset;
+  barrier.size                = _size;
+  barrier.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+  barrier.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+
+  if (this->hasDedicatedTransferQueue())
+  { // Exclusive resources must be released by one family and acquired by the other
+    barrier.srcQueueFamilyIndex = m_transferFamily;
+    barrier.dstQueueFamilyIndex = m_graphicsFamily;
+    barrier.srcAccessMask       = VK_ACCESS_TRANSFER_WRITE_BIT;
+    barrier.dstAccessMask       = 0; // Ignored on release
+
+    vkCmdPipelineBarrier(m_recordingBatch.transferCmd,
+                         VK_PIPELINE_STAGE_TRANSFER_BIT,
+                         VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT,
+                         0,
+                         0, nullptr,
+                         1, &barrier,
+                         0, nullptr);
+
+    // The semaphore already made the writes available
+    barrier.srcAccessMask = 0;
+  }
+  else
+    barrier.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+
+  barrier.dstAccessMask = _dstAccess;
+
+  vkCmdPipelineBarrier(m_recordingBatch.graphicsCmd,
+                       VK_PIPELINE_STAGE_TRANSFER_BIT,
+                       _dstStage,
+                       0,
+                       0, nullptr,
+                       1, &barrier,
+                       0, nullptr);
+}
+
+void UploadBatcher::beginImageUpload(const VkImage& _image, const uint32_t _mipLevels)
+{
+  this->beginBatch();
+
+  VkImageMemoryBarrier barrier{};
+  barrier.sType                           = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER;
+  barrier.image                           = _image;
+  barrier.srcQueueFamilyIndex             = VK_QUEUE_FAMILY_IGNORED;
+  barrier.dstQueueFamilyIndex             = VK_QUEUE_FAMILY_IGNORED;
+  barrier.subresourceRange.aspectMask     = VK_IMAGE_ASPECT_COLOR_BIT;
+  barrier.subresourceRange.baseMipLevel   = 0;
+  barrier.subresourceRange.levelCount     = _mipLevels;
+  barrier.subresourceRange.baseArrayLayer = 0;
+  barrier.subresourceRange.layerCount     = 1;
+  barrier.oldLayout                       = VK_IMAGE_LAYOUT_UNDEFINED;
+  barrier.newLayout                       = VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL;
+  barrier.srcAccessMask                   = 0;
+  barrier.dstAccessMask                   = VK_ACCESS_TRANSFER_WRITE_BIT;
+
+  vkCmdPipelineBarrier(m_recordingBatch.transferCmd,
+                       VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT,
+                       VK_PIPELINE_STAGE_TRANSFER_BIT,
+                       0,
+                       0, nullptr,
+                       0, nullptr,
+                       1, &barrier);
+}
+
+void UploadBatcher::endImageUpload(const VkImage& _image, const uint32_t _mipLevels)
+{
+  this->beginBatch();
+
+  VkImageMemoryBarrier barrier{};
+  barrier.sType                           = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER;
+  barrier.image                           = _image;
+  barrier.srcQueueFamilyIndex             = VK_QUEUE_FAMILY_IGNORED;
+  barrier.dstQueueFamilyIndex             = VK_QUEUE_FAMILY_IGNORED;
+  barrier.subresourceRange.aspectMask     = VK_IMAGE_ASPECT_COLOR_BIT;
+  barrier.subresourceRange.baseMipLevel   = 0;
+  barrier.subresourceRange.levelCount     = _mipLevels;
+  barrier.subresourceRange.baseArrayLayer = 0;
+  barrier.subresourceRange.layerCount     = 1;
+  // Same layout, it's only the ownership (or visibility) that changes
+  barrier.oldLayout                       = VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL;
+  barrier.newLayout                       = VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL;
+
+  if (this->hasDedicatedTransferQueue())
+  {
+    barrier.srcQueueFamilyIndex = m_transferFamily;
+    barrier.dstQueueFamilyIndex = m_graphicsFamily;
+    barrier.srcAccessMask       = VK_ACCESS_TRANSFER_WRITE_BIT;
+    barrier.dstAccessMask       = 0; // Ignored on release
+
+    vkCmdPipelineBarrier(m_recordingBatch.transferCmd,
+                         VK_PIPELINE_STAGE_TRANSFER_BIT,
+                         VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT,
+                         0,
+                         0, nullptr,
+                         0, nullptr,
+                         1, &barrier);
+
+    barrier.srcAccessMask = 0;
+  }
+  else
+    barrier.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+
+  // The mip chain is generated by blitting from the previous level, unless it was uploaded too
+  barrier.dstAccessMask = VK_ACCESS_TRANSFER_READ_BIT | VK_ACCESS_TRANSFER_WRITE_BIT;
+
+  vkCmdPipelineBarrier(m_recordingBatch.graphicsCmd,
+                       VK_PIPELINE_STAGE_TRANSFER_BIT,
+                       VK_PIPELINE_STAGE_TRANSFER_BIT,
+                       0,
+                       0, nullptr,
+                       0, nullptr,
+                       1, &barrier);
+}
+
+VkDeviceSize UploadBatcher::allocateStaging(const VkDeviceSize _maxSize,
+                                            const VkDeviceSize _granularity,
+                                            const VkDeviceSize _alignment,
+                                            VkDeviceSize&      _offset)
+{
+  // Big uploads are split, so a few of them can be in flight at the same time
+  const VkDeviceSize chunkLimit = m_stagingRing.getSize() / 4 / _granularity * _granularity;
+  if (chunkLimit == 0)
+    throw std::runtime_error("ERROR: UploadBatcher::allocateStaging - The granularity is bigger than a chunk!");
+
+  const VkDeviceSize size = std::min(_maxSize / _granularity * _granularity, chunkLimit);
+
+  while (!m_stagingRing.tryAllocate(size, _alignment, _offset))
+  {
+    // The ring is full of data that's still being copied (or not even submitted yet)
+    if (m_isRecording) this->submit();
+
+    if (m_inFlightBatches.empty())
+      throw std::runtime_error("ERROR: UploadBatcher::allocateStaging - The staging ring is stuck!");
+
+    vkWaitForFences(*m_pLogicalDevice, 1, &m_inFlightBatches.front().fence, VK_TRUE, UINT64_MAX);
+    this->collect();
+  }
+
+  return size;
+}
+
+void UploadBatcher::stageBuffer(const void*                _data,
+                                const VkDeviceSize         _size,
+                                const VkBuffer&            _dst,
+                                const VkPipelineStageFlags _dstStage,
+                                const VkAccessFlags        _dstAccess,
+                                const VkDeviceSize         _dstOffset)
+{
+  const char*  pSrc   = static_cast<const char*>(_data);
+  VkDeviceSize copied = 0;
+
+  while (copied < _size)
+  {
+    VkDeviceSize ringOffset = 0;
+    // vkCmdCopyBuffer has no alignment requirements, 16 is just to keep the memcpys aligned
+    const VkDeviceSize chunkSize = this->allocateStaging(_size - copied, 1, 16, ringOffset);
+
+    memcpy(m_stagingRing.getMapped(ringOffset), pSrc + copied, chunkSize);
+
+    // Each chunk gets its own barrier, but they all end up in the same batch unless the ring fills up
+    this->uploadBuffer(m_stagingRing.getBuffer(),
+                       _dst,
+                       chunkSize,
+                       _dstStage,
+                       _dstAccess,
+                       ringOffset,
+                       _dstOffset + copied);
+
+    copied += chunkSize;
+  }
+}
+
+void UploadBatcher::stageImage(const void*        _pixels,
+                               const VkDeviceSize _size,
+                               const VkImage&     _dst,
+                               const uint32_t     _width,
+                               const uint32_t     _height,
+                               const uint32_t     _mipLevels)
+{
+  if (_width == 0 || _height == 0 || _size % (_width * _height) != 0)
+    throw std::runtime_error("ERROR: UploadBatcher::stageImage - The size doesn't match the extent!");
+
+  this->beginImageUpload(_dst, _mipLevels);
+
+  this->stageImageRows(static_cast<const char*>(_pixels), _dst, 0, _width, _height, 1, _size / (_width * _height));
+
+  this->endImageUpload(_dst, _mipLevels);
+}
+
+void UploadBatcher::stageImageLevels(const void*                           _data,
+                                     const VkImage&                        _dst,
+                                     const std::vector<VkBufferImageCopy>& _levels,
+                                     const uint32_t                        _blockExtent,
+                                     const VkDeviceSize                    _blockSize)
+{
+  const uint32_t levelCount = static_cast<uint32_t>(_levels.size());
+  if (levelCount == 0 || _blockExtent == 0 || _blockSize == 0)
+    throw std::runtime_error("ERROR: UploadBatcher::stageImageLevels - No levels!");
+
+  // The buffer offsets must be multiples of both the block (or texel) size and 4
+  const VkDeviceSize alignment  = _blockSize * 4;
+  const VkDeviceSize chunkLimit = m_stagingRing.getSize() / 4;
+
+  // Partial blocks on the edges still take a whole one
+  auto getLevelSize = [_blockExtent, _blockSize](const VkBufferImageCopy& _level)
+  {
+    return VkDeviceSize((_level.imageExtent.width  + _blockExtent - 1) / _blockExtent) *
+                       ((_level.imageExtent.height + _blockExtent - 1) / _blockExtent) * _blockSize;
+  };
+  auto alignUp = [alignment](const VkDeviceSize _offset)
+  {
+    return (_offset + alignment - 1) / alignment * alignment;
+  };
+
+  this->beginImageUpload(_dst, levelCount);
+
+  const char*                    pSrc  = static_cast<const char*>(_data);
+  std::vector<VkBufferImageCopy> regions;
+  uint32_t                       first = 0;
+
+  while (first < levelCount)
+  {
+    // As many consecutive levels as fit in one chunk
+    VkDeviceSize groupSize = 0;
+    uint32_t     end       = first;
+    while (end < levelCount && alignUp(groupSize) + getLevelSize(_levels[end]) <= chunkLimit)
+      groupSize = alignUp(groupSize) + getLevelSize(_levels[end++]);
+
+    // Bigger than a chunk on its own
+    if (end == first)
+    {
+      const VkBufferImageCopy& level = _levels[first];
+      this->stageImageRows(pSrc + level.bufferOffset,
+                           _dst,
+                           level.imageSubresource.mipLevel,
+                           level.imageExtent.width,
+                           level.imageExtent.height,
+                           _blockExtent,
+                           _blockSize);
+      ++first;
+      continue;
+    }
+
+    VkDeviceSize ringOffset = 0;
+    this->allocateStaging(groupSize, groupSize, alignment, ringOffset);
+
+    regions.clear();
+    VkDeviceSize groupOffset = 0;
+    for (uint32_t l=first; l<end; ++l)
+    {
+      groupOffset = alignUp(groupOffset);
+
+      const VkDeviceSize levelSize = getLevelSize(_levels[l]);
+      memcpy(m_stagingRing.getMapped(ringOffset + groupOffset), pSrc + _levels[l].bufferOffset, levelSize);
+
+      VkBufferImageCopy region = _levels[l];
+      region.bufferOffset      = ringOffset + groupOffset;
+      region.bufferRowLength   = 0; // Tightly packed
+      region.bufferImageHeight = 0;
+      regions.push_back(region);
+
+      groupOffset += levelSize;
+    }
+
+    this->beginBatch();
+    vkCmdCopyBufferToImage(m_recordingBatch.transferCmd,
+                           m_stagingRing.getBuffer(),
+                           _dst,
+                           VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL,
+                           static_cast<uint32_t>(regions.size()),
+                           regions.data());
+
+    first = end;
+  }
+
+  this->endImageUpload(_dst, levelCount);
+}
+
+void UploadBatcher::stageImageRows(const char*        _pixels,
+                                   const VkImage&     _dst,
+                                   const uint32_t     _mipLevel,
+                                   const uint32_t     _width,
+                                   const uint32_t     _height,
+                                   const uint32_t     _blockExtent,
+                                   const VkDeviceSize _blockSize)
+{
+  const VkDeviceSize rowSize  = _blockSize * ((_width  + _blockExtent - 1) / _blockExtent);
+  const uint32_t     rowCount = (_height + _blockExtent - 1) / _blockExtent;
+  uint32_t           row      = 0;
+
+  while (row < rowCount)
+  {
+    VkDeviceSize ringOffset = 0;
+    // Whole rows, and the buffer offset must be a multiple of both the block size and 4
+    const VkDeviceSize chunkSize = this->allocateStaging((rowCount - row) * rowSize,
+                                                         rowSize,
+                                                         _blockSize * 4,
+                                                         ringOffset);
+    const uint32_t     chunkRows = static_cast<uint32_t>(chunkSize / rowSize);
+
+    memcpy(m_stagingRing.getMapped(ringOffset), _pixels + row * rowSize, chunkSize);
+
+    // The last row of blocks may go past the edge, the copy can't
+    const uint32_t firstTexelRow = row * _blockExtent;
+    const uint32_t texelRows     = std::min((row + chunkRows) * _blockExtent, _height) - firstTexelRow;
+
+    // Still in TRANSFER_DST_OPTIMAL if the ring filled up and the previous chunks were submitted,
+    // since all the copies go to the same queue
+    VkBufferImageCopy region{};
+    region.bufferOffset                    = ringOffset;
+    region.bufferRowLength                 = 0; // Tightly packed
+    region.bufferImageHeight               = 0;
+    region.imageSubresource.aspectMask     = VK_IMAGE_ASPECT_COLOR_BIT;
+    region.imageSubresource.mipLevel       = _mipLevel;
+    region.imageSubresource.baseArrayLayer = 0;
+    region.imageSubresource.layerCount     = 1;
+    region.imageOffset                     = {0, static_cast<int32_t>(firstTexelRow), 0};
+    region.imageExtent                     = {_width, texelRows, 1};
+
+    this->beginBatch();
+    vkCmdCopyBufferToImage(m_recordingBatch.transferCmd,
+                           m_stagingRing.getBuffer(),
+                           _dst,
+                           VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL,
+                           1,
+                           &region);
+
+    row += chunkRows;
+  }
+}
+
+void UploadBatcher::releaseAfterUpload(VkBuffer& _buffer, MemoryAllocation& _memory)
+{
+  this->beginBatch();
+
+  m_recordingBatch.stagingBuffers.emplace_back(_buffer, _memory);
+
+  _buffer = VK_NULL_HANDLE;
+  _memory = MemoryAllocation{};
+}
+
+void UploadBatcher::submit()
+{
+  if (!m_isRecording) return;
+
+  Batch& batch = m_recordingBatch;
+
+  if (vkEndCommandBuffer(batch.graphicsCmd) != VK_SUCCESS)
+    throw std::runtime_error("ERROR: UploadBatcher::submit - Failed to end the graphics commands!");
+
+  VkSubmitInfo graphicsSubmit{};
+  graphicsSubmit.sType              = VK_STRUCTURE_TYPE_SUBMIT_INFO;
+  graphicsSubmit.commandBufferCount = 1;
+  graphicsSubmit.pCommandBuffers    = &batch.graphicsCmd;
+
+  const VkPipelineStageFlags waitStage = VK_PIPELINE_STAGE_TRANSFER_BIT; // Where the acquires happen
+
+  if (this->hasDedicatedTransferQueue())
+  {
+    if (vkEndCommandBuffer(batch.transferCmd) != VK_SUCCESS)
+      throw std::runtime_error("ERROR: UploadBatcher::submit - Failed to end the transfer commands!");
+
+    VkSubmitInfo transferSubmit{};
+    transferSubmit.sType                = VK_STRUCTURE_TYPE_SUBMIT_INFO;
+    transferSubmit.commandBufferCount   = 1;
+    transferSubmit.pCommandBuffers      = &batch.transferCmd;
+    transferSubmit.signalSemaphoreCount = 1;
+    transferSubmit.pSignalSemaphores    = &batch.copiesDone;
+
+    if (vkQueueSubmit(*m_pTransferQueue, 1, &transferSubmit, VK_NULL_HANDLE) != VK_SUCCESS)
+      throw std::runtime_error("ERROR: UploadBatcher::submit - Failed to submit the copies!");
+
+    graphicsSubmit.waitSemaphoreCount = 1;
+    graphicsSubmit.pWaitSemaphores    = &batch.copiesDone;
+    graphicsSubmit.pWaitDstStageMask  = &waitStage;
+  }
+
+  // The graphics part always finishes last, so its fence covers the whole batch
+  if (vkQueueSubmit(*m_pGraphicsQueue, 1, &graphicsSubmit, batch.fence) != VK_SUCCESS)
+    throw std::runtime_error("ERROR: UploadBatcher::submit - Failed to submit the graphics commands!");
+
+  // Everything staged so far is read by this batch or an earlier one
+  batch.ringEnd = m_stagingRing.getHead();
+
+  m_inFlightBatches.push_back(std::move(batch));
+  m_recordingBatch = Batch{};
+  m_isRecording    = false;
+}
+
+void UploadBatcher::collect()
+{
+  auto& bufferManager = MemoryBufferManager::getInstance();
+
+  // Submitted in order to the same queue, so they finish in order
+  while (!m_inFlightBatches.empty())
+  {
+    Batch& batch = m_inFlightBatches.front();
+
+    if (vkGetFenceStatus(*m_pLogicalDevice, batch.fence) != VK_SUCCESS) break;
+
+    m_stagingRing.release(batch.ringEnd);
+
+    for (auto& staging : batch.stagingBuffers)
+      bufferManager.destroyBuffer(staging.first, staging.second);
+    batch.stagingBuffers.clear();
+
+    vkResetFences(*m_pLogicalDevice, 1, &batch.fence);
+    vkResetCommandPool(*m_pLogicalDevice, batch.graphicsPool, 0);
+    if (batch.transferPool != VK_NULL_HANDLE)
+      vkResetCommandPool(*m_pLogicalDevice, batch.transferPool, 0);
+
+    m_freeBatches.push_back(std::move(batch));
+    m_inFlightBatches.pop_front();
+  }
+}
+
+void UploadBatcher::flush()
+{
+  this->submit();
+
+  for (auto& batch : m_inFlightBatches)
+    vkWaitForFences(*m_pLogicalDevice, 1, &batch.fence, VK_TRUE, UINT64_MAX);
+
+  this->collect();
+}
+
+void UploadBatcher::cleanUp()
+{
+  if (m_pLogicalDevice == nullptr) return;
+
+  this->flush();
+
+  for (auto& batch : m_freeBatches) this->destroyBatch(batch);
+  m_freeBatches.clear();
+
+  m_stagingRing.cleanUp();
+
+  m_pLogicalDevice = nullptr;
+  m_pTransferQueue = nullptr;
+  m_pGraphicsQueue = nullptr;
+}
+}
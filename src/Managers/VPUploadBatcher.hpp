@@ -0,0 +1,162 @@
+#ifndef VP_UPLOAD_BATCHER_HPP
+#define VP_UPLOAD_BATCHER_HPP
+
+#include <vulkan/vulkan.h>
+
+#include <deque>
+#include <vector>
+#include <utility>
+
+#include "VPMemoryBufferManager.hpp"
+#include "VPStagingRing.hpp"
+
+namespace vpe
+{
+// Records every upload of a frame (or loading step) into one batch, instead of a queue drain per copy.
+// The copies go to the transfer queue and the work that needs the graphics queue (ownership acquires,
+// mip map blits...) to a graphics command buffer that waits for them with a semaphore.
+// Batches are submitted without waiting. Their fences tell when the staging memory can be reused.
+//
+// Data is staged in a shared StagingRing. Uploads bigger than a chunk of the ring are streamed:
+// when it's full, the batch is submitted and the oldest one waited for to make room.
+//
+// Rendering only needs the uploads to be submitted before the frame: the acquire barriers are on
+// the graphics queue, so they already order the frame's reads after the copies.
+class UploadBatcher
+{
+public:
+  UploadBatcher(UploadBatcher const&) = delete;
+  void operator=(UploadBatcher const&) = delete;
+
+  static inline UploadBatcher& getInstance()
+  {
+    static UploadBatcher instance;
+    return instance;
+  }
+
+  void init(VkDevice*      _pLogicalDevice,
+            const uint32_t _transferFamily,
+            VkQueue*       _pTransferQueue,
+            const uint32_t _graphicsFamily,
+            VkQueue*       _pGraphicsQueue);
+
+  // Without a dedicated transfer family everything goes into the graphics command buffer
+  inline bool hasDedicatedTransferQueue() const { return m_transferFamily != m_graphicsFamily; }
+
+  // _dstStage/_dstAccess: how the buffer will be used once uploaded
+  void uploadBuffer(const VkBuffer&            _src,
+                    const VkBuffer&            _dst,
+                    const VkDeviceSize         _size,
+                    const VkPipelineStageFlags _dstStage,
+                    const VkAccessFlags        _dstAccess,
+                    const VkDeviceSize         _srcOffset = 0,
+                    const VkDeviceSize         _dstOffset = 0);
+
+  // Copies _size bytes of _data through the staging ring into _dst
+  void stageBuffer(const void*                _data,
+                   const VkDeviceSize         _size,
+                   const VkBuffer&            _dst,
+                   const VkPipelineStageFlags _dstStage,
+                   const VkAccessFlags        _dstAccess,
+                   const VkDeviceSize         _dstOffset = 0);
+
+  // Copies the tightly packed _pixels into mip 0 and leaves the image in TRANSFER_DST_OPTIMAL, owned by the
+  // graphics family. The rest of the mip chain and the final transition have to be recorded in
+  // getGraphicsCommand().
+  void stageImage(const void*        _pixels,
+                  const VkDeviceSize _size,
+                  const VkImage&     _dst,
+                  const uint32_t     _width,
+                  const uint32_t     _height,
+                  const uint32_t     _mipLevels);
+
+  // Copies a whole precomputed mip chain, one region per level. The regions' bufferOffsets are relative to _data
+  // and the levels are tightly packed. The levels that fit in the ring together go in a single copy command.
+  // _blockExtent/_blockSize: texels per side of each block and its bytes, 1 and the texel size if uncompressed.
+  // Leaves the image in TRANSFER_DST_OPTIMAL like stageImage, only the final transition is left.
+  void stageImageLevels(const void*                           _data,
+                        const VkImage&                        _dst,
+                        const std::vector<VkBufferImageCopy>& _levels,
+                        const uint32_t                        _blockExtent,
+                        const VkDeviceSize                    _blockSize);
+
+  // Runs on the graphics queue after all of the batch's copies
+  VkCommandBuffer& getGraphicsCommand();
+
+  // For uploads from their own staging buffer. It's destroyed once the current batch is finished.
+  void releaseAfterUpload(VkBuffer& _buffer, MemoryAllocation& _memory);
+
+  // Doesn't wait. Call it before submitting anything that reads the uploaded resources.
+  void submit();
+  // Frees the staging resources of the finished batches
+  void collect();
+  // Submits and waits for everything
+  void flush();
+
+  inline size_t             getPendingBatchCount() const { return m_inFlightBatches.size(); }
+  inline const StagingRing& getStagingRing()       const { return m_stagingRing; }
+
+  void cleanUp();
+
+private:
+  struct Batch
+  {
+    VkCommandPool   transferPool = VK_NULL_HANDLE;
+    VkCommandPool   graphicsPool = VK_NULL_HANDLE;
+    VkCommandBuffer transferCmd  = VK_NULL_HANDLE; // Same as graphicsCmd without a dedicated queue
+    VkCommandBuffer graphicsCmd  = VK_NULL_HANDLE;
+    VkSemaphore     copiesDone   = VK_NULL_HANDLE;
+    VkFence         fence        = VK_NULL_HANDLE;
+    VkDeviceSize    ringEnd      = 0; // Staging ring head when it was submitted
+
+    std::vector< std::pair<VkBuffer, MemoryAllocation> > stagingBuffers;
+  };
+
+  UploadBatcher() :
+    m_pLogicalDevice(nullptr),
+    m_transferFamily(0),
+    m_graphicsFamily(0),
+    m_pTransferQueue(nullptr),
+    m_pGraphicsQueue(nullptr),
+    m_isRecording(false)
+  {}
+  ~UploadBatcher() {}
+
+  VkDevice* m_pLogicalDevice;
+  uint32_t  m_transferFamily;
+  uint32_t  m_graphicsFamily;
+  VkQueue*  m_pTransferQueue; // Implicitly destroyed alongside the logical device
+  VkQueue*  m_pGraphicsQueue; // Implicitly destroyed alongside the logical device
+
+  bool              m_isRecording;
+  Batch             m_recordingBatch;
+  std::deque<Batch> m_inFlightBatches;
+  std::vector<Batch> m_freeBatches; // Finished, ready to be recorded again
+  StagingRing        m_stagingRing;
+
+  Batch createBatch();
+  void  destroyBatch(Batch& _batch);
+  void  beginBatch();
+
+  // Reserves up to _maxSize bytes (a multiple of _granularity) of the ring, making room if needed.
+  // Returns the reserved size.
+  VkDeviceSize allocateStaging(const VkDeviceSize _maxSize,
+                               const VkDeviceSize _granularity,
+                               const VkDeviceSize _alignment,
+                               VkDeviceSize&      _offset);
+
+  // A single level through as many chunks as needed, in whole rows of blocks
+  void stageImageRows(const char*        _pixels,
+                      const VkImage&     _dst,
+                      const uint32_t     _mipLevel,
+                      const uint32_t     _width,
+                      const uint32_t     _height,
+                      const uint32_t     _blockExtent,
+                      const VkDeviceSize _blockSize);
+
+  // Layout transition on the copy queue, and queue family release/acquire once all its data is copied
+  void beginImageUpload(const VkImage& _image, const uint32_t _mipLevels);
+  void endImageUpload(const VkImage& _image, const uint32_t _mipLevels);
+};
+}
+#endif
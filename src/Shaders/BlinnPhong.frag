@@ -39,13 +39,17 @@ layout(location = 0) out vec4 _outColor; // location=0: framebuffer index
 vec3 getNormal()
 {
   vec3 result;
-  const vec3 tangetSpaceNormal = normalize( texture(_normalMapSampler, _texCoord).xyz );
+  // Only X and Y are used: BC5 normal maps don't store Z. The empty texture (no normal map) is all 0.
+  const vec2 rawNormal = texture(_normalMapSampler, _texCoord).xy;
   // TODO: Think a way to remove this branching
-  if (tangetSpaceNormal != vec3(0))
+  if (rawNormal != vec2(0))
   {
+    vec3 tangetSpaceNormal;
+    tangetSpaceNormal.xy = rawNormal * 2.0 - 1.0; // Normals must go from -1 to 1, but textures go from 0 to 1
+    tangetSpaceNormal.z  = sqrt( max(1.0 - dot(tangetSpaceNormal.xy, tangetSpaceNormal.xy), 0.0) );
+
     const mat3 TBN = mat3(_tangent, _bitangent, _normal); // tangent->view space
-    result = TBN * (tangetSpaceNormal * 2.0 - 1.0);   // Normals must go from -1 to 1, but textures go from 0 to 1
-    result = normalize(result);
+    result = normalize(TBN * tangetSpaceNormal);
   }
   else result = normalize(_normal);
 
@@ -9,11 +9,46 @@ layout(set = 0, binding = 0) uniform modelViewProjectionNormalUBO
   mat4 normal;
 } u_mvpn;
 
+#ifdef INSTANCED
+// Compiled into vert_instanced.spv. One entry per instance, indexed with the draw's firstInstance.
+struct InstanceData
+{
+  mat4 modelView;
+  mat4 normal;
+};
+
+layout(std430, set = 0, binding = 4) readonly buffer instancesSSBO
+{
+  InstanceData data[];
+} s_instances;
+#endif
+
+#ifdef PACKED_VERTEX
+// Compiled into vert_packed.spv, see PackedVertex. The position is quantized to [0,1], the
+// dequantization is already baked into modelView.
+layout(location = 0) in  vec4 _inPosition; // w is the bitangent's sign, 0 for -1
+layout(location = 1) in  vec2 _inNormal;   // Octahedral
+layout(location = 2) in  vec2 _inTangent;  // Octahedral
+layout(location = 4) in  vec2 _inTexCoord;
+
+vec3 decodeOctahedral(const vec2 _encoded)
+{
+  vec3 direction = vec3(_encoded, 1.0 - abs(_encoded.x) - abs(_encoded.y));
+
+  // Lower hemisphere, unfold it
+  if (direction.z < 0.0)
+    direction.xy = (1.0 - abs(direction.yx)) * vec2(direction.x >= 0.0 ? 1.0 : -1.0,
+                                                     direction.y >= 0.0 ? 1.0 : -1.0);
+
+  return normalize(direction);
+}
+#else
 layout(location = 0) in  vec3 _inPosition;
 layout(location = 1) in  vec3 _inNormal;
 layout(location = 2) in  vec3 _inTangent;
 layout(location = 3) in  vec3 _inBitangent;
 layout(location = 4) in  vec2 _inTexCoord;
+#endif
 
 layout(location = 0) out vec3  _fragPosition;
 layout(location = 1) out vec3  _fragNormal;
@@ -23,12 +58,32 @@ layout(location = 4) out vec2  _fragTexCoord;
 
 void main()
 {
-  const vec4 cameraVertexPos = u_mvpn.modelView * vec4(_inPosition, 1.0);
+#ifdef INSTANCED
+  const mat4 modelView = s_instances.data[gl_InstanceIndex].modelView;
+  const mat4 normalMat = s_instances.data[gl_InstanceIndex].normal;
+#else
+  const mat4 modelView = u_mvpn.modelView;
+  const mat4 normalMat = u_mvpn.normal;
+#endif
+
+#ifdef PACKED_VERTEX
+  const vec3 position  = _inPosition.xyz;
+  const vec3 normal    = decodeOctahedral(_inNormal);
+  const vec3 tangent   = decodeOctahedral(_inTangent);
+  const vec3 bitangent = cross(normal, tangent) * (_inPosition.w > 0.5 ? 1.0 : -1.0);
+#else
+  const vec3 position  = _inPosition;
+  const vec3 normal    = _inNormal;
+  const vec3 tangent   = _inTangent;
+  const vec3 bitangent = _inBitangent;
+#endif
+
+  const vec4 cameraVertexPos = modelView * vec4(position, 1.0);
 
   _fragPosition  = cameraVertexPos.xyz;
-  _fragNormal    = (u_mvpn.normal * vec4(_inNormal, 0)).xyz;
-  _fragTangent   = (u_mvpn.normal * vec4(_inTangent, 0)).xyz;
-  _fragBitangent = (u_mvpn.normal * vec4(_inBitangent, 0)).xyz;
+  _fragNormal    = (normalMat * vec4(normal, 0)).xyz;
+  _fragTangent   = (normalMat * vec4(tangent, 0)).xyz;
+  _fragBitangent = (normalMat * vec4(bitangent, 0)).xyz;
   _fragTexCoord  = _inTexCoord;
 
   gl_Position = u_mvpn.proj * cameraVertexPos;
@@ -0,0 +1,474 @@
+#include "VPBlockEncoder.hpp"
+
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <stdexcept>
+
+namespace vpe::blockEncoder
+{
+  namespace
+  {
+    constexpr uint32_t MAX_CHANNELS = 4;
+
+    struct Endpoints
+    {
+      float start[MAX_CHANNELS];
+      float end[MAX_CHANNELS];
+    };
+
+    // Extremes of the block along its principal axis, which is where the palettes lie
+    Endpoints fitPrincipalAxis(const float _texels[BLOCK_TEXELS][MAX_CHANNELS], const uint32_t _channels)
+    {
+      float mean[MAX_CHANNELS] = {};
+      for (uint32_t t=0; t<BLOCK_TEXELS; ++t)
+        for (uint32_t c=0; c<_channels; ++c) mean[c] += _texels[t][c] / BLOCK_TEXELS;
+
+      float covariance[MAX_CHANNELS][MAX_CHANNELS] = {};
+      for (uint32_t t=0; t<BLOCK_TEXELS; ++t)
+        for (uint32_t i=0; i<_channels; ++i)
+          for (uint32_t j=0; j<_channels; ++j)
+            covariance[i][j] += (_texels[t][i] - mean[i]) * (_texels[t][j] - mean[j]);
+
+      // Power iteration, a few steps are enough to tell the direction
+      float axis[MAX_CHANNELS] = {};
+      for (uint32_t c=0; c<_channels; ++c) axis[c] = 1.0f;
+      for (uint32_t iteration=0; iteration<8; ++iteration)
+      {
+        float next[MAX_CHANNELS] = {};
+        float length = 0.0f;
+        for (uint32_t i=0; i<_channels; ++i)
+        {
+          for (uint32_t j=0; j<_channels; ++j) next[i] += covariance[i][j] * axis[j];
+          length += next[i] * next[i];
+        }
+
+        length = std::sqrt(length);
+        if (length < 1e-6f) break; // Flat block, any axis works
+
+        for (uint32_t c=0; c<_channels; ++c) axis[c] = next[c] / length;
+      }
+
+      float minProjection = 0.0f;
+      float maxProjection = 0.0f;
+      for (uint32_t t=0; t<BLOCK_TEXELS; ++t)
+      {
+        float projection = 0.0f;
+        for (uint32_t c=0; c<_channels; ++c) projection += (_texels[t][c] - mean[c]) * axis[c];
+
+        minProjection = std::min(minProjection, projection);
+        maxProjection = std::max(maxProjection, projection);
+      }
+
+      Endpoints result{};
+      for (uint32_t c=0; c<_channels; ++c)
+      {
+        result.start[c] = std::clamp(mean[c] + minProjection * axis[c], 0.0f, 255.0f);
+        result.end[c]   = std::clamp(mean[c] + maxProjection * axis[c], 0.0f, 255.0f);
+      }
+
+      return result;
+    }
+
+    // Least squares endpoints for the chosen palette entries. _weights: how far towards the end each texel is.
+    // False if the system is degenerate (every texel on the same entry).
+    bool refineEndpoints(const float    _texels[BLOCK_TEXELS][MAX_CHANNELS],
+                         const float    _weights[BLOCK_TEXELS],
+                         const uint32_t _channels,
+                         Endpoints&     _result)
+    {
+      float aa = 0.0f, ab = 0.0f, bb = 0.0f;
+      float startSum[MAX_CHANNELS] = {};
+      float endSum[MAX_CHANNELS]   = {};
+
+      for (uint32_t t=0; t<BLOCK_TEXELS; ++t)
+      {
+        const float w = _weights[t];
+        aa += (1.0f - w) * (1.0f - w);
+        ab += (1.0f - w) * w;
+        bb += w * w;
+
+        for (uint32_t c=0; c<_channels; ++c)
+        {
+          startSum[c] += (1.0f - w) * _texels[t][c];
+          endSum[c]   += w * _texels[t][c];
+        }
+      }
+
+      const float determinant = aa * bb - ab * ab;
+      if (std::abs(determinant) < 1e-6f) return false;
+
+      for (uint32_t c=0; c<_channels; ++c)
+      {
+        _result.start[c] = std::clamp((bb * startSum[c] - ab * endSum[c]) / determinant, 0.0f, 255.0f);
+        _result.end[c]   = std::clamp((aa * endSum[c] - ab * startSum[c]) / determinant, 0.0f, 255.0f);
+      }
+
+      return true;
+    }
+
+    void toFloat(const uint8_t _texels[BLOCK_TEXELS * 4], float _result[BLOCK_TEXELS][MAX_CHANNELS])
+    {
+      for (uint32_t t=0; t<BLOCK_TEXELS; ++t)
+        for (uint32_t c=0; c<MAX_CHANNELS; ++c) _result[t][c] = _texels[t * 4 + c];
+    }
+
+    // Fills the bits from the least significant one, like the formats expect
+    class BitWriter
+    {
+    public:
+      explicit BitWriter(uint8_t* _pResult, const size_t _size) : m_pResult(_pResult), m_position(0)
+      {
+        memset(m_pResult, 0, _size);
+      }
+
+      inline void write(const uint32_t _value, const uint32_t _bitCount)
+      {
+        for (uint32_t b=0; b<_bitCount; ++b, ++m_position)
+          m_pResult[m_position / 8] |= ((_value >> b) & 1) << (m_position % 8);
+      }
+
+    private:
+      uint8_t* m_pResult;
+      uint32_t m_position;
+    };
+
+    // BC1 ---------------------------------------------------------------------------------------------------------
+
+    struct BC1Block
+    {
+      uint16_t color0;
+      uint16_t color1;
+      uint8_t  indices[BLOCK_TEXELS];
+      float    error;
+    };
+
+    inline uint16_t packRGB565(const float _color[MAX_CHANNELS])
+    {
+      const uint32_t r = static_cast<uint32_t>( std::lround(_color[0] * 31.0f / 255.0f) );
+      const uint32_t g = static_cast<uint32_t>( std::lround(_color[1] * 63.0f / 255.0f) );
+      const uint32_t b = static_cast<uint32_t>( std::lround(_color[2] * 31.0f / 255.0f) );
+      return static_cast<uint16_t>((r << 11) | (g << 5) | b);
+    }
+
+    inline void unpackRGB565(const uint16_t _packed, int _result[3])
+    {
+      const int r = (_packed >> 11) & 31;
+      const int g = (_packed >> 5)  & 63;
+      const int b = _packed         & 31;
+      _result[0] = (r << 3) | (r >> 2);
+      _result[1] = (g << 2) | (g >> 4);
+      _result[2] = (b << 3) | (b >> 2);
+    }
+
+    BC1Block encodeBC1Endpoints(const float _texels[BLOCK_TEXELS][MAX_CHANNELS], const Endpoints& _endpoints)
+    {
+      BC1Block result{};
+      result.color0 = packRGB565(_endpoints.end);
+      result.color1 = packRGB565(_endpoints.start);
+
+      // The 4 color mode needs color0 > color1. When they're equal every texel uses color0 anyway.
+      if (result.color0 < result.color1) std::swap(result.color0, result.color1);
+
+      int palette[4][3];
+      unpackRGB565(result.color0, palette[0]);
+      unpackRGB565(result.color1, palette[1]);
+      for (uint32_t c=0; c<3; ++c)
+      {
+        palette[2][c] = (2 * palette[0][c] + palette[1][c]) / 3;
+        palette[3][c] = (palette[0][c] + 2 * palette[1][c]) / 3;
+      }
+
+      const uint32_t paletteSize = result.color0 == result.color1 ? 1 : 4;
+
+      for (uint32_t t=0; t<BLOCK_TEXELS; ++t)
+      {
+        float bestError = INFINITY;
+        for (uint32_t p=0; p<paletteSize; ++p)
+        {
+          float error = 0.0f;
+          for (uint32_t c=0; c<3; ++c) error += (_texels[t][c] - palette[p][c]) * (_texels[t][c] - palette[p][c]);
+
+          if (error < bestError)
+          {
+            bestError         = error;
+            result.indices[t] = static_cast<uint8_t>(p);
+          }
+        }
+        result.error += bestError;
+      }
+
+      return result;
+    }
+
+    // BC4, one channel. BC5 is two of them. ----------------------------------------------------------------------
+
+    struct BC4Block
+    {
+      uint8_t red0;
+      uint8_t red1;
+      uint8_t indices[BLOCK_TEXELS];
+      float   error;
+    };
+
+    BC4Block encodeBC4Endpoints(const float _values[BLOCK_TEXELS], float _start, float _end)
+    {
+      BC4Block result{};
+      // red0 > red1 selects the 8 value mode, with 6 interpolated values
+      result.red0 = static_cast<uint8_t>( std::lround(std::max(_start, _end)) );
+      result.red1 = static_cast<uint8_t>( std::lround(std::min(_start, _end)) );
+
+      int palette[8] = {result.red0, result.red1};
+      for (int p=2; p<8; ++p) palette[p] = ((8 - p) * result.red0 + (p - 1) * result.red1) / 7;
+
+      const uint32_t paletteSize = result.red0 == result.red1 ? 1 : 8;
+
+      for (uint32_t t=0; t<BLOCK_TEXELS; ++t)
+      {
+        float bestError = INFINITY;
+        for (uint32_t p=0; p<paletteSize; ++p)
+        {
+          const float error = (_values[t] - palette[p]) * (_values[t] - palette[p]);
+          if (error < bestError)
+          {
+            bestError         = error;
+            result.indices[t] = static_cast<uint8_t>(p);
+          }
+        }
+        result.error += bestError;
+      }
+
+      return result;
+    }
+
+    void encodeBC4(const uint8_t _texels[BLOCK_TEXELS * 4], const uint32_t _channel, uint8_t _result[8])
+    {
+      float values[BLOCK_TEXELS][MAX_CHANNELS] = {};
+      float minValue = 255.0f;
+      float maxValue = 0.0f;
+      for (uint32_t t=0; t<BLOCK_TEXELS; ++t)
+      {
+        values[t][0] = _texels[t * 4 + _channel];
+        minValue     = std::min(minValue, values[t][0]);
+        maxValue     = std::max(maxValue, values[t][0]);
+      }
+
+      float flatValues[BLOCK_TEXELS];
+      for (uint32_t t=0; t<BLOCK_TEXELS; ++t) flatValues[t] = values[t][0];
+
+      BC4Block best = encodeBC4Endpoints(flatValues, maxValue, minValue);
+
+      if (best.red0 != best.red1)
+      {
+        // From red0 (0) to red1 (1)
+        float weights[BLOCK_TEXELS];
+        for (uint32_t t=0; t<BLOCK_TEXELS; ++t)
+          weights[t] = best.indices[t] < 2 ? float(best.indices[t]) : (best.indices[t] - 1) / 7.0f;
+
+        Endpoints refined{};
+        if (refineEndpoints(values, weights, 1, refined))
+        {
+          const BC4Block candidate = encodeBC4Endpoints(flatValues, refined.start[0], refined.end[0]);
+          if (candidate.error < best.error) best = candidate;
+        }
+      }
+
+      BitWriter writer(_result, 8);
+      writer.write(best.red0, 8);
+      writer.write(best.red1, 8);
+      for (uint32_t t=0; t<BLOCK_TEXELS; ++t) writer.write(best.indices[t], 3);
+    }
+
+    // BC7 mode 6 ---------------------------------------------------------------------------------------------------
+
+    constexpr int BC7_WEIGHTS_4[16] = {0, 4, 9, 13, 17, 21, 26, 30, 34, 38, 43, 47, 51, 55, 60, 64};
+
+    struct BC7Block
+    {
+      uint8_t endpoints[2][MAX_CHANNELS]; // 7 bits
+      uint8_t pBits[2];
+      uint8_t indices[BLOCK_TEXELS];
+      float   error;
+    };
+
+    // The endpoints are 7 bits plus a shared least significant bit, the best of both is kept
+    void quantizeBC7Endpoint(const float _endpoint[MAX_CHANNELS], uint8_t _result[MAX_CHANNELS], uint8_t& _pBit)
+    {
+      float bestError = INFINITY;
+      for (uint8_t p=0; p<2; ++p)
+      {
+        uint8_t quantized[MAX_CHANNELS];
+        float   error = 0.0f;
+        for (uint32_t c=0; c<MAX_CHANNELS; ++c)
+        {
+          quantized[c] = static_cast<uint8_t>( std::clamp<long>(std::lround((_endpoint[c] - p) * 0.5f), 0, 127) );
+          const float reconstructed = (quantized[c] << 1) | p;
+          error += (reconstructed - _endpoint[c]) * (reconstructed - _endpoint[c]);
+        }
+
+        if (error < bestError)
+        {
+          bestError = error;
+          _pBit     = p;
+          memcpy(_result, quantized, MAX_CHANNELS);
+        }
+      }
+    }
+
+    BC7Block encodeBC7Endpoints(const float _texels[BLOCK_TEXELS][MAX_CHANNELS], const Endpoints& _endpoints)
+    {
+      BC7Block result{};
+      quantizeBC7Endpoint(_endpoints.start, result.endpoints[0], result.pBits[0]);
+      quantizeBC7Endpoint(_endpoints.end,   result.endpoints[1], result.pBits[1]);
+
+      int palette[16][MAX_CHANNELS];
+      for (uint32_t c=0; c<MAX_CHANNELS; ++c)
+      {
+        const int start = (result.endpoints[0][c] << 1) | result.pBits[0];
+        const int end   = (result.endpoints[1][c] << 1) | result.pBits[1];
+        for (uint32_t p=0; p<16; ++p)
+          palette[p][c] = ((64 - BC7_WEIGHTS_4[p]) * start + BC7_WEIGHTS_4[p] * end + 32) >> 6;
+      }
+
+      for (uint32_t t=0; t<BLOCK_TEXELS; ++t)
+      {
+        float bestError = INFINITY;
+        for (uint32_t p=0; p<16; ++p)
+        {
+          float error = 0.0f;
+          for (uint32_t c=0; c<MAX_CHANNELS; ++c)
+            error += (_texels[t][c] - palette[p][c]) * (_texels[t][c] - palette[p][c]);
+
+          if (error < bestError)
+          {
+            bestError         = error;
+            result.indices[t] = static_cast<uint8_t>(p);
+          }
+        }
+        result.error += bestError;
+      }
+
+      return result;
+    }
+  }
+
+  void encodeBC1(const uint8_t _texels[BLOCK_TEXELS * 4], uint8_t _result[8])
+  {
+    float texels[BLOCK_TEXELS][MAX_CHANNELS];
+    toFloat(_texels, texels);
+
+    BC1Block best = encodeBC1Endpoints(texels, fitPrincipalAxis(texels, 3));
+
+    if (best.color0 != best.color1)
+    {
+      // From color0 (0) to color1 (1), in palette order
+      constexpr float BC1_WEIGHTS[4] = {0.0f, 1.0f, 1.0f / 3.0f, 2.0f / 3.0f};
+
+      float weights[BLOCK_TEXELS];
+      for (uint32_t t=0; t<BLOCK_TEXELS; ++t) weights[t] = BC1_WEIGHTS[ best.indices[t] ];
+
+      Endpoints refined{};
+      if (refineEndpoints(texels, weights, 3, refined))
+      {
+        std::swap(refined.start, refined.end); // encodeBC1Endpoints puts the end in color0
+        const BC1Block candidate = encodeBC1Endpoints(texels, refined);
+        if (candidate.error < best.error) best = candidate;
+      }
+    }
+
+    BitWriter writer(_result, 8);
+    writer.write(best.color0, 16);
+    writer.write(best.color1, 16);
+    for (uint32_t t=0; t<BLOCK_TEXELS; ++t) writer.write(best.indices[t], 2);
+  }
+
+  void encodeBC5(const uint8_t _texels[BLOCK_TEXELS * 4], uint8_t _result[16])
+  {
+    encodeBC4(_texels, 0, _result);
+    encodeBC4(_texels, 1, _result + 8);
+  }
+
+  void encodeBC7(const uint8_t _texels[BLOCK_TEXELS * 4], uint8_t _result[16])
+  {
+    float texels[BLOCK_TEXELS][MAX_CHANNELS];
+    toFloat(_texels, texels);
+
+    BC7Block best = encodeBC7Endpoints(texels, fitPrincipalAxis(texels, 4));
+
+    float weights[BLOCK_TEXELS];
+    for (uint32_t t=0; t<BLOCK_TEXELS; ++t) weights[t] = BC7_WEIGHTS_4[ best.indices[t] ] / 64.0f;
+
+    Endpoints refined{};
+    if (refineEndpoints(texels, weights, 4, refined))
+    {
+      const BC7Block candidate = encodeBC7Endpoints(texels, refined);
+      if (candidate.error < best.error) best = candidate;
+    }
+
+    // The first texel's index has an implicit 0 as its most significant bit
+    if (best.indices[0] >= 8)
+    {
+      std::swap(best.endpoints[0], best.endpoints[1]);
+      std::swap(best.pBits[0], best.pBits[1]);
+      for (auto& index : best.indices) index = 15 - index;
+    }
+
+    BitWriter writer(_result, 16);
+    writer.write(1 << 6, 7); // Mode 6
+    for (uint32_t c=0; c<MAX_CHANNELS; ++c)
+    {
+      writer.write(best.endpoints[0][c], 7);
+      writer.write(best.endpoints[1][c], 7);
+    }
+    writer.write(best.pBits[0], 1);
+    writer.write(best.pBits[1], 1);
+
+    writer.write(best.indices[0], 3);
+    for (uint32_t t=1; t<BLOCK_TEXELS; ++t) writer.write(best.indices[t], 4);
+  }
+
+  std::vector<char> encodeImage(const std::vector<char>& _rgba,
+                                const uint32_t           _width,
+                                const uint32_t           _height,
+                                const VkFormat           _format)
+  {
+    size_t blockSize = 0;
+    void (*encodeBlock)(const uint8_t*, uint8_t*) = nullptr;
+
+    switch (_format)
+    {
+      case VK_FORMAT_BC1_RGB_UNORM_BLOCK: blockSize = 8;  encodeBlock = encodeBC1; break;
+      case VK_FORMAT_BC5_UNORM_BLOCK:     blockSize = 16; encodeBlock = encodeBC5; break;
+      case VK_FORMAT_BC7_UNORM_BLOCK:     blockSize = 16; encodeBlock = encodeBC7; break;
+      default:
+        throw std::runtime_error("ERROR: blockEncoder::encodeImage - Not a supported block compressed format!");
+    }
+
+    const uint32_t blocksX = (_width  + BLOCK_EXTENT - 1) / BLOCK_EXTENT;
+    const uint32_t blocksY = (_height + BLOCK_EXTENT - 1) / BLOCK_EXTENT;
+
+    std::vector<char> result(size_t(blocksX) * blocksY * blockSize);
+    const uint8_t*    pSrc = reinterpret_cast<const uint8_t*>(_rgba.data());
+
+    uint8_t texels[BLOCK_TEXELS * 4];
+    for (uint32_t by=0; by<blocksY; ++by)
+    {
+      for (uint32_t bx=0; bx<blocksX; ++bx)
+      {
+        for (uint32_t y=0; y<BLOCK_EXTENT; ++y)
+        {
+          for (uint32_t x=0; x<BLOCK_EXTENT; ++x)
+          {
+            const uint32_t srcX = std::min(bx * BLOCK_EXTENT + x, _width  - 1);
+            const uint32_t srcY = std::min(by * BLOCK_EXTENT + y, _height - 1);
+            memcpy(&texels[(y * BLOCK_EXTENT + x) * 4], &pSrc[(size_t(srcY) * _width + srcX) * 4], 4);
+          }
+        }
+
+        encodeBlock(texels, reinterpret_cast<uint8_t*>(&result[(size_t(by) * blocksX + bx) * blockSize]));
+      }
+    }
+
+    return result;
+  }
+} // namespace vpe::blockEncoder
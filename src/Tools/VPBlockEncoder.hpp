@@ -0,0 +1,32 @@
+#ifndef VP_BLOCK_ENCODER_HPP
+#define VP_BLOCK_ENCODER_HPP
+
+#include <vulkan/vulkan.h>
+
+#include <cstdint>
+#include <vector>
+
+// CPU encoders for the block compressed formats, used offline by VPTextureConverter.
+// They favour simplicity over the last bit of quality: principal axis endpoints refined by least squares.
+namespace vpe::blockEncoder
+{
+  constexpr uint32_t BLOCK_EXTENT = 4;
+  constexpr uint32_t BLOCK_TEXELS = BLOCK_EXTENT * BLOCK_EXTENT;
+
+  // _texels: the 4x4 RGBA8 texels of the block, row by row
+
+  // Opaque, RGB only
+  void encodeBC1(const uint8_t _texels[BLOCK_TEXELS * 4], uint8_t _result[8]);
+  // R and G as two independent channels, meant for the XY of normal maps
+  void encodeBC5(const uint8_t _texels[BLOCK_TEXELS * 4], uint8_t _result[16]);
+  // RGBA, only mode 6 (a single subset with 7 bit endpoints and 4 bit indices)
+  void encodeBC7(const uint8_t _texels[BLOCK_TEXELS * 4], uint8_t _result[16]);
+
+  // Tightly packed RGBA8 to _format's blocks, row by row.
+  // The blocks on the edges of images that aren't a multiple of 4 repeat the last row and column.
+  std::vector<char> encodeImage(const std::vector<char>& _rgba,
+                                const uint32_t           _width,
+                                const uint32_t           _height,
+                                const VkFormat           _format);
+} // namespace vpe::blockEncoder
+#endif
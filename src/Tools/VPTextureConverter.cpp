@@ -0,0 +1,306 @@
+#include "../VPTextureFile.hpp"
+#include "VPBlockEncoder.hpp"
+
+#include <algorithm>
+#include <cmath>
+#include <iostream>
+
+// Converts images (anything stb_image reads: PNG, JPG...) into .vptex containers with the whole mip chain,
+// so loading them needs no blits. Each mip is filtered from the original, not from the previous level.
+// Usage: VPTextureConverter [--format bc7|bc5|bc1|rgba8] [--filter lanczos|box] [--normal] [--linear] [--clamp]
+//                           [--out path] input...
+//   --format: BC7 by default, BC5 for normal maps (only X and Y, the shader rebuilds Z)
+//   --normal: normal map, the filtered normals are renormalized
+//   --linear: the colors aren't sRGB encoded (implied by --normal)
+//   --clamp:  the texture doesn't tile, the filter doesn't wrap around the edges
+//   --out:    only with a single input, next to it by default
+
+enum class Filter
+{
+  BOX,
+  LANCZOS
+};
+
+struct ConverterConfig
+{
+  std::vector<std::string> inputPaths;
+  std::string              outPath;
+  VkFormat                 format      = VK_FORMAT_UNDEFINED; // Depends on the kind of texture
+  Filter                   filter      = Filter::LANCZOS;
+  bool                     isNormalMap = false;
+  bool                     isLinear    = false;
+  bool                     isWrapping  = true;
+};
+
+// RGBA, 4 floats per texel
+struct FloatImage
+{
+  uint32_t           width  = 0;
+  uint32_t           height = 0;
+  std::vector<float> texels;
+};
+
+constexpr float LANCZOS_RADIUS = 3.0f;
+constexpr float PI             = 3.14159265358979f;
+
+static ConverterConfig parseArgs(const int _argc, char** _argv)
+{
+  ConverterConfig config;
+
+  for (int i=1; i<_argc; ++i)
+  {
+    const std::string arg(_argv[i]);
+    const bool        hasValue = i+1 < _argc;
+
+    if      (arg == "--normal")              config.isNormalMap = true;
+    else if (arg == "--linear")              config.isLinear    = true;
+    else if (arg == "--clamp")               config.isWrapping  = false;
+    else if (arg == "--out"    && hasValue)  config.outPath     = _argv[++i];
+    else if (arg == "--format" && hasValue)
+    {
+      const std::string format(_argv[++i]);
+      if      (format == "bc7")   config.format = VK_FORMAT_BC7_UNORM_BLOCK;
+      else if (format == "bc5")   config.format = VK_FORMAT_BC5_UNORM_BLOCK;
+      else if (format == "bc1")   config.format = VK_FORMAT_BC1_RGB_UNORM_BLOCK;
+      else if (format == "rgba8") config.format = VK_FORMAT_R8G8B8A8_UNORM;
+      else
+        throw std::runtime_error("ERROR: Unknown format " + format);
+    }
+    else if (arg == "--filter" && hasValue)
+    {
+      const std::string filter(_argv[++i]);
+      if      (filter == "box")     config.filter = Filter::BOX;
+      else if (filter == "lanczos") config.filter = Filter::LANCZOS;
+      else
+        throw std::runtime_error("ERROR: Unknown filter " + filter);
+    }
+    else if (arg.rfind("--", 0) == 0)
+      throw std::runtime_error("ERROR: Unknown or incomplete argument " + arg);
+    else
+      config.inputPaths.push_back(arg);
+  }
+
+  if (config.inputPaths.empty())
+    throw std::runtime_error("ERROR: No input images");
+
+  if (!config.outPath.empty() && config.inputPaths.size() > 1)
+    throw std::runtime_error("ERROR: --out only works with a single input");
+
+  // The normals' components are not colors
+  config.isLinear |= config.isNormalMap;
+
+  if (config.format == VK_FORMAT_UNDEFINED)
+    config.format = config.isNormalMap ? VK_FORMAT_BC5_UNORM_BLOCK : VK_FORMAT_BC7_UNORM_BLOCK;
+
+  return config;
+}
+
+static inline float srgbToLinear(const float _value)
+{
+  return _value <= 0.04045f ? _value / 12.92f : std::pow((_value + 0.055f) / 1.055f, 2.4f);
+}
+
+static inline float linearToSrgb(const float _value)
+{
+  return _value <= 0.0031308f ? _value * 12.92f : 1.055f * std::pow(_value, 1.0f / 2.4f) - 0.055f;
+}
+
+static inline float sinc(const float _x)
+{
+  if (std::abs(_x) < 1e-6f) return 1.0f;
+  return std::sin(PI * _x) / (PI * _x);
+}
+
+static inline float evaluateFilter(const Filter _filter, const float _x)
+{
+  if (_filter == Filter::BOX) return std::abs(_x) <= 0.5f ? 1.0f : 0.0f;
+
+  return std::abs(_x) < LANCZOS_RADIUS ? sinc(_x) * sinc(_x / LANCZOS_RADIUS) : 0.0f;
+}
+
+struct Tap
+{
+  uint32_t index;
+  float    weight;
+};
+
+// The source texels contributing to each destination texel along one axis, with normalized weights
+static std::vector<std::vector<Tap>> computeTaps(const uint32_t         _srcSize,
+                                                 const uint32_t         _dstSize,
+                                                 const ConverterConfig& _config)
+{
+  const float scale  = float(_srcSize) / _dstSize;
+  const float radius = (_config.filter == Filter::BOX ? 0.5f : LANCZOS_RADIUS) * scale;
+
+  std::vector<std::vector<Tap>> result(_dstSize);
+
+  for (uint32_t d=0; d<_dstSize; ++d)
+  {
+    const float center = (d + 0.5f) * scale - 0.5f;
+    const int   first  = static_cast<int>( std::ceil(center - radius) );
+    const int   last   = static_cast<int>( std::floor(center + radius) );
+
+    float totalWeight = 0.0f;
+    for (int s=first; s<=last; ++s)
+    {
+      // Stretched to the destination's texel size, so it also filters out what the smaller mip can't represent
+      const float weight = evaluateFilter(_config.filter, (s - center) / scale);
+      if (weight == 0.0f) continue;
+
+      const int size  = static_cast<int>(_srcSize);
+      const int index = _config.isWrapping ? ((s % size) + size) % size : std::clamp(s, 0, size - 1);
+
+      result[d].push_back( Tap{static_cast<uint32_t>(index), weight} );
+      totalWeight += weight;
+    }
+
+    for (auto& tap : result[d]) tap.weight /= totalWeight;
+  }
+
+  return result;
+}
+
+// Separable, horizontal then vertical
+static FloatImage resample(const FloatImage&      _src,
+                           const uint32_t         _width,
+                           const uint32_t         _height,
+                           const ConverterConfig& _config)
+{
+  const auto horizontalTaps = computeTaps(_src.width,  _width,  _config);
+  const auto verticalTaps   = computeTaps(_src.height, _height, _config);
+
+  std::vector<float> rows(size_t(_width) * _src.height * 4, 0.0f);
+  for (uint32_t y=0; y<_src.height; ++y)
+    for (uint32_t x=0; x<_width; ++x)
+      for (const auto& tap : horizontalTaps[x])
+        for (uint32_t c=0; c<4; ++c)
+          rows[(size_t(y) * _width + x) * 4 + c] += tap.weight * _src.texels[(size_t(y) * _src.width + tap.index) * 4 + c];
+
+  FloatImage result;
+  result.width  = _width;
+  result.height = _height;
+  result.texels.assign(size_t(_width) * _height * 4, 0.0f);
+
+  for (uint32_t y=0; y<_height; ++y)
+    for (const auto& tap : verticalTaps[y])
+      for (uint32_t x=0; x<_width; ++x)
+        for (uint32_t c=0; c<4; ++c)
+          result.texels[(size_t(y) * _width + x) * 4 + c] += tap.weight * rows[(size_t(tap.index) * _width + x) * 4 + c];
+
+  return result;
+}
+
+static FloatImage decode(const stbi_uc* _pixels, const uint32_t _width, const uint32_t _height, const ConverterConfig& _config)
+{
+  FloatImage result;
+  result.width  = _width;
+  result.height = _height;
+  result.texels.resize(size_t(_width) * _height * 4);
+
+  for (size_t i=0; i<result.texels.size(); ++i)
+  {
+    const float value = _pixels[i] / 255.0f;
+    const bool  isAlpha = i % 4 == 3;
+
+    // Filtered in linear space, otherwise the mips get darker
+    result.texels[i] = _config.isLinear || isAlpha ? value : srgbToLinear(value);
+  }
+
+  return result;
+}
+
+static std::vector<char> encode(FloatImage& _image, const ConverterConfig& _config)
+{
+  const size_t      texelCount = size_t(_image.width) * _image.height;
+  std::vector<char> result(texelCount * 4);
+
+  for (size_t t=0; t<texelCount; ++t)
+  {
+    float* pTexel = &_image.texels[t * 4];
+
+    if (_config.isNormalMap)
+    {
+      // Averaging shortens them
+      float normal[3]  = {pTexel[0] * 2.0f - 1.0f, pTexel[1] * 2.0f - 1.0f, pTexel[2] * 2.0f - 1.0f};
+      const float length = std::sqrt(normal[0] * normal[0] + normal[1] * normal[1] + normal[2] * normal[2]);
+      if (length > 1e-6f)
+        for (uint32_t c=0; c<3; ++c) pTexel[c] = normal[c] / length * 0.5f + 0.5f;
+    }
+
+    for (uint32_t c=0; c<4; ++c)
+    {
+      float value = std::clamp(pTexel[c], 0.0f, 1.0f); // The negative lobes can overshoot
+      if (!_config.isLinear && c < 3) value = linearToSrgb(value);
+
+      result[t * 4 + c] = static_cast<char>( static_cast<uint8_t>(std::lround(value * 255.0f)) );
+    }
+  }
+
+  return result;
+}
+
+static void convert(const std::string& _inputPath, const std::string& _outPath, const ConverterConfig& _config)
+{
+  int width    = 0;
+  int height   = 0;
+  int channels = 0;
+  stbi_uc* pPixels = stbi_load(_inputPath.c_str(), &width, &height, &channels, STBI_rgb_alpha);
+  if (pPixels == nullptr)
+    throw std::runtime_error("ERROR: Couldn't read " + _inputPath + ": " + stbi_failure_reason());
+
+  FloatImage original = decode(pPixels, width, height, _config);
+  stbi_image_free(pPixels);
+
+  // Same mip count as the runtime generation
+  const uint32_t mipLevels = std::min<uint32_t>(std::floor(std::log2(std::max(width, height))) + 1,
+                                                vpe::MAX_TEXTURE_MIPS);
+
+  const bool isCompressed = _config.format != VK_FORMAT_R8G8B8A8_UNORM;
+
+  std::vector<std::vector<char>> levels;
+  levels.reserve(mipLevels);
+
+  size_t totalSize = 0;
+  for (uint32_t m=0; m<mipLevels; ++m)
+  {
+    const uint32_t mipWidth  = std::max(uint32_t(width)  >> m, 1u);
+    const uint32_t mipHeight = std::max(uint32_t(height) >> m, 1u);
+
+    // The top level round trips too, so the normal maps' get renormalized
+    FloatImage        mip  = m == 0 ? original : resample(original, mipWidth, mipHeight, _config);
+    std::vector<char> rgba = encode(mip, _config);
+
+    if (isCompressed) rgba = vpe::blockEncoder::encodeImage(rgba, mipWidth, mipHeight, _config.format);
+
+    totalSize += rgba.size();
+    levels.push_back( std::move(rgba) );
+  }
+
+  if (!vpe::textureFile::save(_outPath, _config.format, width, height, levels))
+    throw std::runtime_error("ERROR: Couldn't write " + _outPath);
+
+  std::cout << _inputPath << " -> " << _outPath << " (" << width << "x" << height << ", "
+            << mipLevels << " mips, " << totalSize / 1024 << "KiB)" << std::endl;
+}
+
+int main(int argc, char** argv)
+{
+  try
+  {
+    const ConverterConfig config = parseArgs(argc, argv);
+
+    for (const auto& inputPath : config.inputPaths)
+    {
+      const std::string outPath = config.outPath.empty() ? vpe::textureFile::getPath(inputPath.c_str())
+                                                         : config.outPath;
+      convert(inputPath, outPath, config);
+    }
+  }
+  catch(const std::exception& e)
+  {
+    std::cerr << e.what() << '\n';
+    return EXIT_FAILURE;
+  }
+
+  return EXIT_SUCCESS;
+}
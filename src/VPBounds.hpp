@@ -0,0 +1,52 @@
+#ifndef VP_BOUNDS_HPP
+#define VP_BOUNDS_HPP
+
+#include <glm/glm.hpp>
+
+#include <vector>
+#include <algorithm>
+
+#include "VPVertex.hpp"
+
+namespace vpe
+{
+// Object space bounding volumes of a mesh
+struct Bounds
+{
+  glm::vec3 aabbMin      = glm::vec3(0);
+  glm::vec3 aabbMax      = glm::vec3(0);
+  glm::vec3 sphereCenter = glm::vec3(0);
+  float     sphereRadius = 0.0f;
+};
+
+// The sphere is centered in the AABB. Not the tightest, but cheap and good enough for culling.
+inline Bounds computeBounds(const std::vector<Vertex>& _vertices)
+{
+  Bounds result{};
+
+  if (_vertices.empty()) return result;
+
+  result.aabbMin = _vertices.front().pos;
+  result.aabbMax = _vertices.front().pos;
+
+  for (const auto& vertex : _vertices)
+  {
+    result.aabbMin = glm::min(result.aabbMin, vertex.pos);
+    result.aabbMax = glm::max(result.aabbMax, vertex.pos);
+  }
+
+  result.sphereCenter = 0.5f * (result.aabbMin + result.aabbMax);
+
+  float maxDistanceSqr = 0.0f;
+  for (const auto& vertex : _vertices)
+  {
+    const glm::vec3 d = vertex.pos - result.sphereCenter;
+    maxDistanceSqr    = std::max(maxDistanceSqr, glm::dot(d, d));
+  }
+
+  result.sphereRadius = std::sqrt(maxDistanceSqr);
+
+  return result;
+}
+}
+#endif
@@ -128,6 +128,8 @@ public:
 
   inline const glm::mat4& getProjMat() const { return projection; }
   inline const glm::mat4& getViewMat() const { return view; }
+  inline const glm::vec3& getPosition() const { return position; }
+  inline float            getFoV()      const { return fieldOfView; } // Vertical, in radians
 
 private:
 
@@ -0,0 +1,160 @@
+#include "VPDrawList.hpp"
+
+namespace vpe
+{
+// LSD radix sort, one byte per pass. Passes where every key has the same byte are skipped,
+// which is most of them for scenes with few pipelines, materials and meshes.
+void DrawList::sort()
+{
+  const size_t count = m_sorted.size();
+  if (count < 2)
+  {
+    this->buildBatches();
+    return;
+  }
+
+  m_scratch.resize(count);
+
+  SortItem* pSrc = m_sorted.data();
+  SortItem* pDst = m_scratch.data();
+
+  for (uint32_t shift=0; shift<64; shift+=8)
+  {
+    std::array<size_t, 256> histogram{};
+
+    for (size_t i=0; i<count; ++i)
+      ++histogram[ (pSrc[i].key >> shift) & 0xFF ];
+
+    // All in the same bucket, the pass wouldn't change anything
+    if (histogram[ (pSrc[0].key >> shift) & 0xFF ] == count) continue;
+
+    size_t offset = 0;
+    for (auto& bucket : histogram)
+    {
+      const size_t bucketSize = bucket;
+      bucket  = offset;
+      offset += bucketSize;
+    }
+
+    for (size_t i=0; i<count; ++i)
+      pDst[ histogram[ (pSrc[i].key >> shift) & 0xFF ]++ ] = pSrc[i];
+
+    std::swap(pSrc, pDst);
+  }
+
+  // Odd amount of passes, the result is in the scratch buffer
+  if (pSrc != m_sorted.data()) m_sorted.swap(m_scratch);
+
+  this->buildBatches();
+}
+
+void DrawList::buildBatches()
+{
+  m_batches.clear();
+
+  for (uint32_t i=0; i<m_sorted.size(); ++i)
+  {
+    const DrawCommand& draw = m_commands.at( m_sorted.at(i).commandIdx );
+
+    if (!m_batches.empty() && draw.instancedPipeline != VK_NULL_HANDLE)
+    {
+      const DrawBatch&   batch = m_batches.back();
+      const DrawCommand& first = m_commands.at( m_sorted.at(batch.first).commandIdx );
+
+      // Same material means same textures, so the first draw's descriptor set works for all of them
+      if (first.pipeline   == draw.pipeline   &&
+          first.materialId == draw.materialId &&
+          first.pMesh      == draw.pMesh      &&
+          first.lod        == draw.lod)
+      {
+        ++m_batches.back().count;
+        continue;
+      }
+    }
+
+    m_batches.push_back({i, 1});
+  }
+}
+
+DrawStats DrawList::record(VkCommandBuffer&                                   _commandBuffer,
+                           const size_t                                       _first,
+                           const size_t                                       _last,
+                           const VkPipelineLayout                             _pipelineLayout,
+                           const std::array<uint32_t, DYNAMIC_BINDING_COUNT>& _dynamicOffsets,
+                           const int                                          _numLights) const
+{
+  DrawStats stats{};
+
+  // Each command buffer starts with no state bound
+  VkPipeline      boundPipeline      = VK_NULL_HANDLE;
+  const Mesh*     pBoundMesh         = nullptr;
+  VkDescriptorSet boundDescriptorSet = VK_NULL_HANDLE;
+
+  // All pipelines share the same layout, so the push constants survive pipeline changes
+  if (_first < _last)
+  {
+    vkCmdPushConstants(_commandBuffer,
+                       _pipelineLayout,
+                       VK_SHADER_STAGE_FRAGMENT_BIT,
+                       0,
+                       sizeof(int),
+                       &_numLights);
+  }
+
+  for (size_t i=_first; i<_last; ++i)
+  {
+    const DrawBatch&   batch = m_batches.at(i);
+    const DrawCommand& draw  = m_commands.at( m_sorted.at(batch.first).commandIdx );
+
+    // Instanced draws read their matrices from the instances SSBO instead of the UBO
+    const VkPipeline pipeline = draw.instancedPipeline != VK_NULL_HANDLE ? draw.instancedPipeline :
+                                                                           draw.pipeline;
+    if (pipeline != boundPipeline)
+    {
+      vkCmdBindPipeline(_commandBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, pipeline);
+      boundPipeline = pipeline;
+      ++stats.pipelineBinds;
+    }
+    else ++stats.skippedBinds;
+
+    if (draw.pMesh != pBoundMesh)
+    {
+      VkBuffer     vertexBuffers[] = {draw.pMesh->m_vertexBuffer};
+      VkDeviceSize offsets[]       = {0};
+      vkCmdBindVertexBuffers(_commandBuffer, 0, 1, vertexBuffers, offsets);
+
+      vkCmdBindIndexBuffer(_commandBuffer, draw.pMesh->m_indexBuffer, 0, draw.pMesh->m_indexType);
+
+      pBoundMesh = draw.pMesh;
+      ++stats.meshBinds;
+    }
+    else ++stats.skippedBinds;
+
+    // The dynamic offsets are the same for the whole frame
+    if (draw.descriptorSet != boundDescriptorSet)
+    {
+      vkCmdBindDescriptorSets(_commandBuffer,
+                              VK_PIPELINE_BIND_POINT_GRAPHICS,
+                              _pipelineLayout,
+                              0,
+                              1,
+                              &draw.descriptorSet,
+                              _dynamicOffsets.size(),
+                              _dynamicOffsets.data());
+
+      boundDescriptorSet = draw.descriptorSet;
+      ++stats.descriptorBinds;
+    }
+    else ++stats.skippedBinds;
+
+    // gl_InstanceIndex starts at firstInstance, i.e. the batch's slot in the instances SSBO
+    const LodRange& lod = draw.pMesh->getLod(draw.lod);
+    vkCmdDrawIndexed(_commandBuffer, lod.indexCount, batch.count, lod.firstIndex, 0, batch.first);
+    stats.triangles += static_cast<uint64_t>(lod.indexCount / 3) * batch.count;
+    ++stats.draws;
+    stats.instances += batch.count;
+  }
+
+  return stats;
+}
+}
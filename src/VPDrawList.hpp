@@ -0,0 +1,146 @@
+#ifndef VP_DRAW_LIST_HPP
+#define VP_DRAW_LIST_HPP
+
+#include <vulkan/vulkan.h>
+
+#include <array>
+#include <vector>
+
+#include "Managers/VPStdRenderPipelineManager.hpp"
+
+namespace vpe
+{
+// Sort key layout (most significant first), so draws sharing state end up next to each other:
+// | pipeline hash (16) | material id (16) | mesh id (16) | LOD (16) |
+constexpr uint32_t SORT_KEY_PIPELINE_SHIFT = 48;
+constexpr uint32_t SORT_KEY_MATERIAL_SHIFT = 32;
+constexpr uint32_t SORT_KEY_MESH_SHIFT     = 16;
+constexpr uint32_t SORT_KEY_LOD_SHIFT      = 0;
+constexpr uint64_t SORT_KEY_FIELD_MASK     = 0xFFFF;
+
+// Everything needed to record a draw, resolved on the main thread so workers don't touch the scene
+struct DrawCommand
+{
+  VkPipeline      pipeline;
+  VkPipeline      instancedPipeline; // VK_NULL_HANDLE if the material can't be instanced
+  uint32_t        materialId;
+  const Mesh*     pMesh;
+  uint32_t        lod;
+  VkDescriptorSet descriptorSet;
+  uint32_t        objectIdx;
+};
+
+// Consecutive sorted draws recorded with a single draw call
+struct DrawBatch
+{
+  uint32_t first;
+  uint32_t count;
+};
+
+struct DrawStats
+{
+  uint32_t draws           = 0; // Draw calls
+  uint32_t instances       = 0; // Objects drawn
+  uint32_t pipelineBinds   = 0;
+  uint32_t meshBinds       = 0; // Vertex + index buffers
+  uint32_t descriptorBinds = 0;
+  uint32_t skippedBinds    = 0; // Binds avoided because the state was already set
+  uint32_t culledObjects   = 0; // Outside the frustum, not even in the list
+  uint64_t triangles       = 0; // Of the selected LODs. Instanced dense meshes overflow 32 bits
+
+  inline DrawStats& operator+=(const DrawStats& _other)
+  {
+    draws           += _other.draws;
+    instances       += _other.instances;
+    pipelineBinds   += _other.pipelineBinds;
+    meshBinds       += _other.meshBinds;
+    descriptorBinds += _other.descriptorBinds;
+    skippedBinds    += _other.skippedBinds;
+    culledObjects   += _other.culledObjects;
+    triangles       += _other.triangles;
+    return *this;
+  }
+};
+
+class DrawList
+{
+public:
+  DrawList() {}
+
+  inline void clear()
+  {
+    m_commands.clear();
+    m_sorted.clear();
+    m_batches.clear();
+  }
+
+  inline void reserve(const size_t _count)
+  {
+    m_commands.reserve(_count);
+    m_sorted.reserve(_count);
+    m_scratch.reserve(_count);
+  }
+
+  inline size_t size()       const { return m_commands.size(); }
+  inline size_t batchCount() const { return m_batches.size(); }
+
+  // Object whose instance data goes in the _sortedIdx slot of the instances SSBO
+  inline uint32_t getObjectIdx(const size_t _sortedIdx) const
+  {
+    return m_commands.at( m_sorted.at(_sortedIdx).commandIdx ).objectIdx;
+  }
+
+  inline void add(const VkPipeline       _pipeline,
+                  const VkPipeline       _instancedPipeline,
+                  const StdMaterial&     _material,
+                  const Mesh&            _mesh,
+                  const uint32_t         _lod,
+                  const VkDescriptorSet  _descriptorSet,
+                  const uint32_t         _objectIdx)
+  {
+    m_sorted.push_back({ makeSortKey(_material, _mesh, _lod), static_cast<uint32_t>(m_commands.size()) });
+    m_commands.push_back({_pipeline, _instancedPipeline, _material.id, &_mesh, _lod, _descriptorSet, _objectIdx});
+  }
+
+  // Stable, so draws with equal keys keep their scene order.
+  // Then merges the runs of draws sharing pipeline, material, mesh and LOD into instanced batches.
+  void sort();
+
+  // Records the batches in [_first, _last), only binding what changed since the previous one.
+  // Doesn't modify the list, so several threads can record different ranges at the same time.
+  // The instance data of the draw at sorted position i must be in the i-th slot of the instances SSBO.
+  DrawStats record(VkCommandBuffer&                                   _commandBuffer,
+                   const size_t                                       _first,
+                   const size_t                                       _last,
+                   const VkPipelineLayout                             _pipelineLayout,
+                   const std::array<uint32_t, DYNAMIC_BINDING_COUNT>& _dynamicOffsets,
+                   const int                                          _numLights) const;
+
+private:
+  struct SortItem
+  {
+    uint64_t key;
+    uint32_t commandIdx;
+  };
+
+  std::vector<DrawCommand> m_commands;
+  std::vector<SortItem>    m_sorted;
+  std::vector<SortItem>    m_scratch; // Radix sort ping-pong buffer
+  std::vector<DrawBatch>   m_batches;
+
+  void buildBatches();
+
+  static inline uint64_t makeSortKey(const StdMaterial& _material, const Mesh& _mesh, const uint32_t _lod)
+  {
+    // Fold the whole hash so pipelines differing only in the high bits still get different keys
+    const uint64_t hash         = static_cast<uint64_t>(_material.hash);
+    const uint64_t pipelineBits = (hash ^ (hash >> 16) ^ (hash >> 32) ^ (hash >> 48)) & SORT_KEY_FIELD_MASK;
+
+    return (pipelineBits                                 << SORT_KEY_PIPELINE_SHIFT) |
+           ((_material.id & SORT_KEY_FIELD_MASK)          << SORT_KEY_MATERIAL_SHIFT) |
+           ((_mesh.m_id   & SORT_KEY_FIELD_MASK)          << SORT_KEY_MESH_SHIFT)     |
+           ((_lod         & SORT_KEY_FIELD_MASK)          << SORT_KEY_LOD_SHIFT);
+  }
+};
+}
+#endif
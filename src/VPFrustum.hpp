@@ -0,0 +1,136 @@
+#ifndef VP_FRUSTUM_HPP
+#define VP_FRUSTUM_HPP
+
+#include <glm/glm.hpp>
+
+#include <array>
+#include <vector>
+
+#if defined(__SSE__) || defined(_M_X64)
+#include <xmmintrin.h>
+#define VP_FRUSTUM_SSE
+#endif
+
+namespace vpe
+{
+constexpr uint8_t FRUSTUM_PLANE_COUNT = 6;
+
+// Bounding spheres as Structure of Arrays, so they can be tested 4 at a time
+struct SphereSoA
+{
+  std::vector<float> x;
+  std::vector<float> y;
+  std::vector<float> z;
+  std::vector<float> radius;
+
+  inline size_t size() const { return x.size(); }
+
+  inline void resize(const size_t _count)
+  {
+    x.resize(_count);
+    y.resize(_count);
+    z.resize(_count);
+    radius.resize(_count);
+  }
+};
+
+class Frustum
+{
+public:
+  Frustum() : m_planes() {}
+
+  // Gribb & Hartmann. Expects a [0,1] depth range (GLM_FORCE_DEPTH_ZERO_TO_ONE).
+  // The planes are in the space _viewProj transforms from, and point inwards.
+  explicit Frustum(const glm::mat4& _viewProj)
+  {
+    const glm::vec4 row0(_viewProj[0][0], _viewProj[1][0], _viewProj[2][0], _viewProj[3][0]);
+    const glm::vec4 row1(_viewProj[0][1], _viewProj[1][1], _viewProj[2][1], _viewProj[3][1]);
+    const glm::vec4 row2(_viewProj[0][2], _viewProj[1][2], _viewProj[2][2], _viewProj[3][2]);
+    const glm::vec4 row3(_viewProj[0][3], _viewProj[1][3], _viewProj[2][3], _viewProj[3][3]);
+
+    m_planes[0] = row3 + row0; // Left
+    m_planes[1] = row3 - row0; // Right
+    m_planes[2] = row3 + row1; // Bottom (top with the flipped Y, it doesn't matter)
+    m_planes[3] = row3 - row1; // Top
+    m_planes[4] = row2;        // Near
+    m_planes[5] = row3 - row2; // Far
+
+    for (auto& plane : m_planes)
+      plane /= glm::length(glm::vec3(plane));
+  }
+
+  inline bool isSphereVisible(const glm::vec3& _center, const float _radius) const
+  {
+    for (const auto& plane : m_planes)
+    {
+      if (glm::dot(glm::vec3(plane), _center) + plane.w < -_radius) return false;
+    }
+    return true;
+  }
+
+  // Writes 1 to _visibility[i] if sphere i intersects the frustum, 0 otherwise.
+  // Returns how many were culled.
+  inline size_t cullSpheres(const SphereSoA& _spheres, std::vector<uint8_t>& _visibility) const
+  {
+    const size_t count = _spheres.size();
+    _visibility.resize(count);
+
+    size_t culled = 0;
+    size_t i      = 0;
+
+#ifdef VP_FRUSTUM_SSE
+    __m128 nx[FRUSTUM_PLANE_COUNT], ny[FRUSTUM_PLANE_COUNT], nz[FRUSTUM_PLANE_COUNT], d[FRUSTUM_PLANE_COUNT];
+    for (uint8_t p=0; p<FRUSTUM_PLANE_COUNT; ++p)
+    {
+      nx[p] = _mm_set1_ps(m_planes[p].x);
+      ny[p] = _mm_set1_ps(m_planes[p].y);
+      nz[p] = _mm_set1_ps(m_planes[p].z);
+      d[p]  = _mm_set1_ps(m_planes[p].w);
+    }
+
+    for (; i + 4 <= count; i += 4)
+    {
+      const __m128 x         = _mm_loadu_ps(&_spheres.x[i]);
+      const __m128 y         = _mm_loadu_ps(&_spheres.y[i]);
+      const __m128 z         = _mm_loadu_ps(&_spheres.z[i]);
+      const __m128 negRadius = _mm_sub_ps(_mm_setzero_ps(), _mm_loadu_ps(&_spheres.radius[i]));
+
+      // Lane stays set while the sphere is in front of (or touching) every plane
+      __m128 inside = _mm_cmpeq_ps(x, x);
+
+      for (uint8_t p=0; p<FRUSTUM_PLANE_COUNT; ++p)
+      {
+        const __m128 distance = _mm_add_ps(_mm_add_ps(_mm_mul_ps(nx[p], x),
+                                                      _mm_mul_ps(ny[p], y)),
+                                           _mm_add_ps(_mm_mul_ps(nz[p], z), d[p]));
+
+        inside = _mm_and_ps(inside, _mm_cmpge_ps(distance, negRadius));
+      }
+
+      const int mask = _mm_movemask_ps(inside);
+      for (uint8_t lane=0; lane<4; ++lane)
+      {
+        const uint8_t visible = (mask >> lane) & 1;
+        _visibility[i + lane] = visible;
+        culled               += 1 - visible;
+      }
+    }
+#endif
+
+    // Remainder (or everything, without SSE)
+    for (; i<count; ++i)
+    {
+      const bool visible = this->isSphereVisible(glm::vec3(_spheres.x[i], _spheres.y[i], _spheres.z[i]),
+                                                 _spheres.radius[i]);
+      _visibility[i] = visible;
+      culled        += !visible;
+    }
+
+    return culled;
+  }
+
+private:
+  std::array<glm::vec4, FRUSTUM_PLANE_COUNT> m_planes;
+};
+}
+#endif
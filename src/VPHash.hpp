@@ -0,0 +1,34 @@
+#ifndef VP_HASH_HPP
+#define VP_HASH_HPP
+
+#include <cstdint>
+#include <cstddef>
+
+namespace vpe
+{
+constexpr uint64_t FNV1A_OFFSET_BASIS = 0xcbf29ce484222325ull;
+constexpr uint64_t FNV1A_PRIME        = 0x100000001b3ull;
+
+// 64 bit FNV-1a. Fast and good enough to key caches by file contents, NOT cryptographic.
+// Chain calls passing the previous result as _seed to hash several pieces of data.
+inline uint64_t fnv1a(const void* _data, const size_t _size, const uint64_t _seed = FNV1A_OFFSET_BASIS)
+{
+  const uint8_t* pBytes = static_cast<const uint8_t*>(_data);
+  uint64_t       result = _seed;
+
+  for (size_t i=0; i<_size; ++i)
+  {
+    result ^= pBytes[i];
+    result *= FNV1A_PRIME;
+  }
+
+  return result;
+}
+
+template<typename T>
+inline uint64_t fnv1a(const T& _value, const uint64_t _seed = FNV1A_OFFSET_BASIS)
+{
+  return fnv1a(&_value, sizeof(T), _seed);
+}
+}
+#endif
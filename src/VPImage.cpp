@@ -1,32 +1,23 @@
 #include "VPImage.hpp"
+#include "Managers/VPUploadBatcher.hpp"
+#include "Managers/VPSamplerCache.hpp"
+#include "VPTextureFile.hpp"
 #include <cmath>
+#include <algorithm>
 
 namespace vpe
 {
-void createVkImage(const VkImageCreateInfo& _info, VkDeviceMemory& _imageMemory, VkImage* _pImage)
+void createVkImage(const VkImageCreateInfo& _info, MemoryAllocation& _imageMemory, VkImage* _pImage)
 {
-  MemoryBufferManager& bufferManager = MemoryBufferManager::getInstance();
-  const VkDevice&        logicalDevice = *bufferManager.m_pLogicalDevice;
+  const VkDevice& logicalDevice = *MemoryBufferManager::getInstance().m_pLogicalDevice;
 
   if (vkCreateImage(logicalDevice, &_info, nullptr, _pImage) != VK_SUCCESS)
     throw std::runtime_error("ERROR: createImage - Failed!");
 
-  // Allocate memory for the image
-  VkMemoryRequirements memoryReq;
-  vkGetImageMemoryRequirements(logicalDevice, *_pImage, &memoryReq);
-
-  const uint32_t memoryType = bufferManager.findMemoryType(memoryReq.memoryTypeBits,
-                                                           VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT);
-
-  VkMemoryAllocateInfo allocInfo{};
-  allocInfo.sType           = VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_INFO;
-  allocInfo.allocationSize  = memoryReq.size;
-  allocInfo.memoryTypeIndex = memoryType;
-
-  if (vkAllocateMemory(logicalDevice, &allocInfo, nullptr, &_imageMemory) != VK_SUCCESS)
-    throw std::runtime_error("ERROR: createImage - Failed to allocate image memory!");
-
-  vkBindImageMemory(logicalDevice, *_pImage, _imageMemory, 0);
+  // Sub-allocated from a shared block and bound
+  _imageMemory = MemoryAllocator::getInstance().allocateForImage(*_pImage,
+                                                                 VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT,
+                                                                 _info.tiling);
 }
 
 void createImageView(const VkImage&           _image,
@@ -58,16 +49,14 @@ void createImageView(const VkImage&           _image,
     throw std::runtime_error("ERROR: VPImage::createImageView - Failed!");
 }
 
-void Image::createImageSampler(const uint32_t _mipLevels, VkSampler* _pSampler)
+VkSampler Image::requestSampler()
 {
-  const VkDevice& logicalDevice = *MemoryBufferManager::getInstance().m_pLogicalDevice;
-
   VkSamplerCreateInfo samplerInfo{};
   samplerInfo.sType                   = VK_STRUCTURE_TYPE_SAMPLER_CREATE_INFO;
   samplerInfo.magFilter               = VK_FILTER_LINEAR; // Oversampling filter
   samplerInfo.minFilter               = VK_FILTER_LINEAR; // Undersampling filter
   samplerInfo.anisotropyEnable        = VK_TRUE;
-  samplerInfo.maxAnisotropy           = 16;
+  samplerInfo.maxAnisotropy           = 16; // Clamped to the device's limit
   samplerInfo.addressModeU            = VK_SAMPLER_ADDRESS_MODE_REPEAT;
   samplerInfo.addressModeV            = VK_SAMPLER_ADDRESS_MODE_REPEAT;
   samplerInfo.addressModeW            = VK_SAMPLER_ADDRESS_MODE_REPEAT;
@@ -78,13 +67,14 @@ void Image::createImageSampler(const uint32_t _mipLevels, VkSampler* _pSampler)
   samplerInfo.mipmapMode              = VK_SAMPLER_MIPMAP_MODE_LINEAR;
   samplerInfo.mipLodBias              = 0.0f;
   samplerInfo.minLod                  = 0.0f;
-  samplerInfo.maxLod                  = _mipLevels;
+  // The view already limits the mips, so images with different mip counts can share it
+  samplerInfo.maxLod                  = VK_LOD_CLAMP_NONE;
 
-  if (vkCreateSampler(logicalDevice, &samplerInfo, nullptr, _pSampler) != VK_SUCCESS)
-    throw std::runtime_error("ERROR: createTextureSampler - Failed!");
+  return SamplerCache::getInstance().get(samplerInfo);
 }
 
-void transitionLayout(const VkImage&       _image,
+void transitionLayout(VkCommandBuffer&     _commandBuffer,
+                      const VkImage&       _image,
                       const VkFormat       _format,
                       const VkImageLayout& _oldLayout,
                       const VkImageLayout& _newLayout,
@@ -92,7 +82,6 @@ void transitionLayout(const VkImage&       _image,
 {
   VkPipelineStageFlags srcStage;
   VkPipelineStageFlags dstStage;
-  VkCommandBuffer      commandBuffer = CommandBufferManager::getInstance().beginSingleTimeCommand();
 
   VkImageMemoryBarrier barrier{};
   barrier.sType                           = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER;
@@ -141,110 +130,210 @@ void transitionLayout(const VkImage&       _image,
     throw std::runtime_error("ERROR: transitionImageLayout - Unsopported transition!");
   }
 
-  vkCmdPipelineBarrier(commandBuffer,
+  vkCmdPipelineBarrier(_commandBuffer,
                        srcStage,
                        dstStage,
                        false, // Dependency per region
                        0, nullptr, // Memory barriers
                        0, nullptr, // Buffer memory barriers
                        1, &barrier); // Image memory barriers
-
-  CommandBufferManager::getInstance().endSingleTimeCommand(commandBuffer);
 }
 
 void Image::createFromFile(const char* _path)
 {
-  MemoryBufferManager& bufferManager = MemoryBufferManager::getInstance();
-  const VkDevice&      logicalDevice = *bufferManager.m_pLogicalDevice;
-  VkBuffer             stagingBuffer;
-  VkDeviceMemory       stagingMemory;
-
   auto imageData = resourcesLoader::loadImage(_path);
+  this->createFromData(imageData);
+}
+
+void Image::createFromData(resourcesLoader::ImageData& _imageData)
+{
+  m_mipLevels = _imageData.mipLevels;
 
-  bufferManager.createBuffer(imageData.size(),
-                             VK_IMAGE_USAGE_TRANSFER_SRC_BIT,
-                             VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT |
-                               VK_MEMORY_PROPERTY_HOST_COHERENT_BIT,
-                             &stagingBuffer,
-                             &stagingMemory);
+  if (_imageData.hasMipChain())
+  {
+    m_pStreamingSource.reset( new StreamingSource{std::move(_imageData.pFile),
+                                                  std::move(_imageData.mips),
+                                                  _imageData.format,
+                                                  _imageData.blockExtent,
+                                                  _imageData.blockSize} );
+    _imageData.pFile.reset();
+    _imageData.mips.clear();
+
+    // Only the low mips at first, the TextureStreamer brings in the rest once they're needed
+    this->createResidentLevels( this->getMinResidentMip() );
+
+    // Small enough to be whole from the start, so there's nothing to stream
+    if (m_residentMip == 0) m_pStreamingSource.reset();
+  }
+  else
+  {
+    VkImageCreateInfo imageInfo{};
+    imageInfo.sType         = VK_STRUCTURE_TYPE_IMAGE_CREATE_INFO;
+    imageInfo.imageType     = VK_IMAGE_TYPE_2D;
+    imageInfo.extent.width  = _imageData.width;
+    imageInfo.extent.height = _imageData.heigth;
+    imageInfo.extent.depth  = 1;
+    imageInfo.mipLevels     = _imageData.mipLevels;
+    imageInfo.arrayLayers   = 1;
+    imageInfo.format        = _imageData.format;
+    imageInfo.tiling        = VK_IMAGE_TILING_OPTIMAL; // Texels are laid out in optimal order
+    imageInfo.initialLayout = VK_IMAGE_LAYOUT_UNDEFINED;
+    // The mips are blitted from the previous level
+    imageInfo.usage         = VK_IMAGE_USAGE_TRANSFER_SRC_BIT |
+                              VK_IMAGE_USAGE_TRANSFER_DST_BIT |
+                              VK_IMAGE_USAGE_SAMPLED_BIT;
+    imageInfo.sharingMode   = VK_SHARING_MODE_EXCLUSIVE;
+    imageInfo.samples       = VK_SAMPLE_COUNT_1_BIT;
+    imageInfo.flags         = 0;
+
+    createVkImage(imageInfo, m_memory, &m_image);
+
+    auto& uploadBatcher = UploadBatcher::getInstance();
+
+    // Leaves it in TRANSFER_DST_OPTIMAL, owned by the graphics queue. The pixels are already in the
+    // staging ring once it returns.
+    uploadBatcher.stageImage(_imageData.pPixels,
+                             _imageData.size(),
+                             m_image,
+                             _imageData.width,
+                             _imageData.heigth,
+                             _imageData.mipLevels);
+
+    stbi_image_free(_imageData.pPixels);
+    _imageData.pPixels = nullptr;
+
+    // Implicitly transitioned into SHADER_READ_ONLY_OPTIMAL
+    generateMipMaps(uploadBatcher.getGraphicsCommand(),
+                    m_image,
+                    _imageData.format,
+                    _imageData.width,
+                    _imageData.heigth,
+                    _imageData.mipLevels);
+
+    createImageView(m_image,
+                    _imageData.format,
+                    VK_IMAGE_ASPECT_COLOR_BIT,
+                    _imageData.mipLevels,
+                    &m_imageView);
+  }
+
+  if (m_needsSampler) m_sampler = this->requestSampler();
+}
 
-  MemoryBufferManager::getInstance().copyToBufferMemory(imageData.pPixels,
-                                                        stagingMemory,
-                                                        imageData.size());
+void Image::createResidentLevels(const uint32_t _firstMip)
+{
+  const StreamingSource& source = *m_pStreamingSource;
 
-  stbi_image_free(imageData.pPixels);
+  // The same mips, renumbered from _firstMip
+  std::vector<VkBufferImageCopy> levels(source.mips.begin() + _firstMip, source.mips.end());
+  for (auto& level : levels) level.imageSubresource.mipLevel -= _firstMip;
 
   VkImageCreateInfo imageInfo{};
   imageInfo.sType         = VK_STRUCTURE_TYPE_IMAGE_CREATE_INFO;
   imageInfo.imageType     = VK_IMAGE_TYPE_2D;
-  imageInfo.extent.width  = imageData.width;
-  imageInfo.extent.height = imageData.heigth;
-  imageInfo.extent.depth  = 1;
-  imageInfo.mipLevels     = imageData.mipLevels;
+  imageInfo.extent        = levels.front().imageExtent;
+  imageInfo.mipLevels     = static_cast<uint32_t>(levels.size());
   imageInfo.arrayLayers   = 1;
-  imageInfo.format        = imageData.format;
-  imageInfo.tiling        = VK_IMAGE_TILING_OPTIMAL; // Texels are laid out in optimal order
+  imageInfo.format        = source.format;
+  imageInfo.tiling        = VK_IMAGE_TILING_OPTIMAL;
   imageInfo.initialLayout = VK_IMAGE_LAYOUT_UNDEFINED;
-  imageInfo.usage         = VK_IMAGE_USAGE_TRANSFER_SRC_BIT  |
-                             VK_IMAGE_USAGE_TRANSFER_DST_BIT |
-                             VK_IMAGE_USAGE_SAMPLED_BIT,
+  // Every level comes from the file, no blits
+  imageInfo.usage         = VK_IMAGE_USAGE_TRANSFER_DST_BIT |
+                            VK_IMAGE_USAGE_SAMPLED_BIT;
   imageInfo.sharingMode   = VK_SHARING_MODE_EXCLUSIVE;
   imageInfo.samples       = VK_SAMPLE_COUNT_1_BIT;
   imageInfo.flags         = 0;
 
   createVkImage(imageInfo, m_memory, &m_image);
 
-  transitionLayout(m_image,
-                   imageData.format,
-                   VK_IMAGE_LAYOUT_UNDEFINED,
-                   VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL,
-                   imageData.mipLevels);
-
-  copyBufferToImage(stagingBuffer, &m_image, imageData.width, imageData.heigth);
+  auto& uploadBatcher = UploadBatcher::getInstance();
 
-  vkDestroyBuffer(logicalDevice, stagingBuffer, nullptr);
-  vkFreeMemory(logicalDevice, stagingMemory, nullptr);
+  // Every level at once. Copied into the staging ring before it returns.
+  uploadBatcher.stageImageLevels(source.pFile->data(),
+                                 m_image,
+                                 levels,
+                                 source.blockExtent,
+                                 source.blockSize);
 
-  // Implicitly transitioned into SHADER_READ_ONLY_OPTIMAL
-  generateMipMaps(m_image, imageData.format, imageData.width, imageData.heigth, imageData.mipLevels);
+  transitionLayout(uploadBatcher.getGraphicsCommand(),
+                   m_image,
+                   source.format,
+                   VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL,
+                   VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL,
+                   imageInfo.mipLevels);
 
   createImageView(m_image,
-                  imageData.format,
+                  source.format,
                   VK_IMAGE_ASPECT_COLOR_BIT,
-                  imageData.mipLevels,
+                  imageInfo.mipLevels,
                   &m_imageView);
 
-  if (m_needsSampler) createImageSampler(imageData.mipLevels, &m_sampler);
+  m_residentMip = _firstMip;
+}
+
+uint32_t Image::getMinResidentMip() const
+{
+  if (m_pStreamingSource == nullptr) return 0;
+
+  const auto& mips = m_pStreamingSource->mips;
+
+  uint32_t result = 0;
+  while (result + 1 < mips.size() &&
+         std::max(mips[result].imageExtent.width, mips[result].imageExtent.height) > STREAMING_MIN_RESIDENT_EXTENT)
+  {
+    ++result;
+  }
+
+  return result;
+}
+
+uint32_t Image::getMipForFootprint(const float _pixels) const
+{
+  if (m_pStreamingSource == nullptr) return 0;
+
+  const VkExtent3D& extent = m_pStreamingSource->mips.front().imageExtent;
+  const float       texels = static_cast<float>( std::max(extent.width, extent.height) );
+
+  // About a texel per pixel. Any more detail would just be filtered away.
+  const float mip = std::floor( std::log2(texels / std::max(_pixels, 1.0f)) );
+
+  return std::min(static_cast<uint32_t>( std::max(mip, 0.0f) ), this->getMinResidentMip());
+}
+
+VkDeviceSize Image::getLevelsSize(const uint32_t _firstMip) const
+{
+  if (m_pStreamingSource == nullptr) return 0;
+
+  const StreamingSource&        source = *m_pStreamingSource;
+  const textureFile::BlockInfo block{source.blockExtent, source.blockSize};
+
+  VkDeviceSize result = 0;
+  for (size_t m=_firstMip; m<source.mips.size(); ++m)
+    result += textureFile::getLevelSize(block, source.mips[m].imageExtent.width, source.mips[m].imageExtent.height);
+
+  return result;
 }
 
-void Image::copyBufferToImage(const VkBuffer& _buffer,       VkImage* _pImage,
-                              const uint32_t  _width,  const uint32_t _height)
+std::unique_ptr<Image> Image::changeResidentMip(const uint32_t _mip)
 {
-  VkCommandBuffer commandBuffer = CommandBufferManager::getInstance().beginSingleTimeCommand();
-
-  VkBufferImageCopy region{};
-  region.bufferOffset                    = 0; // Buffer index with the 1st pixel value
-  region.bufferRowLength                 = 0; // Padding
-  region.bufferImageHeight               = 0; // Padding
-  region.imageSubresource.aspectMask     = VK_IMAGE_ASPECT_COLOR_BIT;
-  region.imageSubresource.mipLevel       = 0;
-  region.imageSubresource.baseArrayLayer = 0;
-  region.imageSubresource.layerCount     = 1;
-  // Part of the image to copy
-  region.imageOffset                     = {0, 0, 0};
-  region.imageExtent                     = {_width, _height, 1};
-
-  vkCmdCopyBufferToImage(commandBuffer,
-                         _buffer,
-                         *_pImage,
-                         VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, // Actually, the layout currently using
-                         1,
-                         &region);
-
-  CommandBufferManager::getInstance().endSingleTimeCommand(commandBuffer);
+  if (m_pStreamingSource == nullptr)
+    throw std::runtime_error("ERROR: Image::changeResidentMip - The image isn't streamed!");
+
+  // The shared sampler stays, only the image, its memory and its view are replaced
+  std::unique_ptr<Image> pOld(new Image(false));
+  std::swap(m_image,     pOld->m_image);
+  std::swap(m_memory,    pOld->m_memory);
+  std::swap(m_imageView, pOld->m_imageView);
+
+  // Re-read from the file even the mips that were already in memory. Copying them from the old image
+  // would need it in TRANSFER_SRC_OPTIMAL while the frames in flight still sample it.
+  this->createResidentLevels( std::min(_mip, this->getMinResidentMip()) );
+
+  return pOld;
 }
 
-void Image::generateMipMaps(VkImage&       _image,
+void Image::generateMipMaps(VkCommandBuffer& _commandBuffer,
+                            VkImage&       _image,
                             const VkFormat _format,
                             int            _width,
                             int            _height,
@@ -258,8 +347,6 @@ void Image::generateMipMaps(VkImage&       _image,
   if (!(formatProperties.optimalTilingFeatures & VK_FORMAT_FEATURE_SAMPLED_IMAGE_FILTER_LINEAR_BIT))
     throw std::runtime_error("ERROR: generateMipMaps - Texture image format doesn't support linear blitting!");
 
-  VkCommandBuffer commandBuffer = CommandBufferManager::getInstance().beginSingleTimeCommand();
-
   VkImageMemoryBarrier barrier{};
   barrier.sType                           = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER;
   barrier.image                           = _image;
@@ -278,7 +365,7 @@ void Image::generateMipMaps(VkImage&       _image,
     barrier.srcAccessMask                 = VK_ACCESS_TRANSFER_WRITE_BIT;
     barrier.dstAccessMask                 = VK_ACCESS_TRANSFER_READ_BIT;
 
-    vkCmdPipelineBarrier(commandBuffer,
+    vkCmdPipelineBarrier(_commandBuffer,
                          VK_PIPELINE_STAGE_TRANSFER_BIT,
                          VK_PIPELINE_STAGE_TRANSFER_BIT,
                          0,
@@ -304,7 +391,7 @@ void Image::generateMipMaps(VkImage&       _image,
     blit.dstSubresource.baseArrayLayer = 0;
     blit.dstSubresource.layerCount     = 1;
 
-    vkCmdBlitImage(commandBuffer,
+    vkCmdBlitImage(_commandBuffer,
                    _image, VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL,
                    _image, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL,
                    1,
@@ -316,7 +403,7 @@ void Image::generateMipMaps(VkImage&       _image,
     barrier.srcAccessMask = VK_ACCESS_TRANSFER_READ_BIT;
     barrier.dstAccessMask = VK_ACCESS_SHADER_READ_BIT;
 
-    vkCmdPipelineBarrier(commandBuffer,
+    vkCmdPipelineBarrier(_commandBuffer,
                          VK_PIPELINE_STAGE_TRANSFER_BIT,
                          VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT,
                          0,
@@ -334,14 +421,12 @@ void Image::generateMipMaps(VkImage&       _image,
   barrier.srcAccessMask                 = VK_ACCESS_TRANSFER_WRITE_BIT;
   barrier.dstAccessMask                 = VK_ACCESS_SHADER_READ_BIT;
 
-  vkCmdPipelineBarrier(commandBuffer,
+  vkCmdPipelineBarrier(_commandBuffer,
                        VK_PIPELINE_STAGE_TRANSFER_BIT,
                        VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT,
                        0,
                        0, nullptr,
                        0, nullptr,
                        1, &barrier);
-
-  CommandBufferManager::getInstance().endSingleTimeCommand(commandBuffer);
 }
 }
\ No newline at end of file
@@ -4,13 +4,17 @@
 #include <vulkan/vulkan.h>
 
 #include <cstring>
+#include <memory>
 
 #include "Managers/VPMemoryBufferManager.hpp"
 #include "VPResourcesLoader.hpp"
 
 namespace vpe
 {
-void createVkImage(const VkImageCreateInfo& _info, VkDeviceMemory& _imageMemory, VkImage* _pImage);
+// The streamed images start with the mips up to this size, and never drop below them
+constexpr uint32_t STREAMING_MIN_RESIDENT_EXTENT = 64;
+
+void createVkImage(const VkImageCreateInfo& _info, MemoryAllocation& _imageMemory, VkImage* _pImage);
 
 void createImageView(const VkImage&           _image,
                      const VkFormat&          _format,
@@ -18,12 +22,24 @@ void createImageView(const VkImage&           _image,
                      const uint32_t           _mipLevels,
                      VkImageView*             _pImageView);
 
-void transitionLayout(const VkImage&       _image,
+// Only records the barrier. Use UploadBatcher::getGraphicsCommand() to batch it with the uploads.
+void transitionLayout(VkCommandBuffer&     _commandBuffer,
+                      const VkImage&       _image,
                       const VkFormat       _format,
                       const VkImageLayout& _oldLayout,
                       const VkImageLayout& _newLayout,
                       const uint32_t       _mipLevels=1);
 
+// Where the streamed images' mips come from. The file stays mapped while the image is alive.
+struct StreamingSource
+{
+  std::shared_ptr<MappedFile>    pFile;
+  std::vector<VkBufferImageCopy> mips; // Every level, bufferOffset is relative to the start of the file
+  VkFormat                       format;
+  uint32_t                       blockExtent;
+  uint32_t                       blockSize;
+};
+
 class Image
 {
 public:
@@ -31,61 +47,103 @@ public:
   Image() :
     m_needsSampler(true),
     m_image(VK_NULL_HANDLE),
-    m_memory(VK_NULL_HANDLE),
+    m_memory(),
     m_imageView(VK_NULL_HANDLE),
-    m_sampler(VK_NULL_HANDLE)
+    m_sampler(VK_NULL_HANDLE),
+    m_mipLevels(1),
+    m_residentMip(0)
   {}
 
   Image(bool _needsSampler) :
     m_needsSampler(_needsSampler),
     m_image(VK_NULL_HANDLE),
-    m_memory(VK_NULL_HANDLE),
+    m_memory(),
     m_imageView(VK_NULL_HANDLE),
-    m_sampler(VK_NULL_HANDLE)
+    m_sampler(VK_NULL_HANDLE),
+    m_mipLevels(1),
+    m_residentMip(0)
   {}
 
   Image(const char* _path) :
     m_needsSampler(true),
     m_image(VK_NULL_HANDLE),
-    m_memory(VK_NULL_HANDLE),
+    m_memory(),
     m_imageView(VK_NULL_HANDLE),
-    m_sampler(VK_NULL_HANDLE)
+    m_sampler(VK_NULL_HANDLE),
+    m_mipLevels(1),
+    m_residentMip(0)
   {
     this->createFromFile(_path);
   }
 
+  // Takes the pixels, which are freed once they're staged
+  Image(resourcesLoader::ImageData& _data) :
+    m_needsSampler(true),
+    m_image(VK_NULL_HANDLE),
+    m_memory(),
+    m_imageView(VK_NULL_HANDLE),
+    m_sampler(VK_NULL_HANDLE),
+    m_mipLevels(1),
+    m_residentMip(0)
+  {
+    this->createFromData(_data);
+  }
+
   ~Image() { cleanUp(); }
 
   void createFromFile(const char* _path);
+  void createFromData(resourcesLoader::ImageData& _imageData);
 
   inline VkImageView& getImageView() { return m_imageView; }
-  inline VkSampler&   getSampler()   { return m_sampler; }
+  inline VkSampler    getSampler()   { return m_sampler; } // Owned by the SamplerCache
+
+  // Only the images with a precomputed mip chain (.vptex) bigger than STREAMING_MIN_RESIDENT_EXTENT
+  inline bool     isStreamed()     const { return m_pStreamingSource != nullptr; }
+  inline uint32_t getMipLevels()   const { return m_mipLevels; }
+  inline uint32_t getResidentMip() const { return m_residentMip; } // The most detailed one in memory
+
+  // The least detailed the image can get, the mips up to STREAMING_MIN_RESIDENT_EXTENT are always in memory
+  uint32_t getMinResidentMip() const;
+
+  // The most detailed mip worth having for an image covering _pixels on screen. Never above getMinResidentMip.
+  uint32_t getMipForFootprint(const float _pixels) const;
+
+  // Of the mips from _firstMip to the last one, as stored in the file
+  VkDeviceSize getLevelsSize(const uint32_t _firstMip) const;
+
+  // Streamed images only. Creates a new image holding the mips from _mip on, read from the file, and records
+  // its upload. The old image and view are moved into the result, which must outlive the frames using them.
+  std::unique_ptr<Image> changeResidentMip(const uint32_t _mip);
 
   inline void cleanUp()
   {
     const VkDevice& logicalDevice = *MemoryBufferManager::getInstance().m_pLogicalDevice;
 
-    vkDestroySampler(logicalDevice, m_sampler, nullptr);
-
     vkDestroyImageView(logicalDevice, m_imageView, nullptr);
     vkDestroyImage(logicalDevice, m_image, nullptr);
-    vkFreeMemory(logicalDevice, m_memory, nullptr);
+    MemoryAllocator::getInstance().free(m_memory);
   }
 
 private:
 
-  bool           m_needsSampler; // In cases like depth images, we don't need a sampler
-  VkImage        m_image;
-  VkDeviceMemory m_memory;
-  VkImageView    m_imageView;
-  VkSampler      m_sampler;
+  bool             m_needsSampler; // In cases like depth images, we don't need a sampler
+  VkImage          m_image;
+  MemoryAllocation m_memory;
+  VkImageView      m_imageView;
+  VkSampler        m_sampler; // Shared, see SamplerCache
+  uint32_t         m_mipLevels;   // Of the whole chain, even the mips that aren't in memory
+  uint32_t         m_residentMip; // Mip 0 of m_image. Only above 0 for the streamed images.
+
+  std::unique_ptr<StreamingSource> m_pStreamingSource; // nullptr unless it's streamed
 
-  void createImageSampler(const uint32_t _mipLevels, VkSampler* _pSampler);
+  VkSampler requestSampler();
 
-  void copyBufferToImage(const VkBuffer& _buffer,       VkImage* _pImage,
-                         const uint32_t  _width,  const uint32_t height);
+  // From m_pStreamingSource, every mip from _firstMip on. Creates m_image, m_memory and m_imageView.
+  void createResidentLevels(const uint32_t _firstMip);
 
-  void generateMipMaps(VkImage&       _image,
+  // Recorded into _commandBuffer, which has to run on a graphics queue
+  void generateMipMaps(VkCommandBuffer& _commandBuffer,
+                       VkImage&       _image,
                        const VkFormat _format,
                        int            _width,
                        int            _height,
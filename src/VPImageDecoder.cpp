@@ -0,0 +1,51 @@
+#include "VPImageDecoder.hpp"
+
+namespace vpe
+{
+std::future<resourcesLoader::ImageData> ImageDecoder::request(const std::string& _path)
+{
+  return m_threadPool.submit([this, _path]() { return this->decode(_path); });
+}
+
+resourcesLoader::ImageData ImageDecoder::decode(const std::string& _path)
+{
+  // Only reads the header, so the memory can be reserved before allocating it
+  int width    = 0;
+  int height   = 0;
+  int channels = 0;
+  size_t reserved = 0;
+  if (stbi_info(_path.c_str(), &width, &height, &channels))
+    reserved = static_cast<size_t>(width) * height * STBI_rgb_alpha; // Always expanded to RGBA
+
+  {
+    std::unique_lock<std::mutex> lock(m_mutex);
+    m_budgetCondition.wait(lock, [this, reserved]()
+    {
+      return m_isStopping || m_bytesInFlight == 0 || m_bytesInFlight + reserved <= m_memoryBudget;
+    });
+    m_bytesInFlight += reserved;
+  }
+
+  auto result = resourcesLoader::loadImage(_path.c_str());
+
+  // The built-in images (and the failed ones) don't match what was reserved
+  const size_t actual = static_cast<size_t>(result.size());
+  if (actual != reserved)
+  {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    m_bytesInFlight = m_bytesInFlight + actual - reserved;
+  }
+  if (actual < reserved) m_budgetCondition.notify_all();
+
+  return result;
+}
+
+void ImageDecoder::release(resourcesLoader::ImageData& _image)
+{
+  {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    m_bytesInFlight -= std::min(m_bytesInFlight, static_cast<size_t>(_image.size()));
+  }
+  m_budgetCondition.notify_all();
+}
+}
@@ -0,0 +1,70 @@
+#ifndef VP_IMAGE_DECODER_HPP
+#define VP_IMAGE_DECODER_HPP
+
+#include <string>
+#include <future>
+#include <mutex>
+#include <condition_variable>
+
+#include "VPThreadPool.hpp"
+#include "VPResourcesLoader.hpp"
+
+namespace vpe
+{
+// Decoded pixels waiting for their upload at the same time
+constexpr size_t DEFAULT_DECODE_MEMORY_BUDGET = 256 * 1024 * 1024; // 256MiB
+
+// Decodes images on its own threads. The consumer uploads them and gives the memory back with release(),
+// and the decoders wait before starting a new image while the budget is used up.
+// The only exception is an image that doesn't fit even with nothing in flight, it's decoded anyway.
+class ImageDecoder
+{
+public:
+  ImageDecoder(ImageDecoder const&)   = delete;
+  void operator=(ImageDecoder const&) = delete;
+
+  explicit ImageDecoder(const size_t _threadCount  = ThreadPool::getDefaultThreadCount(),
+                        const size_t _memoryBudget = DEFAULT_DECODE_MEMORY_BUDGET) :
+    m_memoryBudget(_memoryBudget),
+    m_bytesInFlight(0),
+    m_isStopping(false),
+    m_threadPool(_threadCount)
+  {}
+
+  // The pending decodes still run, but without waiting for budget nobody is going to give back
+  ~ImageDecoder()
+  {
+    {
+      std::lock_guard<std::mutex> lock(m_mutex);
+      m_isStopping = true;
+    }
+    m_budgetCondition.notify_all();
+  }
+
+  // The image's pixels must be freed (stbi_image_free) and release() called once they're uploaded
+  std::future<resourcesLoader::ImageData> request(const std::string& _path);
+
+  void release(resourcesLoader::ImageData& _image);
+
+  inline size_t getBytesInFlight()
+  {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    return m_bytesInFlight;
+  }
+
+  inline size_t getThreadCount() const { return m_threadPool.getThreadCount(); }
+
+private:
+  const size_t            m_memoryBudget;
+  size_t                  m_bytesInFlight;
+  bool                    m_isStopping;
+  std::mutex              m_mutex;
+  std::condition_variable m_budgetCondition;
+
+  // Last, so its threads are joined before the rest is destroyed
+  ThreadPool m_threadPool;
+
+  resourcesLoader::ImageData decode(const std::string& _path);
+};
+}
+#endif
@@ -0,0 +1,48 @@
+#ifndef VP_LOD_HPP
+#define VP_LOD_HPP
+
+#include <cstdint>
+#include <cmath>
+#include <algorithm>
+
+namespace vpe
+{
+// LOD 0 is the original mesh, each next one has at most LOD_TRIANGLE_RATIO of the previous' triangles
+constexpr uint32_t MAX_LOD_COUNT      = 4;
+constexpr float    LOD_TRIANGLE_RATIO = 0.5f;
+// A LOD that can't get down to this fraction of the previous one (the error limit stopped it first) would be
+// nearly identical to it. Ends the chain, so every LOD really has at most half the previous' triangles.
+constexpr float    LOD_MIN_REDUCTION  = LOD_TRIANGLE_RATIO;
+// Biggest deviation a LOD can introduce, relative to the mesh's bounding sphere radius
+constexpr float    LOD_MAX_ERROR      = 0.05f;
+// Projected size (bounding sphere diameter / screen height) below which each LOD > 0 is used.
+// Halving the size quarters the pixels, so halving the triangles keeps the density in check.
+constexpr float    LOD_SCREEN_SIZES[MAX_LOD_COUNT - 1] = {0.5f, 0.25f, 0.125f};
+
+// Range of the mesh's index buffer drawn for a LOD. All of them share the vertex buffer.
+struct LodRange
+{
+  uint32_t firstIndex = 0;
+  uint32_t indexCount = 0;
+  float    error      = 0.0f; // Relative to the bounding sphere radius, see LOD_MAX_ERROR
+  uint32_t padding    = 0;
+};
+
+// Fraction of the screen's height covered by a sphere. Good enough away from the screen's edges.
+inline float getProjectedSize(const float _radius, const float _distance, const float _fieldOfView)
+{
+  // The camera is inside the sphere
+  if (_distance <= _radius) return 1.0f;
+
+  return _radius / (_distance * std::tan(0.5f * _fieldOfView));
+}
+
+inline uint32_t selectLod(const float _projectedSize, const uint32_t _lodCount)
+{
+  uint32_t lod = 0;
+  while (lod + 1 < std::min(_lodCount, MAX_LOD_COUNT) && _projectedSize < LOD_SCREEN_SIZES[lod]) ++lod;
+
+  return lod;
+}
+} // namespace vpe
+#endif
@@ -0,0 +1,81 @@
+#ifndef VP_MAPPED_FILE_HPP
+#define VP_MAPPED_FILE_HPP
+
+#include <cstddef>
+#include <vector>
+#include <fstream>
+
+#ifndef _WIN32
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+#endif
+
+namespace vpe
+{
+// Read only view of a whole file. Memory mapped where available, otherwise read into memory.
+class MappedFile
+{
+public:
+  MappedFile() = delete;
+  MappedFile(MappedFile const&)     = delete;
+  void operator=(MappedFile const&) = delete;
+
+  explicit MappedFile(const char* _path) : m_pData(nullptr), m_size(0)
+  {
+#ifndef _WIN32
+    const int fd = open(_path, O_RDONLY);
+    if (fd < 0) return;
+
+    struct stat fileStats{};
+    if (fstat(fd, &fileStats) == 0 && fileStats.st_size > 0)
+    {
+      void* pMapped = mmap(nullptr, fileStats.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+      if (pMapped != MAP_FAILED)
+      {
+        m_pData = pMapped;
+        m_size  = fileStats.st_size;
+      }
+    }
+
+    // The mapping keeps its own reference to the file
+    close(fd);
+#else
+    std::ifstream file(_path, std::ios::ate | std::ios::binary);
+    if (!file.is_open()) return;
+
+    m_fallback.resize( static_cast<size_t>(file.tellg()) );
+    file.seekg(0);
+    file.read(m_fallback.data(), m_fallback.size());
+
+    m_pData = m_fallback.data();
+    m_size  = m_fallback.size();
+#endif
+  }
+
+  ~MappedFile()
+  {
+#ifndef _WIN32
+    if (m_pData != nullptr) munmap(m_pData, m_size);
+#endif
+  }
+
+  inline bool   isValid() const { return m_pData != nullptr; }
+  inline size_t size()    const { return m_size; }
+
+  template<typename T = char>
+  inline const T* data(const size_t _offset = 0) const
+  {
+    return reinterpret_cast<const T*>( static_cast<const char*>(m_pData) + _offset );
+  }
+
+private:
+  void*  m_pData;
+  size_t m_size;
+#ifdef _WIN32
+  std::vector<char> m_fallback;
+#endif
+};
+}
+#endif
@@ -8,7 +8,10 @@
 #include <memory>
 
 #include "VPImage.hpp"
+#include "VPTextureRegistry.hpp"
 #include "VPResourcesLoader.hpp"
+#include "VPHash.hpp"
+#include "Managers/VPShaderRegistry.hpp"
 
 namespace vpe
 {
@@ -19,15 +22,42 @@ struct StdMaterial
   StdMaterial() = delete;
 
   StdMaterial(const char* _vert, const char* _frag) :
+    id(nextId()),
     pTexture(nullptr),
-    pNormalMap(nullptr)
+    pNormalMap(nullptr),
+    pVertShader(nullptr),
+    pFragShader(nullptr),
+    pInstancedVertShader(nullptr),
+    vertexFormat(VertexFormat::FULL)
   {
-    vertShaderCode = resourcesLoader::parseShaderFile(_vert);
-    fragShaderCode = resourcesLoader::parseShaderFile(_frag);
+    auto& shaderRegistry = ShaderRegistry::getInstance();
+
+    const bool isDefaultVert = std::string(_vert) == DEFAULT_VERT;
+
+    // Only the default vertex shader has packed and instanced variants
+    if (isDefaultVert && resourcesLoader::getDefaultVertexFormat() == VertexFormat::PACKED)
+    {
+      vertexFormat         = VertexFormat::PACKED;
+      pVertShader          = &shaderRegistry.load(DEFAULT_VERT_PACKED);
+      pInstancedVertShader = shaderRegistry.tryLoad(DEFAULT_VERT_PACKED_INSTANCED);
+    }
+    else
+    {
+      pVertShader          = &shaderRegistry.load(_vert);
+      pInstancedVertShader = isDefaultVert ? shaderRegistry.tryLoad(DEFAULT_VERT_INSTANCED) : nullptr;
+    }
+    pFragShader = &shaderRegistry.load(_frag);
+
     changeTexture(DEFAULT_TEX);
     changeNormalMap(EMPTY_TEX);
 
-    hash = hashFn( {_vert, _frag, std::to_string(IMAGES_PER_MATERIAL).c_str()} );
+    // By contents, so materials with the same shaders under different paths share the pipelines.
+    // The instanced variant follows from the vertex shader.
+    uint64_t contentHash = fnv1a(pVertShader->hash);
+    contentHash          = fnv1a(pFragShader->hash, contentHash);
+    contentHash          = fnv1a(IMAGES_PER_MATERIAL, contentHash);
+    contentHash          = fnv1a(vertexFormat, contentHash);
+    hash                 = static_cast<size_t>(contentHash);
   };
 
   ~StdMaterial()
@@ -36,25 +66,34 @@ struct StdMaterial
     pNormalMap.reset();
   }
 
-  std::unique_ptr<Image> pTexture;
-  std::unique_ptr<Image> pNormalMap;
+  uint32_t id; // Unique per material, unlike the hash
+
+  // Shared with every other material using the same image, see TextureRegistry
+  std::shared_ptr<Image> pTexture;
+  std::shared_ptr<Image> pNormalMap;
   size_t hash;
 
-  std::vector<char> vertShaderCode;
-  std::vector<char> fragShaderCode;
+  // Owned by the ShaderRegistry
+  const Shader* pVertShader;
+  const Shader* pFragShader;
+  const Shader* pInstancedVertShader; // nullptr if there's no instanced variant
 
-  static inline size_t hashFn(const std::vector<const char*>& _input)
-  {
-    std::hash<std::string> stringHash;
+  VertexFormat vertexFormat; // The only one its vertex shader can read
 
-    std::string id;
-    for (auto& c : _input) id += c;
+  inline bool supportsInstancing() const { return pInstancedVertShader != nullptr; }
 
-    return stringHash(id);
+  static inline uint32_t nextId()
+  {
+    static uint32_t counter = 0;
+    return counter++;
   }
 
-  inline void changeTexture(const char* _path) { pTexture.reset( new Image(_path) ); }
-  inline void changeNormalMap(const char* _path) { pNormalMap.reset( new Image(_path) ); }
+  inline void changeTexture(const char* _path)   { pTexture   = TextureRegistry::getInstance().load(_path); }
+  inline void changeNormalMap(const char* _path) { pNormalMap = TextureRegistry::getInstance().load(_path); }
+
+  // For images decoded somewhere else, already in the TextureRegistry
+  inline void changeTexture(const std::shared_ptr<Image>& _pImage)   { pTexture   = _pImage; }
+  inline void changeNormalMap(const std::shared_ptr<Image>& _pImage) { pNormalMap = _pImage; }
 };
 }
 #endif
\ No newline at end of file
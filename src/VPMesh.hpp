@@ -11,30 +11,50 @@ namespace vpe
 struct Mesh
 {
   Mesh() = delete;
-  Mesh(const char* _path) : m_isValid(true)
+  Mesh(const char* _path) : Mesh( resourcesLoader::loadModel(_path) ) {}
+
+  // Only uploads. The import (the slow part) can happen somewhere else, like a loading thread.
+  Mesh(resourcesLoader::ModelData&& _modelData) : m_isValid(true), m_id(nextId())
   {
     auto& bufferManager = MemoryBufferManager::getInstance();
 
-    std::tie(m_vertices, m_indices) = resourcesLoader::loadModel(_path);
+    m_vertexFormat = _modelData.vertexFormat;
+    m_indexType    = _modelData.indexType;
+    m_vertexCount  = _modelData.getVertexCount();
+    m_indexCount   = _modelData.getIndexCount();
+    m_bounds       = _modelData.bounds;
+    m_lods         = _modelData.lods;
+
+    // Models imported without LODs draw everything as LOD 0
+    if (m_lods.empty()) m_lods.push_back({0, m_indexCount, 0.0f, 0});
+
+    // Maps the quantized [0,1] positions back to object space
+    const auto& quantization = _modelData.quantization;
+    m_dequantization       = glm::mat4(1.0f);
+    m_dequantization[0][0] = quantization.scale.x;
+    m_dequantization[1][1] = quantization.scale.y;
+    m_dequantization[2][2] = quantization.scale.z;
+    m_dequantization[3]    = glm::vec4(quantization.offset, 1.0f);
 
-    if (m_vertices.empty() || m_indices.empty())
+    if (m_vertexCount == 0 || m_indexCount == 0)
     {
       m_isValid = false;
       std::cout << "ERROR: Mesh::Mesh - Failed loading of model." << std::endl;
       return;
     }
 
+    // Cached meshes are staged straight from the mapped file
     bufferManager.fillBuffer(&m_vertexBuffer,
-                             m_vertices.data(),
+                             _modelData.getVertices(),
                              m_vertexBufferMemory,
-                             sizeof(m_vertices[0]) * m_vertices.size(),
+                             _modelData.getVerticesSize(),
                              VK_BUFFER_USAGE_TRANSFER_DST_BIT | VK_BUFFER_USAGE_VERTEX_BUFFER_BIT,
                              VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT);
 
     bufferManager.fillBuffer(&m_indexBuffer,
-                             m_indices.data(),
+                             _modelData.getIndices(),
                              m_indexBufferMemory,
-                             sizeof(m_indices[0]) * m_indices.size(),
+                             _modelData.getIndicesSize(),
                              VK_BUFFER_USAGE_TRANSFER_DST_BIT | VK_BUFFER_USAGE_INDEX_BUFFER_BIT,
                              VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT);
   }
@@ -43,25 +63,40 @@ struct Mesh
   {
     if (!m_isValid) return;
 
-    const VkDevice& logicalDevice = *MemoryBufferManager::getInstance().m_pLogicalDevice;
+    auto& bufferManager = MemoryBufferManager::getInstance();
+
+    bufferManager.destroyBuffer(m_indexBuffer, m_indexBufferMemory);
+    bufferManager.destroyBuffer(m_vertexBuffer, m_vertexBufferMemory);
+  }
+
+  bool     m_isValid;
+  uint32_t m_id; // Used to sort the draws
 
-    vkDestroyBuffer(logicalDevice, m_indexBuffer, nullptr);
-    vkDestroyBuffer(logicalDevice, m_vertexBuffer, nullptr);
-    vkFreeMemory(logicalDevice, m_vertexBufferMemory, nullptr);
-    vkFreeMemory(logicalDevice, m_indexBufferMemory, nullptr);
+  inline const LodRange& getLod(const uint32_t _lod) const
+  {
+    return m_lods.at( std::min<size_t>(_lod, m_lods.size() - 1) );
   }
 
-  bool m_isValid;
+  static inline uint32_t nextId()
+  {
+    static uint32_t counter = 0;
+    return counter++;
+  }
 
-  // Raw data
-  std::vector<uint32_t> m_indices;
-  std::vector<Vertex>   m_vertices;
+  // The data itself only lives in the GPU
+  VertexFormat m_vertexFormat;
+  VkIndexType  m_indexType;
+  uint32_t     m_vertexCount;
+  uint32_t     m_indexCount;
+  Bounds       m_bounds;         // Object space
+  std::vector<LodRange> m_lods;  // Index ranges, LOD 0 first. Never empty.
+  glm::mat4    m_dequantization; // Identity unless the format is PACKED. Baked into the modelView.
 
   // Buffers and memory
-  VkBuffer       m_vertexBuffer;
-  VkBuffer       m_indexBuffer;
-  VkDeviceMemory m_vertexBufferMemory;
-  VkDeviceMemory m_indexBufferMemory;
+  VkBuffer         m_vertexBuffer;
+  VkBuffer         m_indexBuffer;
+  MemoryAllocation m_vertexBufferMemory;
+  MemoryAllocation m_indexBufferMemory;
 };
 }
 #endif
\ No newline at end of file
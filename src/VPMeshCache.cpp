@@ -0,0 +1,143 @@
+#include "VPMeshCache.hpp"
+
+#include <iostream>
+#include <fstream>
+#include <filesystem>
+#include <cstdio>
+#include <algorithm>
+
+namespace vpe::meshCache
+{
+  namespace
+  {
+    constexpr uint64_t BLOB_ALIGNMENT = 16;
+
+    inline uint64_t alignUp(const uint64_t _value)
+    {
+      return (_value + BLOB_ALIGNMENT - 1) / BLOB_ALIGNMENT * BLOB_ALIGNMENT;
+    }
+  }
+
+  std::string getPath(const char* _sourcePath, const VertexFormat _format)
+  {
+    const std::string source(_sourcePath);
+    const std::string stem = std::filesystem::path(source).stem().string();
+
+    // Models with the same name in different folders don't collide
+    char pathHash[17];
+    snprintf(pathHash, sizeof(pathHash), "%016llx",
+             static_cast<unsigned long long>( fnv1a(source.data(), source.size()) ));
+
+    const char* formatSuffix = _format == VertexFormat::PACKED ? "_packed" : "";
+
+    return std::string(MESH_CACHE_DIR) + stem + "_" + pathHash + formatSuffix + ".vpmesh";
+  }
+
+  bool load(const std::string& _path, const uint64_t _key, resourcesLoader::ModelData& _result)
+  {
+    auto pFile = std::make_shared<MappedFile>( _path.c_str() );
+    if (!pFile->isValid() || pFile->size() < sizeof(Header)) return false;
+
+    Header header;
+    memcpy(&header, pFile->data(), sizeof(Header));
+
+    const auto format = static_cast<VertexFormat>(header.vertexFormat);
+
+    if (header.magic        != MESH_CACHE_MAGIC         ||
+        header.version      != MESH_CACHE_VERSION       ||
+        header.key          != _key                     ||
+        header.vertexStride != getVertexStride(format)  ||
+        (header.indexSize   != sizeof(uint16_t) && header.indexSize != sizeof(uint32_t)))
+    {
+      return false;
+    }
+
+    const uint64_t vertexBytes = uint64_t(header.vertexCount) * header.vertexStride;
+    const uint64_t indexBytes  = uint64_t(header.indexCount)  * header.indexSize;
+
+    if (header.vertexOffset + vertexBytes > pFile->size() ||
+        header.indexOffset  + indexBytes  > pFile->size())
+    {
+      std::cout << "WARNING: meshCache::load - " << _path << " is truncated. Ignoring it." << std::endl;
+      return false;
+    }
+
+    if (header.lodCount == 0 || header.lodCount > MAX_LOD_COUNT) return false;
+
+    _result = resourcesLoader::ModelData{};
+    _result.vertexFormat    = format;
+    _result.indexType       = header.indexSize == sizeof(uint16_t) ? VK_INDEX_TYPE_UINT16 : VK_INDEX_TYPE_UINT32;
+    _result.quantization    = header.quantization;
+    _result.bounds          = header.bounds;
+    _result.vertexCount     = header.vertexCount;
+    _result.indexCount      = header.indexCount;
+    _result.lods.assign(header.lods, header.lods + header.lodCount);
+    _result.pCachedVertices = pFile->data<char>(header.vertexOffset);
+    _result.pCachedIndices  = pFile->data<char>(header.indexOffset);
+    _result.pCacheFile      = std::move(pFile);
+
+    return true;
+  }
+
+  bool save(const std::string& _path, const uint64_t _key, const resourcesLoader::ModelData& _data)
+  {
+    std::error_code error;
+    std::filesystem::create_directories(std::filesystem::path(_path).parent_path(), error);
+    if (error)
+    {
+      std::cout << "WARNING: meshCache::save - Couldn't create the cache folder: " << error.message() << std::endl;
+      return false;
+    }
+
+    Header header{};
+    header.magic        = MESH_CACHE_MAGIC;
+    header.version      = MESH_CACHE_VERSION;
+    header.key          = _key;
+    header.vertexFormat = static_cast<uint32_t>(_data.vertexFormat);
+    header.vertexStride = _data.getVertexStride();
+    header.vertexCount  = _data.getVertexCount();
+    header.indexSize    = _data.getIndexSize();
+    header.indexCount   = _data.getIndexCount();
+    header.vertexOffset = alignUp(sizeof(Header));
+    header.indexOffset  = alignUp(header.vertexOffset + uint64_t(header.vertexCount) * header.vertexStride);
+    header.bounds       = _data.bounds;
+    header.quantization = _data.quantization;
+    header.lodCount     = std::min<uint32_t>(_data.lods.size(), MAX_LOD_COUNT);
+    std::copy(_data.lods.begin(), _data.lods.begin() + header.lodCount, header.lods);
+
+    // Written aside and renamed, so a crash (or a concurrent load) never sees half a file
+    const std::string tmpPath = _path + ".tmp";
+    {
+      std::ofstream file(tmpPath, std::ios::binary | std::ios::trunc);
+      if (!file.is_open())
+      {
+        std::cout << "WARNING: meshCache::save - Couldn't open " << tmpPath << std::endl;
+        return false;
+      }
+
+      const char padding[BLOB_ALIGNMENT] = {};
+
+      file.write(reinterpret_cast<const char*>(&header), sizeof(Header));
+      file.write(padding, header.vertexOffset - sizeof(Header));
+      file.write(static_cast<const char*>(_data.getVertices()), header.vertexCount * header.vertexStride);
+      file.write(padding, header.indexOffset - header.vertexOffset - header.vertexCount * header.vertexStride);
+      file.write(static_cast<const char*>(_data.getIndices()), header.indexCount * header.indexSize);
+
+      if (!file.good())
+      {
+        std::cout << "WARNING: meshCache::save - Failed writing " << tmpPath << std::endl;
+        return false;
+      }
+    }
+
+    std::filesystem::rename(tmpPath, _path, error);
+    if (error)
+    {
+      std::cout << "WARNING: meshCache::save - Couldn't move " << tmpPath << ": " << error.message() << std::endl;
+      std::filesystem::remove(tmpPath, error);
+      return false;
+    }
+
+    return true;
+  }
+} // namespace vpe::meshCache
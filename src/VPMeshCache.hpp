@@ -0,0 +1,51 @@
+#ifndef VP_MESH_CACHE_HPP
+#define VP_MESH_CACHE_HPP
+
+#include <string>
+#include <type_traits>
+
+#include "VPResourcesLoader.hpp"
+#include "VPHash.hpp"
+
+namespace vpe
+{
+// Relative to the working directory, like the models and shaders
+const char* const MESH_CACHE_DIR = "../Cache/Meshes/";
+
+constexpr uint32_t MESH_CACHE_MAGIC   = 0x534D5056; // "VPMS"
+// Bump it whenever the layout or the import changes, the old files become stale
+constexpr uint32_t MESH_CACHE_VERSION = 5;
+} // namespace vpe
+
+namespace vpe::meshCache
+{
+  // Followed by the vertex and the index blobs, in the same layout as the GPU buffers
+  struct Header
+  {
+    uint32_t     magic;
+    uint32_t     version;
+    uint64_t     key;          // Hash of the source's contents, the import settings and the vertex format
+    uint32_t     vertexFormat; // VertexFormat
+    uint32_t     vertexStride; // Guards against changes in the vertex structs without a version bump
+    uint32_t     vertexCount;
+    uint32_t     indexSize;    // 2 or 4
+    uint32_t     indexCount;
+    uint32_t     padding;
+    uint64_t     vertexOffset; // From the start of the file
+    uint64_t     indexOffset;
+    Bounds       bounds;
+    Quantization quantization;
+    uint32_t     lodCount;
+    LodRange     lods[MAX_LOD_COUNT];
+  };
+  static_assert(std::is_trivially_copyable<Header>::value, "The header is written and read as raw bytes");
+
+  // One file per source path and vertex format. The key is checked when loading, so stale files are just overwritten.
+  std::string getPath(const char* _sourcePath, const VertexFormat _format);
+
+  // The result keeps the file mapped and points into it, nothing is copied
+  bool load(const std::string& _path, const uint64_t _key, resourcesLoader::ModelData& _result);
+
+  bool save(const std::string& _path, const uint64_t _key, const resourcesLoader::ModelData& _data);
+} // namespace vpe::meshCache
+#endif
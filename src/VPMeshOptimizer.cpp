@@ -0,0 +1,325 @@
+#include "VPMeshOptimizer.hpp"
+
+#include <unordered_map>
+#include <algorithm>
+#include <numeric>
+
+namespace vpe::meshOptimizer
+{
+  namespace
+  {
+    // FIFO cache made of time stamps: a vertex is cached if it was loaded less than _cacheSize misses ago
+    struct CacheSimulator
+    {
+      CacheSimulator(const size_t _vertexCount, const uint32_t _cacheSize) :
+        cacheSize(_cacheSize),
+        time(_cacheSize + 1),
+        stamps(_vertexCount, 0)
+      {}
+
+      // Returns true on a miss
+      inline bool access(const uint32_t _vertex)
+      {
+        if (time - stamps.at(_vertex) <= cacheSize) return false;
+
+        stamps.at(_vertex) = time++;
+        return true;
+      }
+
+      inline void reset()
+      {
+        time += cacheSize + 1; // Everything falls out of the cache
+      }
+
+      const uint32_t        cacheSize;
+      uint32_t              time;
+      std::vector<uint32_t> stamps;
+    };
+  }
+
+  CacheStats computeCacheStats(const std::vector<uint32_t>& _indices,
+                               const size_t                 _vertexCount,
+                               const uint32_t               _cacheSize)
+  {
+    CacheStats result{};
+    if (_indices.size() < 3 || _vertexCount == 0) return result;
+
+    CacheSimulator cache(_vertexCount, _cacheSize);
+
+    size_t misses = 0;
+    for (const auto& index : _indices) misses += cache.access(index);
+
+    result.acmr = float(misses) / (_indices.size() / 3);
+    result.atvr = float(misses) / _vertexCount;
+
+    return result;
+  }
+
+  void weldVertices(std::vector<Vertex>& _vertices, std::vector<uint32_t>& _indices)
+  {
+    std::unordered_map<Vertex, uint32_t> uniqueVertices;
+    uniqueVertices.reserve(_vertices.size());
+
+    std::vector<Vertex>   welded;
+    std::vector<uint32_t> remap(_vertices.size());
+    welded.reserve(_vertices.size());
+
+    for (size_t i=0; i<_vertices.size(); ++i)
+    {
+      const auto inserted = uniqueVertices.emplace(_vertices[i], static_cast<uint32_t>(welded.size()));
+      if (inserted.second) welded.push_back(_vertices[i]);
+
+      remap[i] = inserted.first->second;
+    }
+
+    for (auto& index : _indices) index = remap.at(index);
+
+    _vertices.swap(welded);
+  }
+
+  std::vector<uint32_t> optimizeVertexCache(std::vector<uint32_t>& _indices,
+                                            const size_t           _vertexCount,
+                                            const uint32_t         _cacheSize)
+  {
+    std::vector<uint32_t> hardBoundaries{0};
+
+    const size_t triangleCount = _indices.size() / 3;
+    if (triangleCount == 0 || _vertexCount == 0) return hardBoundaries;
+
+    // Triangles using each vertex, flattened
+    std::vector<uint32_t> liveTriangles(_vertexCount, 0);
+    for (const auto& index : _indices) ++liveTriangles.at(index);
+
+    std::vector<uint32_t> adjacencyOffsets(_vertexCount + 1, 0);
+    for (size_t v=0; v<_vertexCount; ++v)
+      adjacencyOffsets[v + 1] = adjacencyOffsets[v] + liveTriangles[v];
+
+    std::vector<uint32_t> adjacency(_indices.size());
+    {
+      std::vector<uint32_t> cursor(adjacencyOffsets.begin(), adjacencyOffsets.end() - 1);
+      for (size_t i=0; i<_indices.size(); ++i)
+        adjacency[ cursor[_indices[i]]++ ] = static_cast<uint32_t>(i / 3);
+    }
+
+    std::vector<uint32_t> stamps(_vertexCount, 0);
+    std::vector<bool>     isEmitted(triangleCount, false);
+    std::vector<uint32_t> deadEnds;
+    std::vector<uint32_t> candidates;
+    std::vector<uint32_t> result;
+    result.reserve(_indices.size());
+
+    uint32_t time    = _cacheSize + 1;
+    size_t   scanIdx = 0; // Next vertex to check when there are no dead ends left
+    int64_t  fanning = 0;
+
+    while (fanning >= 0)
+    {
+      candidates.clear();
+
+      for (uint32_t a=adjacencyOffsets[fanning]; a<adjacencyOffsets[fanning + 1]; ++a)
+      {
+        const uint32_t triangle = adjacency[a];
+        if (isEmitted[triangle]) continue;
+
+        for (uint32_t c=0; c<3; ++c)
+        {
+          const uint32_t vertex = _indices[triangle * 3 + c];
+
+          result.push_back(vertex);
+          deadEnds.push_back(vertex);
+          candidates.push_back(vertex);
+          --liveTriangles[vertex];
+
+          if (time - stamps[vertex] > _cacheSize) stamps[vertex] = time++;
+        }
+
+        isEmitted[triangle] = true;
+      }
+
+      // The candidate that will still be in the cache after its remaining triangles, and the oldest one
+      int64_t  next         = -1;
+      uint32_t bestPriority = 0;
+      for (const auto& vertex : candidates)
+      {
+        if (liveTriangles[vertex] == 0) continue;
+
+        uint32_t priority = 0;
+        if (time - stamps[vertex] + 2 * liveTriangles[vertex] <= _cacheSize)
+          priority = time - stamps[vertex];
+
+        if (next < 0 || priority > bestPriority)
+        {
+          next         = vertex;
+          bestPriority = priority;
+        }
+      }
+
+      if (next < 0)
+      {
+        // Dead end: go back to a recently used vertex, or any vertex with triangles left
+        while (!deadEnds.empty() && next < 0)
+        {
+          const uint32_t vertex = deadEnds.back();
+          deadEnds.pop_back();
+          if (liveTriangles[vertex] > 0) next = vertex;
+        }
+
+        while (next < 0 && scanIdx < _vertexCount)
+        {
+          if (liveTriangles[scanIdx] > 0) next = scanIdx;
+          ++scanIdx;
+        }
+
+        if (next >= 0) hardBoundaries.push_back( static_cast<uint32_t>(result.size() / 3) );
+      }
+
+      fanning = next;
+    }
+
+    _indices.swap(result);
+
+    return hardBoundaries;
+  }
+
+  void optimizeOverdraw(std::vector<uint32_t>&       _indices,
+                        const std::vector<Vertex>&   _vertices,
+                        const std::vector<uint32_t>& _hardBoundaries,
+                        const uint32_t               _cacheSize,
+                        const float                  _threshold)
+  {
+    const uint32_t triangleCount = static_cast<uint32_t>(_indices.size() / 3);
+    if (triangleCount == 0 || _hardBoundaries.empty()) return;
+
+    CacheSimulator cache(_vertices.size(), _cacheSize);
+
+    auto triangleMisses = [&](const uint32_t _triangle)
+    {
+      return cache.access(_indices[_triangle * 3 + 0]) +
+             cache.access(_indices[_triangle * 3 + 1]) +
+             cache.access(_indices[_triangle * 3 + 2]);
+    };
+
+    // Soft boundaries: split a cluster as soon as the piece so far is as cache efficient as the whole
+    std::vector<uint32_t> clusters;
+    for (size_t c=0; c<_hardBoundaries.size(); ++c)
+    {
+      const uint32_t start = _hardBoundaries[c];
+      const uint32_t end   = c + 1 < _hardBoundaries.size() ? _hardBoundaries[c + 1] : triangleCount;
+      if (start >= end) continue;
+
+      cache.reset();
+      uint32_t clusterMisses = 0;
+      for (uint32_t t=start; t<end; ++t) clusterMisses += triangleMisses(t);
+
+      const float maxACMR = _threshold * float(clusterMisses) / (end - start);
+
+      cache.reset();
+      uint32_t pieceStart  = start;
+      uint32_t pieceMisses = 0;
+      for (uint32_t t=start; t<end; ++t)
+      {
+        pieceMisses += triangleMisses(t);
+
+        if (t + 1 == end || float(pieceMisses) / (t + 1 - pieceStart) <= maxACMR)
+        {
+          clusters.push_back(pieceStart);
+          pieceStart  = t + 1;
+          pieceMisses = 0;
+          cache.reset();
+        }
+      }
+    }
+
+    // Sander's linear overdraw heuristic: sort by how much each cluster faces away from the center
+    glm::vec3 meshCenter(0);
+    for (const auto& vertex : _vertices) meshCenter += vertex.pos;
+    meshCenter /= float(std::max(_vertices.size(), size_t(1)));
+
+    std::vector<float> sortKeys(clusters.size());
+    for (size_t c=0; c<clusters.size(); ++c)
+    {
+      const uint32_t start = clusters[c];
+      const uint32_t end   = c + 1 < clusters.size() ? clusters[c + 1] : triangleCount;
+
+      glm::vec3 centroid(0);
+      glm::vec3 normal(0);
+      float     area = 0.0f;
+
+      for (uint32_t t=start; t<end; ++t)
+      {
+        const glm::vec3& p0 = _vertices[ _indices[t * 3 + 0] ].pos;
+        const glm::vec3& p1 = _vertices[ _indices[t * 3 + 1] ].pos;
+        const glm::vec3& p2 = _vertices[ _indices[t * 3 + 2] ].pos;
+
+        // Its length is twice the triangle's area, so it's already area weighted
+        const glm::vec3 triangleNormal = glm::cross(p1 - p0, p2 - p0);
+        const float     triangleArea   = glm::length(triangleNormal);
+
+        centroid += (p0 + p1 + p2) * (triangleArea / 3.0f);
+        normal   += triangleNormal;
+        area     += triangleArea;
+      }
+
+      centroid   = area > 0.0f ? centroid / area : _vertices[ _indices[start * 3] ].pos;
+      const float normalLength = glm::length(normal);
+      sortKeys[c] = normalLength > 0.0f ? glm::dot(centroid - meshCenter, normal / normalLength) : 0.0f;
+    }
+
+    std::vector<uint32_t> order(clusters.size());
+    std::iota(order.begin(), order.end(), 0);
+    std::stable_sort(order.begin(), order.end(), [&](const uint32_t _a, const uint32_t _b)
+    {
+      return sortKeys[_a] > sortKeys[_b];
+    });
+
+    std::vector<uint32_t> result;
+    result.reserve(_indices.size());
+    for (const auto& c : order)
+    {
+      const uint32_t start = clusters[c];
+      const uint32_t end   = c + 1 < clusters.size() ? clusters[c + 1] : triangleCount;
+
+      result.insert(result.end(), _indices.begin() + start * 3, _indices.begin() + end * 3);
+    }
+
+    _indices.swap(result);
+  }
+
+  void optimizeVertexFetch(std::vector<Vertex>& _vertices, std::vector<uint32_t>& _indices)
+  {
+    std::vector<uint32_t> remap(_vertices.size(), UINT32_MAX);
+    std::vector<Vertex>   result;
+    result.reserve(_vertices.size());
+
+    for (auto& index : _indices)
+    {
+      if (remap.at(index) == UINT32_MAX)
+      {
+        remap[index] = static_cast<uint32_t>(result.size());
+        result.push_back(_vertices[index]);
+      }
+
+      index = remap[index];
+    }
+
+    _vertices.swap(result);
+  }
+
+  Report optimize(std::vector<Vertex>& _vertices, std::vector<uint32_t>& _indices)
+  {
+    Report report{};
+    report.vertexCountBefore = _vertices.size();
+    report.before            = computeCacheStats(_indices, _vertices.size());
+
+    weldVertices(_vertices, _indices);
+
+    const auto hardBoundaries = optimizeVertexCache(_indices, _vertices.size());
+    optimizeOverdraw(_indices, _vertices, hardBoundaries);
+    optimizeVertexFetch(_vertices, _indices);
+
+    report.vertexCountAfter = _vertices.size();
+    report.after            = computeCacheStats(_indices, _vertices.size());
+
+    return report;
+  }
+} // namespace vpe::meshOptimizer
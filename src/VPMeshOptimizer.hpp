@@ -0,0 +1,62 @@
+#ifndef VP_MESH_OPTIMIZER_HPP
+#define VP_MESH_OPTIMIZER_HPP
+
+#include <vector>
+#include <cstdint>
+
+#include "VPVertex.hpp"
+
+namespace vpe
+{
+// Post transform cache size the orderings are optimized for. Small enough to be a safe bet on any GPU.
+constexpr uint32_t VERTEX_CACHE_SIZE = 16;
+// How much worse than the cache optimal order each cluster can get to improve the overdraw
+constexpr float    OVERDRAW_THRESHOLD = 1.05f;
+} // namespace vpe
+
+namespace vpe::meshOptimizer
+{
+  struct CacheStats
+  {
+    float acmr = 0.0f; // Average Cache Miss Ratio: vertex shader invocations per triangle. 0.5 is the ideal.
+    float atvr = 0.0f; // Average Transformed Vertex Ratio: invocations per vertex. 1.0 is the ideal.
+  };
+
+  struct Report
+  {
+    size_t     vertexCountBefore = 0;
+    size_t     vertexCountAfter  = 0;
+    CacheStats before;
+    CacheStats after;
+  };
+
+  // Simulates a FIFO post transform cache of _cacheSize entries
+  CacheStats computeCacheStats(const std::vector<uint32_t>& _indices,
+                               const size_t                 _vertexCount,
+                               const uint32_t               _cacheSize = VERTEX_CACHE_SIZE);
+
+  // Merges bitwise identical vertices
+  void weldVertices(std::vector<Vertex>& _vertices, std::vector<uint32_t>& _indices);
+
+  // Tipsify (Sander et al. 2007): fans around vertices that are likely still in the cache.
+  // Returns the triangle offsets where the order had to jump (dead ends), as cluster boundaries.
+  std::vector<uint32_t> optimizeVertexCache(std::vector<uint32_t>& _indices,
+                                            const size_t           _vertexCount,
+                                            const uint32_t         _cacheSize = VERTEX_CACHE_SIZE);
+
+  // Splits the clusters further while their cache efficiency allows, then draws the ones facing
+  // outwards first, so they occlude the rest
+  void optimizeOverdraw(std::vector<uint32_t>&       _indices,
+                        const std::vector<Vertex>&   _vertices,
+                        const std::vector<uint32_t>& _hardBoundaries,
+                        const uint32_t               _cacheSize = VERTEX_CACHE_SIZE,
+                        const float                  _threshold = OVERDRAW_THRESHOLD);
+
+  // Sorts the vertices by first use, so the fetches walk the vertex buffer linearly.
+  // Unreferenced vertices are dropped.
+  void optimizeVertexFetch(std::vector<Vertex>& _vertices, std::vector<uint32_t>& _indices);
+
+  // All of the above, in order
+  Report optimize(std::vector<Vertex>& _vertices, std::vector<uint32_t>& _indices);
+} // namespace vpe::meshOptimizer
+#endif
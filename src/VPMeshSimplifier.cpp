@@ -0,0 +1,320 @@
+#include "VPMeshSimplifier.hpp"
+#include "VPMeshOptimizer.hpp"
+
+#include <unordered_map>
+#include <algorithm>
+#include <numeric>
+
+namespace vpe::meshSimplifier
+{
+  namespace
+  {
+    // Sum of the (area weighted) squared distances to a set of planes: p'Ap + 2b'p + c
+    struct Quadric
+    {
+      double a00 = 0, a01 = 0, a02 = 0, a11 = 0, a12 = 0, a22 = 0;
+      double b0  = 0, b1  = 0, b2  = 0;
+      double c   = 0;
+      double weight = 0;
+
+      static inline Quadric fromPlane(const glm::vec3& _normal, const float _distance, const double _weight)
+      {
+        const double x = _normal.x, y = _normal.y, z = _normal.z, d = _distance;
+
+        Quadric result{};
+        result.a00 = _weight * x * x;  result.a01 = _weight * x * y;  result.a02 = _weight * x * z;
+        result.a11 = _weight * y * y;  result.a12 = _weight * y * z;  result.a22 = _weight * z * z;
+        result.b0  = _weight * x * d;  result.b1  = _weight * y * d;  result.b2  = _weight * z * d;
+        result.c   = _weight * d * d;
+        result.weight = _weight;
+
+        return result;
+      }
+
+      inline Quadric& operator+=(const Quadric& _other)
+      {
+        a00 += _other.a00;  a01 += _other.a01;  a02 += _other.a02;
+        a11 += _other.a11;  a12 += _other.a12;  a22 += _other.a22;
+        b0  += _other.b0;   b1  += _other.b1;   b2  += _other.b2;
+        c   += _other.c;
+        weight += _other.weight;
+        return *this;
+      }
+
+      // Mean squared distance, so it doesn't depend on the mesh's density
+      inline double evaluate(const glm::vec3& _point) const
+      {
+        const double x = _point.x, y = _point.y, z = _point.z;
+
+        const double error = a00 * x * x + a11 * y * y + a22 * z * z +
+                             2.0 * (a01 * x * y + a02 * x * z + a12 * y * z) +
+                             2.0 * (b0 * x + b1 * y + b2 * z) +
+                             c;
+
+        return weight > 0.0 ? std::max(error, 0.0) / weight : 0.0;
+      }
+    };
+
+    struct Collapse
+    {
+      uint32_t from;
+      uint32_t to;
+      double   error; // Squared
+    };
+
+    inline uint64_t edgeKey(const uint32_t _a, const uint32_t _b)
+    {
+      return (uint64_t(std::min(_a, _b)) << 32) | std::max(_a, _b);
+    }
+  }
+
+  std::vector<uint32_t> simplify(const std::vector<Vertex>&   _vertices,
+                                 const std::vector<uint32_t>& _indices,
+                                 const size_t                 _targetIndexCount,
+                                 const float                  _maxError,
+                                 float*                       _pResultError)
+  {
+    std::vector<uint32_t> result = _indices;
+    double                resultError = 0.0;
+
+    const size_t vertexCount     = _vertices.size();
+    const size_t targetTriangles = _targetIndexCount / 3;
+    size_t       triangleCount   = result.size() / 3;
+
+    if (triangleCount <= targetTriangles || vertexCount == 0)
+    {
+      if (_pResultError) *_pResultError = 0.0f;
+      return result;
+    }
+
+    // Vertices sharing a position (but not the other attributes) are the same point of the surface
+    std::vector<uint32_t> canonical(vertexCount);
+    std::vector<uint32_t> copies(vertexCount, 0);
+    {
+      std::unordered_map<glm::vec3, uint32_t> firstWithPosition;
+      firstWithPosition.reserve(vertexCount);
+
+      for (uint32_t v=0; v<vertexCount; ++v)
+      {
+        canonical[v] = firstWithPosition.emplace(_vertices[v].pos, v).first->second;
+        ++copies[ canonical[v] ];
+      }
+    }
+
+    // Seams and borders stay where they are, moving them would open cracks
+    std::vector<bool> isLocked(vertexCount, false);
+    for (uint32_t v=0; v<vertexCount; ++v)
+      if (copies[v] > 1) isLocked[v] = true;
+
+    {
+      std::unordered_map<uint64_t, uint32_t> edgeUses;
+      edgeUses.reserve(result.size());
+
+      for (size_t i=0; i<result.size(); i+=3)
+        for (uint32_t e=0; e<3; ++e)
+          ++edgeUses[ edgeKey(canonical[ result[i + e] ], canonical[ result[i + (e + 1) % 3] ]) ];
+
+      for (const auto& edge : edgeUses)
+      {
+        if (edge.second != 1) continue;
+
+        isLocked[ uint32_t(edge.first >> 32) ]        = true;
+        isLocked[ uint32_t(edge.first & 0xFFFFFFFF) ] = true;
+      }
+    }
+
+    std::vector<Quadric> quadrics(vertexCount);
+    for (size_t i=0; i<result.size(); i+=3)
+    {
+      const uint32_t  v0 = canonical[ result[i + 0] ];
+      const uint32_t  v1 = canonical[ result[i + 1] ];
+      const uint32_t  v2 = canonical[ result[i + 2] ];
+      const glm::vec3 p0 = _vertices[v0].pos;
+
+      glm::vec3   normal = glm::cross(_vertices[v1].pos - p0, _vertices[v2].pos - p0);
+      const float length = glm::length(normal);
+      if (length == 0.0f) continue;
+
+      normal /= length;
+      const Quadric plane = Quadric::fromPlane(normal, -glm::dot(normal, p0), 0.5 * length);
+
+      quadrics[v0] += plane;
+      quadrics[v1] += plane;
+      quadrics[v2] += plane;
+    }
+
+    const double maxErrorSqr = double(_maxError) * double(_maxError);
+
+    std::vector<uint32_t> collapseTo(vertexCount);
+    std::vector<bool>     isTouched(vertexCount);
+    std::vector<uint32_t> adjacencyOffsets(vertexCount + 1);
+    std::vector<uint32_t> adjacency;
+    std::vector<Collapse> collapses;
+
+    // Each pass collapses as many independent edges as it can, cheapest first
+    while (triangleCount > targetTriangles)
+    {
+      // Triangles around each canonical vertex, flattened
+      std::fill(adjacencyOffsets.begin(), adjacencyOffsets.end(), 0);
+      for (const auto& index : result) ++adjacencyOffsets[ canonical[index] + 1 ];
+      std::partial_sum(adjacencyOffsets.begin(), adjacencyOffsets.end(), adjacencyOffsets.begin());
+
+      adjacency.resize(result.size());
+      {
+        std::vector<uint32_t> cursor(adjacencyOffsets.begin(), adjacencyOffsets.end() - 1);
+        for (size_t i=0; i<result.size(); ++i)
+          adjacency[ cursor[ canonical[ result[i] ] ]++ ] = static_cast<uint32_t>(i / 3);
+      }
+
+      collapses.clear();
+      for (size_t i=0; i<result.size(); i+=3)
+      {
+        for (uint32_t e=0; e<3; ++e)
+        {
+          const uint32_t a = canonical[ result[i + e] ];
+          const uint32_t b = canonical[ result[i + (e + 1) % 3] ];
+
+          // Both directions. A seam target would be ambiguous: which of its copies should be used?
+          for (const auto& edge : {std::make_pair(a, b), std::make_pair(b, a)})
+          {
+            if (isLocked[edge.first] || copies[edge.second] > 1) continue;
+
+            Quadric merged = quadrics[edge.first];
+            merged += quadrics[edge.second];
+
+            const double error = merged.evaluate(_vertices[edge.second].pos);
+            if (error <= maxErrorSqr) collapses.push_back({edge.first, edge.second, error});
+          }
+        }
+      }
+
+      if (collapses.empty()) break;
+
+      std::sort(collapses.begin(), collapses.end(), [](const Collapse& _a, const Collapse& _b)
+      {
+        if (_a.error != _b.error) return _a.error < _b.error;
+        return _a.from != _b.from ? _a.from < _b.from : _a.to < _b.to;
+      });
+
+      std::iota(collapseTo.begin(), collapseTo.end(), 0);
+      std::fill(isTouched.begin(), isTouched.end(), false);
+
+      const size_t trianglesToRemove = triangleCount - targetTriangles;
+      size_t       removedTriangles  = 0;
+
+      for (const auto& collapse : collapses)
+      {
+        if (removedTriangles >= trianglesToRemove) break;
+        if (isTouched[collapse.from] || isTouched[collapse.to]) continue;
+
+        const glm::vec3& target = _vertices[collapse.to].pos;
+
+        // Reject the collapses that would flip a triangle
+        bool     isFlipping = false;
+        uint32_t removedHere = 0;
+        for (uint32_t a=adjacencyOffsets[collapse.from]; a<adjacencyOffsets[collapse.from + 1] && !isFlipping; ++a)
+        {
+          const uint32_t* pTriangle = &result[ adjacency[a] * 3 ];
+
+          glm::vec3 before[3];
+          glm::vec3 after[3];
+          bool      isRemoved = false;
+          for (uint32_t c=0; c<3; ++c)
+          {
+            const uint32_t v = canonical[ pTriangle[c] ];
+
+            isRemoved |= v == collapse.to;
+            before[c]  = _vertices[v].pos;
+            after[c]   = v == collapse.from ? target : before[c];
+          }
+
+          if (isRemoved)
+          {
+            ++removedHere;
+            continue;
+          }
+
+          const glm::vec3 normalBefore = glm::cross(before[1] - before[0], before[2] - before[0]);
+          const glm::vec3 normalAfter  = glm::cross(after[1]  - after[0],  after[2]  - after[0]);
+          isFlipping = glm::dot(normalBefore, normalAfter) <= 0.0f;
+        }
+
+        if (isFlipping) continue;
+
+        // The triangles around it change, so their vertices can't be collapsed again in this pass
+        for (uint32_t a=adjacencyOffsets[collapse.from]; a<adjacencyOffsets[collapse.from + 1]; ++a)
+          for (uint32_t c=0; c<3; ++c)
+            isTouched[ canonical[ result[adjacency[a] * 3 + c] ] ] = true;
+
+        collapseTo[collapse.from]  = collapse.to;
+        quadrics[collapse.to]     += quadrics[collapse.from];
+        resultError                = std::max(resultError, collapse.error);
+        removedTriangles          += removedHere;
+      }
+
+      if (removedTriangles == 0) break;
+
+      // Neither end of a collapse is a seam, so its canonical vertex is the only copy
+      size_t written = 0;
+      for (size_t i=0; i<result.size(); i+=3)
+      {
+        uint32_t triangle[3];
+        for (uint32_t c=0; c<3; ++c)
+        {
+          const uint32_t v = canonical[ result[i + c] ];
+          triangle[c] = collapseTo[v] != v ? collapseTo[v] : result[i + c];
+        }
+
+        const uint32_t v0 = canonical[triangle[0]];
+        const uint32_t v1 = canonical[triangle[1]];
+        const uint32_t v2 = canonical[triangle[2]];
+        if (v0 == v1 || v1 == v2 || v0 == v2) continue;
+
+        result[written++] = triangle[0];
+        result[written++] = triangle[1];
+        result[written++] = triangle[2];
+      }
+
+      result.resize(written);
+      triangleCount = written / 3;
+    }
+
+    if (_pResultError) *_pResultError = static_cast<float>( std::sqrt(resultError) );
+
+    return result;
+  }
+
+  std::vector<std::vector<uint32_t>> generateLods(const std::vector<Vertex>&   _vertices,
+                                                  const std::vector<uint32_t>& _indices,
+                                                  const float                  _radius,
+                                                  std::vector<float>&          _errors)
+  {
+    std::vector<std::vector<uint32_t>> lods{_indices};
+    _errors.assign(1, 0.0f);
+
+    float error = 0.0f;
+    while (lods.size() < MAX_LOD_COUNT)
+    {
+      const auto&  previous    = lods.back();
+      const size_t targetCount = size_t(previous.size() / 3 * LOD_TRIANGLE_RATIO) * 3;
+
+      // Smaller on screen, so they can deviate more for the same error in pixels
+      const float maxError = LOD_MAX_ERROR * _radius * (LOD_SCREEN_SIZES[0] / LOD_SCREEN_SIZES[lods.size() - 1]);
+      if (maxError <= error) break;
+
+      // Simplifying the previous LOD instead of the original is way cheaper. The errors add up.
+      float lodError = 0.0f;
+      auto  lod      = simplify(_vertices, previous, targetCount, maxError - error, &lodError);
+
+      if (lod.empty() || lod.size() > previous.size() * LOD_MIN_REDUCTION) break;
+
+      meshOptimizer::optimizeVertexCache(lod, _vertices.size());
+
+      error += lodError;
+      _errors.push_back(_radius > 0.0f ? error / _radius : 0.0f);
+      lods.push_back( std::move(lod) );
+    }
+
+    return lods;
+  }
+} // namespace vpe::meshSimplifier
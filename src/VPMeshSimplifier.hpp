@@ -0,0 +1,31 @@
+#ifndef VP_MESH_SIMPLIFIER_HPP
+#define VP_MESH_SIMPLIFIER_HPP
+
+#include <vector>
+#include <cstdint>
+
+#include "VPVertex.hpp"
+#include "VPLod.hpp"
+
+namespace vpe::meshSimplifier
+{
+  // Quadric error metric edge collapse (Garland & Heckbert 1997), restricted to the existing vertices:
+  // a vertex is only ever collapsed into one of its neighbours, so only the indices change and every
+  // LOD can share the original vertex buffer.
+  // Seams (vertices split by their attributes) and borders are never moved, so there are no cracks.
+  //
+  // Stops at _targetIndexCount or when every collapse left would move the surface more than _maxError
+  // (object space distance). _pResultError receives the biggest error introduced.
+  std::vector<uint32_t> simplify(const std::vector<Vertex>&   _vertices,
+                                 const std::vector<uint32_t>& _indices,
+                                 const size_t                 _targetIndexCount,
+                                 const float                  _maxError,
+                                 float*                       _pResultError = nullptr);
+
+  // LOD 0 is _indices itself. Each LOD's indices are ordered for the vertex cache.
+  std::vector<std::vector<uint32_t>> generateLods(const std::vector<Vertex>&   _vertices,
+                                                  const std::vector<uint32_t>& _indices,
+                                                  const float                  _radius,
+                                                  std::vector<float>&          _errors);
+} // namespace vpe::meshSimplifier
+#endif
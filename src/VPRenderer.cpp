@@ -11,20 +11,26 @@ namespace vpe
 {
 Renderer::Renderer() :
   m_pUserInputController(nullptr),
+  m_isHeadless(false),
   m_pWindow(nullptr),
   m_pCamera(nullptr),
+  m_surface(VK_NULL_HANDLE),
   m_frameBufferResized(false),
+  m_lastImageIdx(0),
   m_pRenderPipelineManager(nullptr),
   m_currentFrame(0),
-  m_msaaSampleCount(VK_SAMPLE_COUNT_1_BIT)
+  m_msaaSampleCount(VK_SAMPLE_COUNT_1_BIT),
+  m_pRecordingThreadPool(nullptr)
 {}
 Renderer::~Renderer() {}
 
-void Renderer::init()
+void Renderer::init(const bool _headless)
 {
-  this->initWindow();
+  m_isHeadless = _headless;
+
+  if (!m_isHeadless) this->initWindow();
   this->initVulkan();
-  m_pUserInputController = new UserInputController();
+  if (!m_isHeadless) m_pUserInputController = new UserInputController();
 }
 
 void Renderer::initWindow()
@@ -42,21 +48,35 @@ void Renderer::initWindow()
 
 void Renderer::initVulkan()
 {
-  m_vkInstance     = deviceManagement::createVulkanInstance( getGLFWRequiredExtensions() );
+  m_vkInstance     = deviceManagement::createVulkanInstance( getRequiredExtensions() );
   m_debugMessenger = deviceManagement::createDebugMessenger(m_vkInstance);
 
-  this->createSurface();
+  if (!m_isHeadless) this->createSurface();
 
   m_physicalDevice       = deviceManagement::getPhysicalDevice(m_vkInstance, m_surface);
   m_queueFamiliesIndices = deviceManagement::findQueueFamilies(m_physicalDevice, m_surface);
-  m_logicalDevice        = deviceManagement::createLogicalDevice(m_physicalDevice,
-                                                                 m_queueFamiliesIndices);
+
+  std::vector<const char*> deviceExtensions = m_isHeadless ? deviceManagement::HEADLESS_DEVICE_EXTENSIONS :
+                                                             deviceManagement::DEVICE_EXTENSIONS;
+  bool hasCreationFeedback = false;
+  for (const char* extension : deviceManagement::OPTIONAL_DEVICE_EXTENSIONS)
+  {
+    if (!deviceManagement::checkExtensionSupport(m_physicalDevice, {extension})) continue;
+
+    deviceExtensions.push_back(extension);
+    hasCreationFeedback |= strcmp(extension, VK_EXT_PIPELINE_CREATION_FEEDBACK_EXTENSION_NAME) == 0;
+  }
+
+  m_logicalDevice = deviceManagement::createLogicalDevice(m_physicalDevice,
+                                                          m_queueFamiliesIndices,
+                                                          deviceExtensions);
 
   VkPhysicalDeviceProperties properties{};
   vkGetPhysicalDeviceProperties(m_physicalDevice, &properties);
 
   vkGetDeviceQueue(m_logicalDevice, m_queueFamiliesIndices.graphicsFamily.value(), 0, &m_graphicsQueue);
   vkGetDeviceQueue(m_logicalDevice, m_queueFamiliesIndices.presentFamily.value(), 0, &m_presentQueue);
+  vkGetDeviceQueue(m_logicalDevice, m_queueFamiliesIndices.transferFamily.value(), 0, &m_transferQueue);
 
   m_msaaSampleCount = deviceManagement::getMaxUsableSampleCount(m_physicalDevice);
 
@@ -68,21 +88,47 @@ void Renderer::initVulkan()
   bufferManager.m_pLogicalDevice        = &m_logicalDevice;
   bufferManager.m_pPhysicalDevice       = &m_physicalDevice;
 
+  MemoryAllocator::getInstance().init(&m_physicalDevice, &m_logicalDevice);
+
+  PipelineCache::getInstance().init(&m_logicalDevice, m_physicalDevice, hasCreationFeedback);
+
+  UploadBatcher::getInstance().init(&m_logicalDevice,
+                                    m_queueFamiliesIndices.transferFamily.value(),
+                                    &m_transferQueue,
+                                    m_queueFamiliesIndices.graphicsFamily.value(),
+                                    &m_graphicsQueue);
+
+  m_pRecordingThreadPool = std::make_unique<ThreadPool>( ThreadPool::getDefaultThreadCount() );
+
+  // One secondary pool per recording thread and frame
   commandBufferManager.createCommandPool(m_queueFamiliesIndices.graphicsFamily.value());
+  commandBufferManager.createFramePools(m_queueFamiliesIndices.graphicsFamily.value(),
+                                        MAX_FRAMES_IN_FLIGHT,
+                                        m_pRecordingThreadPool->getThreadCount());
+
+  if (m_isHeadless)
+    this->createOffscreenImages();
+  else
+    this->createSwapChain();
 
-  this->createSwapChain();
   this->createImageViews();
   this->createRenderPass();
 
   // Create the default Material and Pipeline
   this->createGraphicsPipelineManager();
   this->createMaterial(DEFAULT_VERT, DEFAULT_FRAG);
+  m_scene.setUniformRegionCount(MAX_FRAMES_IN_FLIGHT);
+
+  if (!m_scene.m_pMaterials.at(DEFAULT_MATERIAL_IDX)->supportsInstancing())
+  {
+    std::cout << "WARNING: Renderer::initVulkan - " << DEFAULT_VERT_INSTANCED
+              << " not found, instancing is disabled. Run compileShaders.sh." << std::endl;
+  }
 
   if (MSAA_ENABLED) this->createColorResources();
   this->createDepthResources();
   this->createFrameBuffers();
 
-  this->setupRenderCommands();
   this->createSyncObjects();
 }
 
@@ -92,48 +138,79 @@ void Renderer::createSurface()
     throw std::runtime_error("ERROR: Failed to create the surface window.");
 }
 
-void Renderer::drawFrame()
+// Waits until the GPU is done with the next image (and its uniform region). False if the frame must be skipped.
+bool Renderer::acquireNextImage(uint32_t& _imageIdx)
 {
-  CommandBufferManager& commandBufferManager = CommandBufferManager::getInstance();
-  if (commandBufferManager.getCommandBufferCount() == 0) return;
-
+  auto fenceWaitStart = std::chrono::high_resolution_clock::now();
   vkWaitForFences(m_logicalDevice, 1, &m_inFlightFences[m_currentFrame], VK_TRUE, UINT64_MAX);
+  auto fenceWaitEnd   = std::chrono::high_resolution_clock::now();
+
+  m_lastFrameTimings.fenceWait = std::chrono::duration<double, std::milli>
+                                 (fenceWaitEnd - fenceWaitStart).count();
 
   uint32_t imageIdx = 0;
-  VkResult result   = vkAcquireNextImageKHR(m_logicalDevice,
-                                            m_swapChain,
-                                            UINT64_MAX,
-                                            m_imageAvailableSemaphores[m_currentFrame],
-                                            VK_NULL_HANDLE,
-                                            &imageIdx);
-
-  if (result == VK_ERROR_OUT_OF_DATE_KHR)
+  VkResult result   = VK_SUCCESS;
+
+  if (m_isHeadless)
+  { // No swapchain to ask, just cycle through the offscreen images
+    imageIdx = (m_lastImageIdx + 1) % m_swapChainImages.size();
+  }
+  else
   {
-    this->recreateSwapChain();
-    return;
+    result = vkAcquireNextImageKHR(m_logicalDevice,
+                                   m_swapChain,
+                                   UINT64_MAX,
+                                   m_imageAvailableSemaphores[m_currentFrame],
+                                   VK_NULL_HANDLE,
+                                   &imageIdx);
+
+    if (result == VK_ERROR_OUT_OF_DATE_KHR)
+    {
+      this->recreateSwapChain();
+      return false;
+    }
+    else if (result != VK_SUCCESS && result != VK_SUBOPTIMAL_KHR)
+      throw std::runtime_error("ERROR: Failed to acquire swap chain image!");
   }
-  else if (result != VK_SUCCESS && result != VK_SUBOPTIMAL_KHR)
-    throw std::runtime_error("ERROR: Failed to acquire swap chain image!");
 
   // Check if a previous frame is using this image. Wait if so.
   if (m_imagesInFlight[imageIdx] != VK_NULL_HANDLE)
+  {
+    fenceWaitStart = std::chrono::high_resolution_clock::now();
     vkWaitForFences(m_logicalDevice, 1, &m_imagesInFlight[imageIdx], VK_TRUE, UINT64_MAX);
+    fenceWaitEnd   = std::chrono::high_resolution_clock::now();
+
+    m_lastFrameTimings.fenceWait += std::chrono::duration<double, std::milli>
+                                    (fenceWaitEnd - fenceWaitStart).count();
+  }
 
   // Mark the image as in use
   m_imagesInFlight[imageIdx] = m_inFlightFences[m_currentFrame];
 
+  _imageIdx = imageIdx;
+  return true;
+}
+
+void Renderer::drawFrame(const uint32_t _imageIdx)
+{
+  CommandBufferManager& commandBufferManager = CommandBufferManager::getInstance();
+
+  uint32_t imageIdx = _imageIdx;
+  VkResult result   = VK_SUCCESS;
+
   VkSemaphore waitSemaphores[]      = {m_imageAvailableSemaphores[m_currentFrame]};
   VkSemaphore signalSemaphores[]    = {m_renderFinishedSemaphores[m_currentFrame]};
   VkPipelineStageFlags waitStages[] = {VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT};
 
+  // Headless frames have no image to wait for nor presentation to signal
   VkSubmitInfo submitInfo{};
   submitInfo.sType                = VK_STRUCTURE_TYPE_SUBMIT_INFO;
-  submitInfo.waitSemaphoreCount   = 1;
+  submitInfo.waitSemaphoreCount   = m_isHeadless ? 0 : 1;
   submitInfo.pWaitSemaphores      = waitSemaphores;
   submitInfo.pWaitDstStageMask    = waitStages;
   submitInfo.commandBufferCount   = 1;
-  submitInfo.pCommandBuffers      = &commandBufferManager.getBufferAt(imageIdx);
-  submitInfo.signalSemaphoreCount = 1;
+  submitInfo.pCommandBuffers      = &commandBufferManager.getFrameBuffer(m_currentFrame);
+  submitInfo.signalSemaphoreCount = m_isHeadless ? 0 : 1;
   submitInfo.pSignalSemaphores    = signalSemaphores;
 
   vkResetFences(m_logicalDevice, 1, &m_inFlightFences[m_currentFrame]);
@@ -141,6 +218,14 @@ void Renderer::drawFrame()
   if (vkQueueSubmit(m_graphicsQueue, 1, &submitInfo, m_inFlightFences[m_currentFrame]) != VK_SUCCESS)
     throw std::runtime_error("ERROR: Failed to submit draw command buffer!");
 
+  m_lastImageIdx = imageIdx;
+
+  if (m_isHeadless)
+  {
+    m_currentFrame = (m_currentFrame + 1) % MAX_FRAMES_IN_FLIGHT;
+    return;
+  }
+
   VkSwapchainKHR   swapChains[]  = {m_swapChain};
   VkPresentInfoKHR presentInfo{};
   presentInfo.sType              = VK_STRUCTURE_TYPE_PRESENT_INFO_KHR;
@@ -165,6 +250,13 @@ void Renderer::drawFrame()
 
 void Renderer::renderLoop()
 {
+  if (m_isHeadless)
+  {
+    std::cout << "WARNING: Renderer::renderLoop - No window in headless mode. Use renderFrames instead."
+              << std::endl;
+    return;
+  }
+
   static auto  startTime   = std::chrono::high_resolution_clock::now();
          auto  currentTime = std::chrono::high_resolution_clock::now();
          float cumulativeTime = 0.0f;
@@ -207,25 +299,165 @@ void Renderer::renderLoop()
     userInputCtx.scrollY = *m_pUserInputController->m_pScrollY;
     m_pUserInputController->processInput(userInputCtx);
 
-    this->updateCamera();
-    m_scene.update(*m_pCamera, m_deltaTime);
+    this->renderFrame();
+  }
+
+  // Wait until all drawing operations have finished before cleaning up
+  vkDeviceWaitIdle(m_logicalDevice);
+}
+
+// Renders a fixed amount of frames without user input. Works with and without a window.
+void Renderer::renderFrames(const uint32_t                    _frameCount,
+                            std::function<void(const uint32_t)> _frameCallback)
+{
+  auto startTime   = std::chrono::high_resolution_clock::now();
+  auto currentTime = startTime;
+
+  for (uint32_t i=0; i<_frameCount; ++i)
+  {
+    currentTime = std::chrono::high_resolution_clock::now();
+    m_deltaTime = std::chrono::duration<float, std::chrono::seconds::period>
+                  (currentTime - startTime).count();
+    startTime   = currentTime;
+
+    if (!m_isHeadless) glfwPollEvents();
 
-    if (m_scene.anyDescriptorUpdated()) this->setupRenderCommands();
+    this->renderFrame();
 
-    this->drawFrame();
+    if (_frameCallback) _frameCallback(i);
   }
 
-  // Wait until all drawing operations have finished before cleaning up
   vkDeviceWaitIdle(m_logicalDevice);
 }
 
-// Get the extensions required by GLFW and by the validation layers (if enabled)
-std::vector<const char*> Renderer::getGLFWRequiredExtensions()
+void Renderer::renderFrame()
+{
+  using clock = std::chrono::high_resolution_clock;
+  using ms    = std::chrono::duration<double, std::milli>;
+
+  m_lastFrameTimings = FrameTimings{};
+
+  const auto frameStart = clock::now();
+
+  this->updateCamera();
+
+  // Also waits for this frame's previous submission, so its uniform region and command pool are free
+  uint32_t imageIdx = 0;
+  if (!this->acquireNextImage(imageIdx)) return;
+
+  const auto sceneUpdateStart = clock::now();
+  m_scene.update(*m_pCamera, m_deltaTime, m_currentFrame);
+
+  // Whatever was loaded since the last frame has to be on the queue before the frame reads it
+  auto& uploadBatcher = UploadBatcher::getInstance();
+  uploadBatcher.submit();
+  uploadBatcher.collect();
+
+  const auto sceneUpdateEnd = clock::now();
+  m_lastFrameTimings.sceneUpdate = ms(sceneUpdateEnd - sceneUpdateStart).count();
+
+  // Only the current frame's buffer, always recorded from scratch
+  this->setupRenderCommands(imageIdx);
+  m_lastFrameTimings.renderCommands = ms(clock::now() - sceneUpdateEnd).count();
+
+  this->drawFrame(imageIdx);
+
+  m_lastFrameTimings.total = ms(clock::now() - frameStart).count();
+}
+
+std::vector<uint8_t> Renderer::readBackLastFrame()
 {
-  uint32_t     extensionsCount = 0;
-  const char** glfwExtensions  = glfwGetRequiredInstanceExtensions(&extensionsCount);
+  std::vector<uint8_t> result;
 
-  std::vector<const char*> extensions(glfwExtensions, glfwExtensions + extensionsCount);
+  if (!m_isHeadless)
+  {
+    std::cout << "WARNING: Renderer::readBackLastFrame - Only supported in headless mode." << std::endl;
+    return result;
+  }
+
+  auto& bufferManager = MemoryBufferManager::getInstance();
+  auto& commandBufferManager = CommandBufferManager::getInstance();
+
+  const VkDeviceSize size = m_swapChainExtent.width * m_swapChainExtent.height * 4;
+
+  VkBuffer         readBackBuffer;
+  MemoryAllocation readBackMemory;
+  bufferManager.createBuffer(size,
+                             VK_BUFFER_USAGE_TRANSFER_DST_BIT,
+                             VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT |
+                               VK_MEMORY_PROPERTY_HOST_COHERENT_BIT,
+                             &readBackBuffer,
+                             &readBackMemory);
+
+  // The render pass leaves the offscreen images in TRANSFER_SRC_OPTIMAL
+  // and the single time command waits for the queue to be idle, so the frame is finished
+  VkCommandBuffer commandBuffer = commandBufferManager.beginSingleTimeCommand();
+
+  // Finished isn't visible: the render pass' writes still have to be made available to the copy
+  VkImageMemoryBarrier barrier{};
+  barrier.sType                           = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER;
+  barrier.oldLayout                       = VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL;
+  barrier.newLayout                       = VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL;
+  barrier.srcQueueFamilyIndex             = VK_QUEUE_FAMILY_IGNORED;
+  barrier.dstQueueFamilyIndex             = VK_QUEUE_FAMILY_IGNORED;
+  barrier.image                           = m_swapChainImages.at(m_lastImageIdx);
+  barrier.subresourceRange.aspectMask     = VK_IMAGE_ASPECT_COLOR_BIT;
+  barrier.subresourceRange.baseMipLevel   = 0;
+  barrier.subresourceRange.levelCount     = 1;
+  barrier.subresourceRange.baseArrayLayer = 0;
+  barrier.subresourceRange.layerCount     = 1;
+  barrier.srcAccessMask                   = VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT;
+  barrier.dstAccessMask                   = VK_ACCESS_TRANSFER_READ_BIT;
+
+  vkCmdPipelineBarrier(commandBuffer,
+                       VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT,
+                       VK_PIPELINE_STAGE_TRANSFER_BIT,
+                       0,
+                       0, nullptr,
+                       0, nullptr,
+                       1, &barrier);
+
+  VkBufferImageCopy region{};
+  region.bufferOffset                    = 0;
+  region.bufferRowLength                 = 0; // Tightly packed
+  region.bufferImageHeight               = 0;
+  region.imageSubresource.aspectMask     = VK_IMAGE_ASPECT_COLOR_BIT;
+  region.imageSubresource.mipLevel       = 0;
+  region.imageSubresource.baseArrayLayer = 0;
+  region.imageSubresource.layerCount     = 1;
+  region.imageOffset                     = {0, 0, 0};
+  region.imageExtent                     = {m_swapChainExtent.width, m_swapChainExtent.height, 1};
+
+  vkCmdCopyImageToBuffer(commandBuffer,
+                         m_swapChainImages.at(m_lastImageIdx),
+                         VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL,
+                         readBackBuffer,
+                         1,
+                         &region);
+
+  commandBufferManager.endSingleTimeCommand(commandBuffer);
+
+  result.resize(size);
+
+  memcpy(result.data(), readBackMemory.pMapped, size);
+
+  bufferManager.destroyBuffer(readBackBuffer, readBackMemory);
+
+  return result;
+}
+
+// Get the extensions required by GLFW (if there's a window) and by the validation layers (if enabled)
+std::vector<const char*> Renderer::getRequiredExtensions()
+{
+  std::vector<const char*> extensions{};
+
+  if (!m_isHeadless)
+  {
+    uint32_t     extensionsCount = 0;
+    const char** glfwExtensions  = glfwGetRequiredInstanceExtensions(&extensionsCount);
+
+    extensions.assign(glfwExtensions, glfwExtensions + extensionsCount);
+  }
 
   if (ENABLE_VALIDATION_LAYERS) extensions.push_back(VK_EXT_DEBUG_UTILS_EXTENSION_NAME);
 
@@ -307,31 +539,71 @@ void Renderer::createSwapChain()
   vkGetSwapchainImagesKHR(m_logicalDevice, m_swapChain, &imageCount, m_swapChainImages.data());
 }
 
+void Renderer::createOffscreenImages()
+{
+  m_swapChainExtent      = {static_cast<uint32_t>(WIDTH), static_cast<uint32_t>(HEIGTH)};
+  m_swapChainImageFormat = OFFSCREEN_IMAGE_FORMAT;
+
+  VkImageCreateInfo imageInfo{};
+  imageInfo.sType         = VK_STRUCTURE_TYPE_IMAGE_CREATE_INFO;
+  imageInfo.imageType     = VK_IMAGE_TYPE_2D;
+  imageInfo.extent.width  = m_swapChainExtent.width;
+  imageInfo.extent.height = m_swapChainExtent.height;
+  imageInfo.extent.depth  = 1;
+  imageInfo.mipLevels     = 1;
+  imageInfo.arrayLayers   = 1;
+  imageInfo.format        = m_swapChainImageFormat;
+  imageInfo.tiling        = VK_IMAGE_TILING_OPTIMAL;
+  imageInfo.initialLayout = VK_IMAGE_LAYOUT_UNDEFINED;
+  imageInfo.usage         = VK_IMAGE_USAGE_COLOR_ATTACHMENT_BIT | // Render target
+                             VK_IMAGE_USAGE_TRANSFER_SRC_BIT;     // Read back
+  imageInfo.sharingMode   = VK_SHARING_MODE_EXCLUSIVE;
+  imageInfo.samples       = VK_SAMPLE_COUNT_1_BIT;
+  imageInfo.flags         = 0;
+
+  m_swapChainImages.resize(OFFSCREEN_IMAGE_COUNT);
+  m_offscreenImagesMemory.resize(OFFSCREEN_IMAGE_COUNT);
+
+  for (size_t i=0; i<m_swapChainImages.size(); ++i)
+    createVkImage(imageInfo, m_offscreenImagesMemory.at(i), &m_swapChainImages.at(i));
+
+  m_lastImageIdx = OFFSCREEN_IMAGE_COUNT - 1;
+}
+
 void Renderer::cleanUpSwapChain()
 {
   if (MSAA_ENABLED)
   { // FIXME: Validation layers complain when MSAA is enabled and the window is resized. (Issue #1)
     vkDestroyImageView(m_logicalDevice, m_colorImageView, nullptr);
     vkDestroyImage(m_logicalDevice, m_colorImage, nullptr);
-    vkFreeMemory(m_logicalDevice, m_colorImageMemory, nullptr);
+    MemoryAllocator::getInstance().free(m_colorImageMemory);
   }
 
   vkDestroyImageView(m_logicalDevice, m_depthImageView, nullptr);
   vkDestroyImage(m_logicalDevice, m_depthImage, nullptr);
-  vkFreeMemory(m_logicalDevice, m_depthMemory, nullptr);
+  MemoryAllocator::getInstance().free(m_depthMemory);
 
   for (auto& b : m_swapChainFrameBuffers)
     vkDestroyFramebuffer(m_logicalDevice, b, nullptr);
 
-  CommandBufferManager::getInstance().freeBuffers();
-
   m_pRenderPipelineManager->cleanUp();
   vkDestroyRenderPass(m_logicalDevice, m_renderPass, nullptr);
 
   for (auto& imageView : m_swapChainImageViews)
     vkDestroyImageView(m_logicalDevice, imageView, nullptr);
 
-  vkDestroySwapchainKHR(m_logicalDevice, m_swapChain, nullptr);
+  if (m_isHeadless)
+  {
+    for (size_t i=0; i<m_swapChainImages.size(); ++i)
+    {
+      vkDestroyImage(m_logicalDevice, m_swapChainImages.at(i), nullptr);
+      MemoryAllocator::getInstance().free(m_offscreenImagesMemory.at(i));
+    }
+    m_swapChainImages.clear();
+    m_offscreenImagesMemory.clear();
+  }
+  else
+    vkDestroySwapchainKHR(m_logicalDevice, m_swapChain, nullptr);
 }
 
 void Renderer::recreateSwapChain()
@@ -355,8 +627,6 @@ void Renderer::recreateSwapChain()
   if (MSAA_ENABLED) this->createColorResources();
   this->createDepthResources();
   this->createFrameBuffers();
-
-  this->setupRenderCommands();
 }
 
 // Creates an image view for each image in the swap chain.
@@ -374,6 +644,10 @@ void Renderer::createImageViews()
 
 void Renderer::createRenderPass()
 {
+  // Offscreen images are read back instead of presented
+  const VkImageLayout outputLayout = m_isHeadless ? VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL
+                                                  : VK_IMAGE_LAYOUT_PRESENT_SRC_KHR;
+
   VkAttachmentDescription colorAttachment{};
   colorAttachment.format         = m_swapChainImageFormat;
   colorAttachment.samples        = m_msaaSampleCount;
@@ -383,7 +657,7 @@ void Renderer::createRenderPass()
   colorAttachment.stencilStoreOp = VK_ATTACHMENT_STORE_OP_DONT_CARE;
   colorAttachment.initialLayout  = VK_IMAGE_LAYOUT_UNDEFINED; // We are clearing it anyway
   colorAttachment.finalLayout    = MSAA_ENABLED ? VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL
-                                                : VK_IMAGE_LAYOUT_PRESENT_SRC_KHR;
+                                                : outputLayout;
 
   VkAttachmentDescription depthAttachment{};
   depthAttachment.format         = this->findDepthFormat();
@@ -403,7 +677,7 @@ void Renderer::createRenderPass()
   resolveAttachment.stencilLoadOp  = VK_ATTACHMENT_LOAD_OP_DONT_CARE;
   resolveAttachment.stencilStoreOp = VK_ATTACHMENT_STORE_OP_DONT_CARE;
   resolveAttachment.initialLayout  = VK_IMAGE_LAYOUT_UNDEFINED; // We are clearing it anyway
-  resolveAttachment.finalLayout    = VK_IMAGE_LAYOUT_PRESENT_SRC_KHR;
+  resolveAttachment.finalLayout    = outputLayout;
 
   std::vector<VkAttachmentDescription> attachments {colorAttachment, depthAttachment};
   if (MSAA_ENABLED) attachments.push_back(resolveAttachment);
@@ -493,7 +767,7 @@ void Renderer::createFrameBuffers()
   }
 }
 
-void Renderer::setupRenderCommands()
+void Renderer::setupRenderCommands(const uint32_t _imageIdx)
 {
   CommandBufferManager& commandBufferManager = CommandBufferManager::getInstance();
 
@@ -501,72 +775,130 @@ void Renderer::setupRenderCommands()
   clearValues[0].color        = CLEAR_COLOR_GREY;
   clearValues[1].depthStencil = {1.0f, 0};
 
-  commandBufferManager.allocateNCommandBuffers(m_swapChainFrameBuffers.size());
+  VkCommandBuffer& commandBuffer = commandBufferManager.getFrameBuffer(m_currentFrame);
+
+  commandBufferManager.beginFrameCommand(m_currentFrame);
+
+  // Start render pass //TODO: Refactor into own function
+  VkRenderPassBeginInfo renderPassInfo{};
+  renderPassInfo.sType             = VK_STRUCTURE_TYPE_RENDER_PASS_BEGIN_INFO;
+  renderPassInfo.renderPass        = m_renderPass;
+  renderPassInfo.framebuffer       = m_swapChainFrameBuffers.at(_imageIdx);
+  renderPassInfo.renderArea.offset = {0,0};
+  renderPassInfo.renderArea.extent = m_swapChainExtent;
+  renderPassInfo.clearValueCount   = clearValues.size();
+  renderPassInfo.pClearValues      = clearValues.data();
+
+  // Resolve everything that touches the scene or creates pipelines here, the workers only record
+  m_drawList.clear();
+  m_drawList.reserve(m_scene.m_renderableObjects.size());
 
-  // Record the command buffers TODO: Refactor into own function
-  for (size_t i=0; i<commandBufferManager.getCommandBufferCount(); ++i)
+  for (const auto& object : m_scene.m_renderableObjects)
   {
-    commandBufferManager.beginRecordingCommand(i);
-
-    // Start render pass //TODO: Refactor into own function
-    VkRenderPassBeginInfo renderPassInfo{};
-    renderPassInfo.sType             = VK_STRUCTURE_TYPE_RENDER_PASS_BEGIN_INFO;
-    renderPassInfo.renderPass        = m_renderPass;
-    renderPassInfo.framebuffer       = m_swapChainFrameBuffers.at(i);
-    renderPassInfo.renderArea.offset = {0,0};
-    renderPassInfo.renderArea.extent = m_swapChainExtent;
-    renderPassInfo.clearValueCount   = clearValues.size();
-    renderPassInfo.pClearValues      = clearValues.data();
-
-    vkCmdBeginRenderPass(commandBufferManager.getBufferAt(i),
-                         &renderPassInfo,
-                         VK_SUBPASS_CONTENTS_INLINE);
-
-    for (const auto& object : m_scene.m_renderableObjects)
-    {
-      auto mesh = m_scene.getObjectMesh(object);
-      if (mesh.get() == nullptr) continue;
-
-      const int numLights = m_scene.getLightCount();
-
-      vkCmdBindPipeline(commandBufferManager.getBufferAt(i),
-                        VK_PIPELINE_BIND_POINT_GRAPHICS,
-                        m_pRenderPipelineManager->getOrCreatePipeline(m_swapChainExtent,
-                                                                      *object.m_pMaterial));
-
-      vkCmdPushConstants(commandBufferManager.getBufferAt(i),
-                         m_pRenderPipelineManager->getPipelineLayout(),
-                         VK_SHADER_STAGE_FRAGMENT_BIT,
-                         0,
-                         sizeof(int),
-                         &numLights);
-
-      // Bind the vertex buffers
-      VkBuffer     vertexBuffers[] = {mesh->m_vertexBuffer};
-      VkDeviceSize offsets[]       = {0};
-      vkCmdBindVertexBuffers(commandBufferManager.getBufferAt(i), 0, 1, vertexBuffers, offsets);
-
-      vkCmdBindIndexBuffer(commandBufferManager.getBufferAt(i),
-                           mesh->m_indexBuffer,
-                           0,
-                           VK_INDEX_TYPE_UINT32);
-
-      vkCmdBindDescriptorSets(commandBufferManager.getBufferAt(i),
-                              VK_PIPELINE_BIND_POINT_GRAPHICS,
-                              m_pRenderPipelineManager->getPipelineLayout(),
-                              0,
-                              1,
-                              &object.m_descriptorSet,
-                              0,
-                              nullptr);
-
-      vkCmdDrawIndexed(commandBufferManager.getBufferAt(i),
-                       mesh->m_indices.size(),
-                       1, 0, 0, 0);
-    }
+    if (!m_scene.isObjectVisible(object.m_UBOoffsetIdx)) continue;
+
+    auto mesh = m_scene.getObjectMesh(object);
+    if (mesh.get() == nullptr) continue;
+
+    // Always in the vertex format the material reads, see Scene::getObjectMesh
+    const StdMaterial& material = *object.m_pMaterial;
+
+    m_drawList.add(m_pRenderPipelineManager->getOrCreatePipeline(m_swapChainExtent, material),
+                   material.supportsInstancing() ?
+                     m_pRenderPipelineManager->getOrCreatePipeline(m_swapChainExtent, material, true) :
+                     VK_NULL_HANDLE,
+                   material,
+                   *mesh, // Kept alive by the scene
+                   m_scene.getObjectLod(object.m_UBOoffsetIdx),
+                   object.m_descriptorSets.at(m_currentFrame),
+                   object.m_UBOoffsetIdx);
+  }
+
+  // Groups the draws sharing state, so recordDraws can skip the redundant binds and instance them
+  m_drawList.sort();
+
+  // The instances are read in draw order
+  for (uint32_t i=0; i<m_drawList.size(); ++i)
+    m_scene.writeInstance(m_currentFrame, i, m_drawList.getObjectIdx(i));
+
+  if (m_drawList.size() > 0) m_scene.flushInstances(m_currentFrame);
+
+  // Batches, not objects, since each one is a single draw call
+  const size_t drawCount   = m_drawList.batchCount();
+  const size_t threadCount = std::min<size_t>(commandBufferManager.getSecondarySlotCount(),
+                                              drawCount / MIN_DRAWS_PER_RECORDING_THREAD);
+
+  if (threadCount <= 1)
+  {
+    vkCmdBeginRenderPass(commandBuffer, &renderPassInfo, VK_SUBPASS_CONTENTS_INLINE);
+    m_lastDrawStats = this->recordDraws(commandBuffer, 0, drawCount);
+    m_lastDrawStats.culledObjects = m_scene.getCulledCount();
+    commandBufferManager.endFrameCommand(m_currentFrame);
+    return;
+  }
+
+  vkCmdBeginRenderPass(commandBuffer, &renderPassInfo, VK_SUBPASS_CONTENTS_SECONDARY_COMMAND_BUFFERS);
+
+  VkCommandBufferInheritanceInfo inheritanceInfo{};
+  inheritanceInfo.sType       = VK_STRUCTURE_TYPE_COMMAND_BUFFER_INHERITANCE_INFO;
+  inheritanceInfo.renderPass  = m_renderPass;
+  inheritanceInfo.subpass     = 0;
+  inheritanceInfo.framebuffer = m_swapChainFrameBuffers.at(_imageIdx); // Optional, but may help the driver
 
-    commandBufferManager.endRecordingCommand(i);
+  // Each chunk owns its slot (and therefore its pool), so no synchronization is needed while recording
+  const size_t   chunkSize = (drawCount + threadCount - 1) / threadCount;
+  const uint32_t frameIdx  = m_currentFrame;
+
+  std::vector<std::future<DrawStats>> recordings;
+  recordings.reserve(threadCount);
+
+  for (uint32_t slot=0; slot<threadCount; ++slot)
+  {
+    const size_t first = slot * chunkSize;
+    const size_t last  = std::min(first + chunkSize, drawCount);
+
+    recordings.push_back( m_pRecordingThreadPool->submit([=, &commandBufferManager, &inheritanceInfo]()
+    {
+      VkCommandBuffer& secondaryBuffer = commandBufferManager.beginSecondaryCommand(frameIdx,
+                                                                                    slot,
+                                                                                    inheritanceInfo);
+      const DrawStats stats = this->recordDraws(secondaryBuffer, first, last);
+      commandBufferManager.endSecondaryCommand(frameIdx, slot);
+      return stats;
+    }));
   }
+
+  // get() rethrows any exception from the workers
+  m_lastDrawStats = DrawStats{};
+  for (auto& recording : recordings) m_lastDrawStats += recording.get();
+  m_lastDrawStats.culledObjects = m_scene.getCulledCount();
+
+  std::vector<VkCommandBuffer> secondaryBuffers(threadCount);
+  for (uint32_t slot=0; slot<threadCount; ++slot)
+    secondaryBuffers.at(slot) = commandBufferManager.getSecondaryBuffer(frameIdx, slot);
+
+  // Executed in order, so the draw order is the same as the single threaded path
+  vkCmdExecuteCommands(commandBuffer, secondaryBuffers.size(), secondaryBuffers.data());
+
+  commandBufferManager.endFrameCommand(m_currentFrame);
+}
+
+// Records the sorted batches in [_first, _last). Doesn't touch any shared state, so it can be called from workers.
+DrawStats Renderer::recordDraws(VkCommandBuffer& _commandBuffer, const size_t _first, const size_t _last)
+{
+  // The matrices and instances of this frame live in their own regions
+  const std::array<uint32_t, DYNAMIC_BINDING_COUNT> dynamicOffsets =
+  {
+    m_scene.getMVPNDynamicOffset(m_currentFrame),
+    m_scene.getInstancesDynamicOffset(m_currentFrame)
+  };
+
+  return m_drawList.record(_commandBuffer,
+                           _first,
+                           _last,
+                           m_pRenderPipelineManager->getPipelineLayout(),
+                           dynamicOffsets,
+                           m_scene.getLightCount());
 }
 
 void Renderer::createDepthResources()
@@ -696,16 +1028,34 @@ void Renderer::cleanUp()
     vkDestroyFence(m_logicalDevice, m_inFlightFences.at(i), nullptr);
   }
 
+  // Frees the staging buffers still waiting for their uploads
+  UploadBatcher::getInstance().cleanUp();
+
   this->cleanUpSwapChain();
 
   m_scene.cleanUp();
   m_pRenderPipelineManager.reset();
 
+  // Saved for the next run
+  PipelineCache::getInstance().cleanUp();
+  // No materials left using them
+  ShaderRegistry::getInstance().cleanUp();
+  TextureRegistry::getInstance().cleanUp();
+  // The textures were the only users
+  SamplerCache::getInstance().cleanUp();
+
   CommandBufferManager::getInstance().cleanUp();
+  m_pRecordingThreadPool.reset();
+
+  MemoryAllocator::getInstance().printStats();
+  MemoryAllocator::getInstance().cleanUp();
 
   vkDestroyDevice(m_logicalDevice, nullptr);
-  vkDestroySurfaceKHR(m_vkInstance, m_surface, nullptr);
+  if (m_surface != VK_NULL_HANDLE) vkDestroySurfaceKHR(m_vkInstance, m_surface, nullptr);
   vkDestroyInstance(m_vkInstance, nullptr);
+
+  if (m_isHeadless) return;
+
   glfwDestroyWindow(m_pWindow);
   glfwTerminate();
 }
@@ -30,8 +30,13 @@
 #include <functional>
 
 #include "Managers/VPDeviceManagement.hpp"
+#include "Managers/VPUploadBatcher.hpp"
+#include "Managers/VPPipelineCache.hpp"
+#include "Managers/VPSamplerCache.hpp"
 #include "VPScene.hpp"
 #include "VPUserInputController.hpp"
+#include "VPThreadPool.hpp"
+#include "VPDrawList.hpp"
 
 namespace vpe
 {
@@ -39,8 +44,24 @@ constexpr int WIDTH  = 800;
 constexpr int HEIGTH = 600;
 constexpr int MAX_FRAMES_IN_FLIGHT = 2;
 
+// Headless mode renders into these instead of the swapchain images
+constexpr uint32_t OFFSCREEN_IMAGE_COUNT  = 3;
+constexpr VkFormat OFFSCREEN_IMAGE_FORMAT = VK_FORMAT_B8G8R8A8_UNORM;
+
 constexpr uint32_t DEFAULT_MATERIAL_IDX = 0;
 
+// Below this (in draw calls), spreading the recording across threads costs more than it saves
+constexpr size_t MIN_DRAWS_PER_RECORDING_THREAD = 256;
+
+// Milliseconds spent in each phase of the last rendered frame
+struct FrameTimings
+{
+  double sceneUpdate    = 0.0;
+  double renderCommands = 0.0;
+  double fenceWait      = 0.0;
+  double total          = 0.0;
+};
+
 constexpr VkClearColorValue CLEAR_COLOR_BLACK {{0.0f,  0.0f,  0.0f,  1.0f}};
 constexpr VkClearColorValue CLEAR_COLOR_GREY  {{0.25f, 0.25f, 0.25f, 1.0f}};
 constexpr VkClearColorValue CLEAR_COLOR_SKY   {{0.53f, 0.81f, 0.92f, 1.0f}};
@@ -85,20 +106,45 @@ public:
 
   UserInputController* m_pUserInputController;
 
-  void init();
+  // Headless: No window, surface nor swapchain. Renders into offscreen images instead.
+  void init(const bool _headless = false);
   void renderLoop();
+  // The callback (optional) is called after each frame with its index
+  void renderFrames(const uint32_t _frameCount,
+                    std::function<void(const uint32_t)> _frameCallback = nullptr);
   void cleanUp();
 
+  // Copies the last rendered frame to the CPU (B8G8R8A8, tightly packed). Headless only.
+  std::vector<uint8_t> readBackLastFrame();
+
+  inline bool       isHeadless()   const { return m_isHeadless; }
+  inline VkExtent2D getExtent()    const { return m_swapChainExtent; }
+
+  inline const FrameTimings& getLastFrameTimings() const { return m_lastFrameTimings; }
+  inline const DrawStats&    getLastDrawStats()    const { return m_lastDrawStats; }
+
   // TODO: Merge both into addSceneObject
   inline uint32_t addLight(Light& _light)
   {
     return m_scene.scheduleLightCreation(_light);
   }
 
+  // The mesh is imported in the background. The object isn't drawn until it's ready.
   inline uint32_t createObject(const char* _meshPath)
   {
     return m_scene.scheduleObjCreation(_meshPath);
   }
+
+  // Blocks until every mesh and texture requested so far is loaded. They're uploaded with the next frame.
+  inline void waitForPendingLoads() { m_scene.waitForPendingLoads(); }
+
+  // Optional. Compiles the pipelines of every material now instead of on their first draw.
+  // Applies the scheduled creations first: changing the light count recreates every pipeline.
+  inline void warmUpPipelines()
+  {
+    m_scene.applyScheduledCreations();
+    m_pRenderPipelineManager->warmUp(m_swapChainExtent, m_scene.m_pMaterials);
+  }
   // TODO: deleteSceneObject
 
   inline uint32_t createMaterial(const char* _vertShaderPath,
@@ -117,6 +163,14 @@ public:
     m_scene.scheduleMaterialImageChange(_matIdx, _path, DescriptorFlags::NORMAL_MAP);
   }
 
+  // Device memory for the streamed textures (.vptex), see TextureStreamer. DEFAULT_TEXTURE_BUDGET by default.
+  inline void setTextureBudget(const VkDeviceSize _budget) { m_scene.setTextureBudget(_budget); }
+
+  inline const TextureStreamingStats& getTextureStreamingStats() const
+  {
+    return m_scene.getTextureStreamingStats();
+  }
+
   inline void setObjMaterial(const uint32_t _objIdx, const uint32_t _matIdx)
   {
     m_scene.scheduleObjMaterialChange(_objIdx, _matIdx);
@@ -155,6 +209,7 @@ public:
   }
 
 private:
+  bool                    m_isHeadless;
   GLFWwindow*             m_pWindow;
 
   std::shared_ptr<Camera> m_pCamera; // TODO: Multi-camera
@@ -162,13 +217,16 @@ private:
 
   Scene m_scene;
 
-  float m_deltaTime;
+  float        m_deltaTime;
+  FrameTimings m_lastFrameTimings;
+  DrawStats    m_lastDrawStats;
 
   VkInstance       m_vkInstance;
   VkPhysicalDevice m_physicalDevice; // Implicitly destroyed alongside m_vkInstance
   VkDevice         m_logicalDevice;
   VkQueue          m_graphicsQueue; // Implicitly destroyed alongside m_logicalDevice
   VkQueue          m_presentQueue; // Implicitly destroyed alongside m_logicalDevice
+  VkQueue          m_transferQueue; // Implicitly destroyed alongside m_logicalDevice
 
   deviceManagement::QueueFamilyIndices_t m_queueFamiliesIndices;
 
@@ -179,6 +237,10 @@ private:
   std::vector<VkImage>     m_swapChainImages; // Implicitly destroyed alongside m_swapChain
   std::vector<VkImageView> m_swapChainImageViews;
 
+  // Headless only. Stand-ins for the swapchain images.
+  std::vector<MemoryAllocation> m_offscreenImagesMemory;
+  uint32_t                      m_lastImageIdx;
+
   VkRenderPass m_renderPass;
   std::shared_ptr<StdRenderPipelineManager> m_pRenderPipelineManager;
   std::vector<VkFramebuffer> m_swapChainFrameBuffers;
@@ -189,26 +251,32 @@ private:
   std::vector<VkFence>     m_inFlightFences;
   std::vector<VkFence>     m_imagesInFlight;
 
-  VkImage        m_depthImage;
-  VkDeviceMemory m_depthMemory;
-  VkImageView    m_depthImageView;
+  VkImage          m_depthImage;
+  MemoryAllocation m_depthMemory;
+  VkImageView      m_depthImageView;
 
   // MSAA
   VkImage               m_colorImage;
   VkImageView           m_colorImageView;
-  VkDeviceMemory        m_colorImageMemory;
+  MemoryAllocation      m_colorImageMemory;
   VkSampleCountFlagBits m_msaaSampleCount;
 
   VkDebugUtilsMessengerEXT m_debugMessenger;
 
+  // Multithreaded command recording
+  std::unique_ptr<ThreadPool> m_pRecordingThreadPool;
+  DrawList                    m_drawList;
+
   void initWindow();
   void initVulkan();
-  void drawFrame();
+  void renderFrame();
+  bool acquireNextImage(uint32_t& _imageIdx);
+  void drawFrame(const uint32_t _imageIdx);
 
   void createSurface();
 
   // Validation layers and extensions
-  std::vector<const char*> getGLFWRequiredExtensions();
+  std::vector<const char*> getRequiredExtensions();
 
   // Swapchain
   VkExtent2D chooseSwapExtent(const VkSurfaceCapabilitiesKHR& _capabilities);
@@ -216,6 +284,7 @@ private:
   void       cleanUpSwapChain();
   void       recreateSwapChain();
   void       createImageViews();
+  void       createOffscreenImages();
 
   // Pipeline
   void createRenderPass();
@@ -223,7 +292,8 @@ private:
   void createFrameBuffers();
 
   // Command Buffers
-  void setupRenderCommands();
+  void setupRenderCommands(const uint32_t _imageIdx);
+  DrawStats recordDraws(VkCommandBuffer& _commandBuffer, const size_t _first, const size_t _last);
 
   // Shaders
   VkShaderModule createShaderModule(const std::vector<char>& _code);
@@ -234,6 +304,9 @@ private:
 
     m_pCamera->setAspectRatio( static_cast<float>(m_swapChainExtent.width) /
                               static_cast<float>(m_swapChainExtent.height) );
+
+    // The textures' footprints are in pixels
+    m_scene.setViewportHeight(m_swapChainExtent.height);
   }
 
   void     createDepthResources();
@@ -1,4 +1,9 @@
 #include "VPResourcesLoader.hpp"
+#include "VPMeshCache.hpp"
+#include "VPMeshOptimizer.hpp"
+#include "VPMeshSimplifier.hpp"
+#include "VPHash.hpp"
+#include "VPTextureFile.hpp"
 #include <iostream>
 
 #ifndef NDEBUG
@@ -7,6 +12,12 @@
 
 namespace vpe::resourcesLoader
 {
+  // Part of the mesh cache key, changing them invalidates the cached meshes
+  constexpr unsigned int IMPORT_FLAGS    = aiProcess_Triangulate |
+                                           aiProcess_GenSmoothNormals |
+                                           aiProcess_CalcTangentSpace;
+  constexpr float        SMOOTHING_ANGLE = 80.0f;
+
   std::vector<char> parseShaderFile(const char* _fileName)
   {
     // Read the file from the end and as a binary file
@@ -37,14 +48,38 @@ namespace vpe::resourcesLoader
     {
       loadEmptyImage(&result);
     }
+    else if (textureFile::isTextureFile(_path))
+    {
+      if (textureFile::load(_path, result)) return result;
+    }
     else
     {
-      int dummy = 0;
-      result.pPixels   = stbi_load(_path, &result.width, &result.heigth, &dummy, STBI_rgb_alpha);
-      result.mipLevels = std::floor(std::log2(std::max(result.width, result.heigth))) + 1;
+      // Converted offline, with its mips
+      const std::string texturePath = textureFile::findFor(_path);
+      if (!texturePath.empty() && textureFile::load(texturePath.c_str(), result)) return result;
+
+      // Read once for both the hash and the decoder
+      const MappedFile file(_path);
+      if (file.isValid())
+      {
+        int dummy = 0;
+        result.contentHash = fnv1a(file.data(), file.size());
+        result.pPixels     = stbi_load_from_memory(file.data<stbi_uc>(),
+                                                   static_cast<int>(file.size()),
+                                                   &result.width,
+                                                   &result.heigth,
+                                                   &dummy,
+                                                   STBI_rgb_alpha);
+        result.mipLevels   = std::floor(std::log2(std::max(result.width, result.heigth))) + 1;
+      }
     }
 
-    if (result.pPixels == nullptr) { loadEmptyImage(&result); }
+    // The failed ones are the same texture as the empty one
+    if (result.pPixels == nullptr)
+    {
+      result = ImageData{};
+      loadEmptyImage(&result);
+    }
 
     return result;
   }
@@ -121,25 +156,106 @@ namespace vpe::resourcesLoader
     return result;
   }
 
-  std::pair< std::vector<Vertex>, std::vector<uint32_t> > loadModel(const char* _path)
+  void packModel(const std::vector<Vertex>&                _vertices,
+                 const std::vector<std::vector<uint32_t>>& _lodIndices,
+                 const std::vector<float>&                 _lodErrors,
+                 const VertexFormat                        _format,
+                 ModelData&                                _result)
+  {
+    std::vector<uint32_t> indices;
+    _result.lods.clear();
+
+    for (size_t lod=0; lod<_lodIndices.size(); ++lod)
+    {
+      LodRange range{};
+      range.firstIndex = indices.size();
+      range.indexCount = _lodIndices[lod].size();
+      range.error      = lod < _lodErrors.size() ? _lodErrors[lod] : 0.0f;
+
+      _result.lods.push_back(range);
+      indices.insert(indices.end(), _lodIndices[lod].begin(), _lodIndices[lod].end());
+    }
+
+    _result.vertexFormat = _format;
+    _result.vertexCount  = _vertices.size();
+    _result.indexCount   = indices.size();
+    _result.bounds       = computeBounds(_vertices);
+    _result.quantization = Quantization{};
+
+    if (_format == VertexFormat::PACKED)
+    {
+      _result.quantization = Quantization::fromAABB(_result.bounds.aabbMin, _result.bounds.aabbMax);
+
+      _result.vertexBlob.resize(_vertices.size() * sizeof(PackedVertex));
+      auto pPacked = reinterpret_cast<PackedVertex*>( _result.vertexBlob.data() );
+
+      for (size_t i=0; i<_vertices.size(); ++i)
+        pPacked[i] = PackedVertex::pack(_vertices[i], _result.quantization);
+    }
+    else
+    {
+      _result.vertexBlob.resize(_vertices.size() * sizeof(Vertex));
+      memcpy(_result.vertexBlob.data(), _vertices.data(), _result.vertexBlob.size());
+    }
+
+    // Half the index bandwidth and memory for most meshes
+    if (_vertices.size() <= UINT16_MAX)
+    {
+      _result.indexType = VK_INDEX_TYPE_UINT16;
+      _result.indexBlob.resize(indices.size() * sizeof(uint16_t));
+      auto pIndices = reinterpret_cast<uint16_t*>( _result.indexBlob.data() );
+
+      for (size_t i=0; i<indices.size(); ++i)
+        pIndices[i] = static_cast<uint16_t>(indices[i]);
+    }
+    else
+    {
+      _result.indexType = VK_INDEX_TYPE_UINT32;
+      _result.indexBlob.resize(indices.size() * sizeof(uint32_t));
+      memcpy(_result.indexBlob.data(), indices.data(), _result.indexBlob.size());
+    }
+  }
+
+  ModelData loadModel(const char* _path, const VertexFormat _format)
   {
 #ifndef NDEBUG
     const auto startTime = std::chrono::high_resolution_clock::now();
 #endif
 
-    std::vector<Vertex>   vertices;
-    std::vector<uint32_t> indices;
+    ModelData result{};
 
-    if (_path == nullptr) return std::make_pair(vertices, indices);
+    if (_path == nullptr) return result;
+
+    // Hashing the file is way cheaper than importing it
+    uint64_t cacheKey = 0;
+    {
+      const MappedFile source(_path);
+      if (source.isValid())
+      {
+        cacheKey = fnv1a(source.data(), source.size());
+        cacheKey = fnv1a(IMPORT_FLAGS, cacheKey);
+        cacheKey = fnv1a(SMOOTHING_ANGLE, cacheKey);
+        cacheKey = fnv1a(_format, cacheKey);
+      }
+    }
+
+    const std::string cachePath = meshCache::getPath(_path, _format);
+
+    if (cacheKey != 0 && meshCache::load(cachePath, cacheKey, result))
+    {
+#ifndef NDEBUG
+      const auto duration = std::chrono::duration<float, std::chrono::milliseconds::period>
+                            (std::chrono::high_resolution_clock::now() - startTime).count();
+      std::cout << _path << " loaded from the cache in " << duration << "ms." << std::endl;
+#endif
+      return result;
+    }
 
     Assimp::Importer importer;
     // Generate Smooth normals if not already present in the model
-    importer.SetPropertyFloat("AI_CONFIG_PP_GSN_MAX_SMOOTHING_ANGLE", 80.0f);
+    importer.SetPropertyFloat("AI_CONFIG_PP_GSN_MAX_SMOOTHING_ANGLE", SMOOTHING_ANGLE);
 
-    const auto postProcessingFlags = aiProcess_Triangulate |
-                                     aiProcess_GenSmoothNormals |
-                                     aiProcess_CalcTangentSpace;
-    const aiScene* assimpScene = importer.ReadFile(_path, postProcessingFlags);
+    const aiScene* assimpScene = importer.ReadFile(_path, IMPORT_FLAGS);
 
     // Load model into an Assimp's Scene, optimized for realtime
     //const aiScene* assimpScene = importer.ReadFile(_path, aiProcessPreset_TargetRealtime_MaxQuality);
@@ -151,14 +267,14 @@ namespace vpe::resourcesLoader
       std::cout << "ERROR: resourcesLoader::loadModel - " << _path
                 << " model is not valid. Skipping." << std::endl;
 
-      return std::make_pair(vertices, indices);
+      return result;
     }
     if (!assimpScene->HasMeshes())
     {
       std::cout << "ERROR: resourcesLoader::loadModel - " << _path
                 << " has no meshes. Skipping." << std::endl;
 
-      return std::make_pair(vertices, indices);
+      return result;
     }
     if (assimpScene->HasAnimations())
     {
@@ -187,8 +303,35 @@ namespace vpe::resourcesLoader
     if (assimpScene->mMeshes[0]->HasTangentsAndBitangents())
       std::cout << "There are tangents!" << std::endl;
 
-    indices  = extractIndicesFromMesh(assimpScene->mMeshes[0]);
-    vertices = extractVerticesFromMesh(assimpScene->mMeshes[0]);
+    auto indices  = extractIndicesFromMesh(assimpScene->mMeshes[0]);
+    auto vertices = extractVerticesFromMesh(assimpScene->mMeshes[0]);
+
+    if (vertices.empty() || indices.empty()) return result;
+
+    // Done once here, the cache stores the optimized mesh
+    {
+      const auto report = meshOptimizer::optimize(vertices, indices);
+
+      std::cout << "NOTE: resourcesLoader::loadModel - " << _path << " optimized. "
+                << "Vertices: " << report.vertexCountBefore << " -> " << report.vertexCountAfter
+                << ", ACMR: "   << report.before.acmr << " -> " << report.after.acmr
+                << ", ATVR: "   << report.before.atvr << " -> " << report.after.atvr << std::endl;
+    }
+
+    // Also done once here. Every LOD shares the optimized vertices.
+    std::vector<float> lodErrors;
+    const auto lodIndices = meshSimplifier::generateLods(vertices,
+                                                         indices,
+                                                         computeBounds(vertices).sphereRadius,
+                                                         lodErrors);
+
+    std::cout << "NOTE: resourcesLoader::loadModel - " << _path << " LOD triangles:";
+    for (const auto& lod : lodIndices) std::cout << " " << lod.size() / 3;
+    std::cout << std::endl;
+
+    packModel(vertices, lodIndices, lodErrors, _format, result);
+
+    if (cacheKey != 0) meshCache::save(cachePath, cacheKey, result);
 
 #ifndef NDEBUG
     const auto currentTime = std::chrono::high_resolution_clock::now();
@@ -197,6 +340,6 @@ namespace vpe::resourcesLoader
     std::cout << _path << " loaded in " << duration << "ms." << std::endl;
 #endif
 
-    return std::make_pair(vertices, indices);
+    return result;
   }
 } // namespace vpe::resourceslLoader
@@ -9,13 +9,22 @@
 
 #include <vector>
 #include <fstream>
+#include <memory>
 
 #include "VPVertex.hpp"
+#include "VPBounds.hpp"
+#include "VPLod.hpp"
+#include "VPMappedFile.hpp"
 
 namespace vpe
 {
 const char* const DEFAULT_VERT = "../src/Shaders/vert.spv";
 const char* const DEFAULT_FRAG = "../src/Shaders/frag.spv";
+// DEFAULT_VERT compiled with INSTANCED defined. Optional, without it there's no instancing.
+const char* const DEFAULT_VERT_INSTANCED = "../src/Shaders/vert_instanced.spv";
+// DEFAULT_VERT compiled with PACKED_VERTEX defined. Optional, without it the meshes use the full Vertex.
+const char* const DEFAULT_VERT_PACKED           = "../src/Shaders/vert_packed.spv";
+const char* const DEFAULT_VERT_PACKED_INSTANCED = "../src/Shaders/vert_packed_instanced.spv";
 const char* const DEFAULT_TEX  = "VP_DEFAULT_TEX";
 const char* const EMPTY_TEX    = "VP_EMPTY_TEX";
 } // namespace vpe
@@ -30,19 +39,84 @@ namespace vpe::resourcesLoader
     int      mipLevels = 1;
     VkFormat format    = VK_FORMAT_R8G8B8A8_UNORM;
     stbi_uc* pPixels   = nullptr;
+    uint64_t contentHash = 0; // Of the file. The built-in images have their own, see loadImage.
 
-    inline int size() { return width * heigth * channels; }
+    // Precomputed mip chain (.vptex), read straight from the mapping. pPixels stays null.
+    std::shared_ptr<MappedFile>    pFile;
+    std::vector<VkBufferImageCopy> mips; // bufferOffset is relative to the start of the file
+
+    // 4x4 texels per block for the compressed formats, only possible with a precomputed chain
+    uint32_t blockExtent = 1;
+    uint32_t blockSize   = 4; // In bytes
+
+    inline bool hasMipChain() const { return !mips.empty(); }
+
+    // Only mip 0, the chain is generated on the GPU
+    inline int size()
+    {
+      if (blockExtent == 1) return width * heigth * channels;
+
+      const int extent = static_cast<int>(blockExtent);
+      return ((width + extent - 1) / extent) * ((heigth + extent - 1) / extent) * static_cast<int>(blockSize);
+    }
+  };
+
+  struct ModelData
+  {
+    VertexFormat vertexFormat = VertexFormat::FULL;
+    VkIndexType  indexType    = VK_INDEX_TYPE_UINT32; // UINT16 whenever the vertices fit
+    Quantization quantization;                        // Only used by VertexFormat::PACKED
+    Bounds       bounds;
+    uint32_t     vertexCount  = 0;
+    uint32_t     indexCount   = 0; // Of every LOD
+    std::vector<LodRange> lods;    // Ranges of the index data, LOD 0 first
+
+    // Already in the GPU buffers' layout, see packModel
+    std::vector<char> vertexBlob;
+    std::vector<char> indexBlob;
+
+    // Loaded from the mesh cache: the blobs stay empty and the data is read straight from the mapping
+    std::shared_ptr<MappedFile> pCacheFile;
+    const void*                 pCachedVertices = nullptr;
+    const void*                 pCachedIndices  = nullptr;
+
+    inline bool isCached() const { return pCacheFile != nullptr; }
+
+    inline const void* getVertices() const { return this->isCached() ? pCachedVertices : vertexBlob.data(); }
+    inline const void* getIndices()  const { return this->isCached() ? pCachedIndices  : indexBlob.data(); }
+
+    inline uint32_t getVertexCount()  const { return vertexCount; }
+    inline uint32_t getIndexCount()   const { return indexCount; }
+    inline uint32_t getVertexStride() const { return vpe::getVertexStride(vertexFormat); }
+    inline uint32_t getIndexSize()    const { return indexType == VK_INDEX_TYPE_UINT16 ? 2 : 4; }
+
+    inline VkDeviceSize getVerticesSize() const { return VkDeviceSize(vertexCount) * this->getVertexStride(); }
+    inline VkDeviceSize getIndicesSize()  const { return VkDeviceSize(indexCount)  * this->getIndexSize(); }
   };
 
+  // PACKED only if the default vertex shader has a variant that decodes it
+  inline VertexFormat getDefaultVertexFormat()
+  {
+    static const VertexFormat format = std::ifstream(DEFAULT_VERT_PACKED).good() ? VertexFormat::PACKED :
+                                                                                    VertexFormat::FULL;
+    return format;
+  }
+
+  // Not hashes of any real file, so they can't collide with one
+  constexpr uint64_t DEFAULT_TEX_HASH = 1;
+  constexpr uint64_t EMPTY_TEX_HASH   = 2;
+
   inline void loadDefaultImage(ImageData* _data)
   {
-    _data->pPixels = static_cast<stbi_uc*>( malloc(4) ); // stbi uses free to clean up
+    _data->pPixels     = static_cast<stbi_uc*>( malloc(4) ); // stbi uses free to clean up
+    _data->contentHash = DEFAULT_TEX_HASH;
     memset(_data->pPixels, 255, 4);
   }
 
   inline void loadEmptyImage(ImageData* _data)
   {
-    _data->pPixels = static_cast<stbi_uc*>( malloc(4) ); // stbi uses free to clean up
+    _data->pPixels     = static_cast<stbi_uc*>( malloc(4) ); // stbi uses free to clean up
+    _data->contentHash = EMPTY_TEX_HASH;
     memset(_data->pPixels, 0, 4);
   }
 
@@ -51,7 +125,15 @@ namespace vpe::resourcesLoader
   std::vector<Vertex>   extractVerticesFromMesh(const aiMesh* _pMesh);
   std::vector<uint32_t> extractIndicesFromMesh(const aiMesh* _pMesh);
 
-  std::pair< std::vector<Vertex>, std::vector<uint32_t> > loadModel(const char* _path);
+  // Converts the vertices and the LODs' indices to the GPU layout, computing the bounds and the quantization.
+  // The LODs' indices are concatenated, LOD 0 first.
+  void packModel(const std::vector<Vertex>&                _vertices,
+                 const std::vector<std::vector<uint32_t>>& _lodIndices,
+                 const std::vector<float>&                 _lodErrors,
+                 const VertexFormat                        _format,
+                 ModelData&                                _result);
+
+  ModelData loadModel(const char* _path, const VertexFormat _format = getDefaultVertexFormat());
 
 } // namespace vpe::resourcesLoader
 
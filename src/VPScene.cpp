@@ -2,33 +2,138 @@
 
 namespace vpe
 {
-void Scene::scheduledCreations()
+void Scene::addLoadedMeshes()
 {
-  bool shouldRecreateLayout      = !m_scheduledLightCreationData.empty();
-  bool shouldRecreateDescriptors = !m_scheduledObjCreationMeshes.empty() || shouldRecreateLayout;
+  for (auto it = m_pendingMeshes.begin(); it != m_pendingMeshes.end();)
+  {
+    if (it->second.wait_for(std::chrono::seconds(0)) != std::future_status::ready)
+    {
+      ++it;
+      continue;
+    }
 
-  while (!m_scheduledLightCreationData.empty())
+    // Records the upload. The renderer submits it before this frame's commands.
+    Mesh* mesh = new Mesh( it->second.get() );
+
+    if (mesh->m_isValid)
+      m_pMeshes.emplace( it->first, mesh );
+    else
+    {
+      std::cout << "ERROR: Scene::addLoadedMeshes - " << it->first << " not added." << std::endl;
+      delete mesh;
+    }
+
+    it = m_pendingMeshes.erase(it);
+  }
+}
+
+void Scene::addLoadedImages()
+{
+  auto& textureRegistry = TextureRegistry::getInstance();
+
+  // Kept alive until they're applied, the registry doesn't own them
+  std::unordered_map<std::string, std::shared_ptr<Image>> decodedImages;
+
+  for (auto it = m_pendingImages.begin(); it != m_pendingImages.end();)
   {
-    this->addLight( m_scheduledLightCreationData.front() );
-    m_scheduledLightCreationData.pop();
+    if (it->second.wait_for(std::chrono::seconds(0)) != std::future_status::ready)
+    {
+      ++it;
+      continue;
+    }
+
+    auto imageData = it->second.get();
+
+    // Records the upload and frees the pixels, unless it's a copy of an image in use
+    decodedImages.emplace( it->first, textureRegistry.add(it->first, imageData) );
+    // Only once they're freed, so the next decodes stay within the budget. The size doesn't need the pixels.
+    m_pImageDecoder->release(imageData);
+
+    it = m_pendingImages.erase(it);
   }
 
+  struct ReadyImage
+  {
+    uint32_t               materialIdx;
+    DescriptorFlags        type;
+    std::shared_ptr<Image> pImage;
+  };
+  std::vector<ReadyImage> readyImages;
+
+  for (auto it = m_pendingMaterialChanges.begin(); it != m_pendingMaterialChanges.end();)
+  {
+    const auto decodedIt = decodedImages.find(it->path);
+    auto pImage = decodedIt != decodedImages.end() ? decodedIt->second : textureRegistry.find(it->path);
+
+    if (pImage == nullptr)
+    {
+      // It was in use when requested, but not anymore
+      if (m_pendingImages.count(it->path) == 0) this->requestImage(it->path);
+
+      ++it;
+      continue;
+    }
+
+    if (!it->isSuperseded && it->idx < m_pMaterials.size())
+    {
+      // The older requests for the same image would undo this one if they finished later
+      for (auto older = m_pendingMaterialChanges.begin(); older != it; ++older)
+      {
+        if (older->idx == it->idx && older->type == it->type) older->isSuperseded = true;
+      }
+
+      readyImages.push_back( ReadyImage{it->idx, it->type, pImage} );
+    }
+
+    it = m_pendingMaterialChanges.erase(it);
+  }
+
+  // No need to wait for the frames in flight, the old images are retired and each region's sets are
+  // rewritten before it's recorded again
+  for (auto& ready : readyImages)
+    this->changeMaterialImage(ready.materialIdx, ready.pImage, ready.type);
+}
+
+void Scene::requestImage(const std::string& _path)
+{
+  if (m_pendingImages.count(_path) > 0) return;
+
+  if (m_pImageDecoder == nullptr) m_pImageDecoder = std::make_unique<ImageDecoder>();
+
+  m_pendingImages.emplace( _path, m_pImageDecoder->request(_path) );
+}
+
+void Scene::scheduledCreations()
+{
+  const bool shouldRecreateLayout      = !m_scheduledLightCreationData.empty();
+  const bool shouldRecreateArenas      = !m_scheduledObjCreationMeshes.empty();
+  const bool shouldRecreateDescriptors = shouldRecreateArenas || shouldRecreateLayout;
+
+  // CPU side only, the buffers are sized once for all of them
   while (!m_scheduledObjCreationMeshes.empty())
   {
     this->createObject( m_scheduledObjCreationMeshes.front() );
     m_scheduledObjCreationMeshes.pop();
   }
 
-  if (shouldRecreateDescriptors)
-  {
-    auto& device = *MemoryBufferManager::getInstance().m_pLogicalDevice;
-    vkDeviceWaitIdle(device); // FIXME: I don't like this. Should I use the fences/semaphores?
+  if (!shouldRecreateDescriptors) return;
 
-    if (shouldRecreateLayout)
-      m_pRenderPipelineManager->recreateLayout(m_lights.size());
+  // The frames in flight still read the arenas, the lights' UBO and the descriptor sets being replaced
+  auto& device = *MemoryBufferManager::getInstance().m_pLogicalDevice;
+  vkDeviceWaitIdle(device); // FIXME: I don't like this. Should I use the fences/semaphores?
 
-    this->recreateSceneDescriptors();
+  while (!m_scheduledLightCreationData.empty())
+  {
+    this->addLight( m_scheduledLightCreationData.front() );
+    m_scheduledLightCreationData.pop();
   }
+
+  if (shouldRecreateArenas) this->createArenas();
+
+  if (shouldRecreateLayout)
+    m_pRenderPipelineManager->recreateLayout(m_lights.size());
+
+  this->recreateSceneDescriptors();
 }
 
 void Scene::scheduledChanges()
@@ -54,75 +159,74 @@ void Scene::scheduledChanges()
 
     m_scheduledObjChangesData.pop();
   }
-
-  while (!m_scheduledMaterialChangesData.empty())
-  {
-    auto& changes = m_scheduledMaterialChangesData.front();
-    if (changes.idx < m_pMaterials.size())
-      this->changeMaterialImage(changes.idx, changes.texturePath, changes.type);
-
-    m_scheduledMaterialChangesData.pop();
-  }
 }
 
 void Scene::recreateSceneDescriptors()
 {
-  m_pRenderPipelineManager->createOrUpdateDescriptorPool(m_renderableObjects.size(),
-                                                         m_lights.size() * m_renderableObjects.size());
+  const size_t setCount = m_renderableObjects.size() * m_uniformRegionCount;
+  m_pRenderPipelineManager->createOrUpdateDescriptorPool(setCount, m_lights.size() * setCount);
 
-  std::vector<VkBuffer> ubos = {m_mvpnUBO, m_lightsUBO};
+  std::vector<VkBuffer> ubos = {m_mvpnArena.getBuffer(), m_lightsUBO, m_instanceArena.getBuffer()};
   for (auto& object : m_renderableObjects)
   {
-    m_pRenderPipelineManager->createDescriptorSet(&object.m_descriptorSet);
-    m_pRenderPipelineManager->updateObjDescriptorSet(ubos,
-                                                     m_lights.size(),
-                                                     DescriptorFlags::ALL,
-                                                     &object);
+    object.m_descriptorSets.assign(m_uniformRegionCount, VK_NULL_HANDLE);
+    object.m_staleDescriptors.assign(m_uniformRegionCount, DescriptorFlags::NONE);
+
+    for (uint32_t region=0; region<m_uniformRegionCount; ++region)
+    {
+      m_pRenderPipelineManager->createDescriptorSet(&object.m_descriptorSets.at(region));
+      m_pRenderPipelineManager->updateObjDescriptorSet(ubos,
+                                                       m_lights.size(),
+                                                       DescriptorFlags::ALL,
+                                                       &object,
+                                                       region,
+                                                       m_mvpnArena.getElementStride(),
+                                                       m_instanceArena.getRegionSize());
+    }
   }
 }
 
-void Scene::createObject(const char* _meshPath)
+void Scene::createArenas()
 {
-  auto logicalDevice = *MemoryBufferManager::getInstance().m_pLogicalDevice;
+  m_mvpnArena.create(sizeof(ModelViewProjNormalUBO),
+                     m_renderableObjects.size(),
+                     m_uniformRegionCount);
+
+  m_instanceArena.create(sizeof(InstanceData),
+                         m_renderableObjects.size(),
+                         m_uniformRegionCount,
+                         VK_BUFFER_USAGE_STORAGE_BUFFER_BIT);
+
+  m_instanceData.resize(m_renderableObjects.size());
+  m_worldSpheres.resize(m_renderableObjects.size());
+  m_visibility.assign(m_renderableObjects.size(), 1);
+  m_lodLevels.assign(m_renderableObjects.size(), 0);
+  m_projectedSizes.assign(m_renderableObjects.size(), 0.0f);
+}
 
-  if (m_pMeshes.count(_meshPath) == 0) this->addMesh(_meshPath);
+void Scene::createObject(const char* _meshPath)
+{
+  this->addMesh(_meshPath, m_pMaterials.at(0)->vertexFormat);
 
   const auto idx = m_renderableObjects.size();
 
+  // The arenas are resized by scheduledCreations, once for every object created in the update
   m_renderableObjects.push_back( StdRenderableObject(idx, _meshPath, m_pMaterials.at(0)) );
-  if (m_mvpnUBO != VK_NULL_HANDLE)
-  {
-    vkDestroyBuffer(logicalDevice, m_mvpnUBO, nullptr);
-    vkFreeMemory(logicalDevice, m_mvpnUBOMemory, nullptr);
-  }
-
-  auto& bufferManager = MemoryBufferManager::getInstance();
-  bufferManager.createBuffer(sizeof(ModelViewProjNormalUBO) * m_renderableObjects.size(),
-                             VK_BUFFER_USAGE_UNIFORM_BUFFER_BIT,
-                             VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT |
-                               VK_MEMORY_PROPERTY_HOST_COHERENT_BIT,
-                             &m_mvpnUBO,
-                             &m_mvpnUBOMemory);
 
   m_descriptorsChanged = true;
 }
 
 void Scene::addLight(Light& _light)
 {
-  auto logicalDevice = *MemoryBufferManager::getInstance().m_pLogicalDevice;
+  auto& bufferManager = MemoryBufferManager::getInstance();
 
   uint32_t   idx     = m_lights.size();
   const auto uboSize = sizeof(LightUBO);
 
   m_lights.emplace_back(_light.type, idx, _light.ubo);
 
-  if (m_lightsUBO != VK_NULL_HANDLE)
-  {
-    vkDestroyBuffer(logicalDevice, m_lightsUBO, nullptr);
-    vkFreeMemory(logicalDevice, m_lightsUBOMemory, nullptr);
-  }
+  if (m_lightsUBO != VK_NULL_HANDLE) bufferManager.destroyBuffer(m_lightsUBO, m_lightsUBOMemory);
 
-  auto& bufferManager = MemoryBufferManager::getInstance();
   bufferManager.createBuffer(uboSize * m_lights.size(),
                              VK_BUFFER_USAGE_UNIFORM_BUFFER_BIT,
                              VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT |
@@ -130,42 +234,38 @@ void Scene::addLight(Light& _light)
                              &m_lightsUBO,
                              &m_lightsUBOMemory);
 
+  LightUBO* pLightUBOs = m_lightsUBOMemory.getMapped<LightUBO>();
   for (auto& light : m_lights)
-    bufferManager.copyToBufferMemory(&light.ubo, m_lightsUBOMemory, uboSize, uboSize * light.idx);
+    pLightUBOs[light.idx] = light.ubo;
+
+  MemoryAllocator::getInstance().flush(m_lightsUBOMemory);
 
   m_descriptorsChanged = true;
 }
 
 void Scene::changeMaterialImage(const uint32_t _materialIdx,
-                                const char* _texturePath,
+                                const std::shared_ptr<Image>& _pImage,
                                 const DescriptorFlags _type)
 {
   if (_materialIdx >= m_pMaterials.size() ||
       (_type != DescriptorFlags::TEXTURE && _type != DescriptorFlags::NORMAL_MAP))
-  {
     return;
-  }
 
-  if (_type == DescriptorFlags::TEXTURE)
-    m_pMaterials.at(_materialIdx)->changeTexture(_texturePath);
-  else
-    m_pMaterials.at(_materialIdx)->changeNormalMap(_texturePath);
+  auto& pMaterial = m_pMaterials.at(_materialIdx);
+  auto& pOldImage = _type == DescriptorFlags::TEXTURE ? pMaterial->pTexture : pMaterial->pNormalMap;
 
-  auto device = *MemoryBufferManager::getInstance().m_pLogicalDevice;
-  vkDeviceWaitIdle(device);
+  // The frames in flight may still sample it
+  if (pOldImage != nullptr && pOldImage != _pImage)
+    m_retiredImages.push_back( RetiredImage{m_updateCount, pOldImage} );
 
-  std::vector<VkBuffer> NOT_UPDATING_UBOS{};
-  const size_t NOT_UPDATING_LIGHTS = 0;
+  if (_type == DescriptorFlags::TEXTURE)
+    pMaterial->changeTexture(_pImage);
+  else
+    pMaterial->changeNormalMap(_pImage);
 
   for (auto& object : m_renderableObjects)
   {
-    if (object.m_pMaterial != m_pMaterials.at(_materialIdx)) continue;
-
-    m_pRenderPipelineManager->updateObjDescriptorSet(NOT_UPDATING_UBOS,
-                                                     NOT_UPDATING_LIGHTS,
-                                                     _type,
-                                                     &object);
-    m_descriptorsChanged = true;
+    if (object.m_pMaterial == pMaterial) this->markDescriptorsStale(object, _type);
   }
 }
 
@@ -173,19 +273,22 @@ void Scene::changeObjectMaterial(const uint32_t _objectIdx, const uint32_t _mate
 {
   if (_objectIdx >= m_renderableObjects.size()) return;
 
-  m_renderableObjects.at(_objectIdx).setMaterial( m_pMaterials.at(_materialIdx) );
+  auto& object = m_renderableObjects.at(_objectIdx);
 
-  std::vector<VkBuffer> dummyUBOs{};
-  m_pRenderPipelineManager->updateObjDescriptorSet(dummyUBOs,
-                                                   0,
-                                                   DescriptorFlags::TEXTURE,
-                                                   &m_renderableObjects.at(_objectIdx));
+  // The old material stays alive in m_pMaterials, and so do its images
+  object.setMaterial( m_pMaterials.at(_materialIdx) );
 
-  m_descriptorsChanged = true;
+  // Custom vertex shaders only read the full Vertex. Until the mesh is loaded in it, the object is skipped.
+  this->addMesh(object.m_meshPath.c_str(), object.m_pMaterial->vertexFormat);
+
+  this->markDescriptorsStale(object, static_cast<DescriptorFlags>(DescriptorFlags::TEXTURE |
+                                                                  DescriptorFlags::NORMAL_MAP));
 }
 
-void Scene::updateObjects(const Camera& _camera, float _deltaTime)
+void Scene::updateObjects(const Camera& _camera, float _deltaTime, const uint32_t _frameRegion)
 {
+  if (!m_mvpnArena.isValid()) return;
+
   ModelViewProjNormalUBO mvpnUBO{};
   mvpnUBO.view = _camera.getViewMat();
   mvpnUBO.proj = _camera.getProjMat();
@@ -194,13 +297,145 @@ void Scene::updateObjects(const Camera& _camera, float _deltaTime)
   {
     object.update(_deltaTime);
 
-    mvpnUBO.modelView = mvpnUBO.view * object.m_transform.getModelMatrix();
-    mvpnUBO.normal    = glm::transpose(glm::inverse(mvpnUBO.modelView));
+    const auto      mesh  = this->getObjectMesh(object);
+    const glm::mat4 model = object.m_transform.getModelMatrix();
+    mvpnUBO.modelView     = mvpnUBO.view * model;
+    mvpnUBO.normal        = glm::transpose(glm::inverse(mvpnUBO.modelView));
+
+    // Packed positions are quantized. The normals aren't, so the normal matrix ignores it.
+    if (mesh && mesh->m_vertexFormat == VertexFormat::PACKED)
+      mvpnUBO.modelView = mvpnUBO.modelView * mesh->m_dequantization;
+
+    // Persistently mapped, so write straight into it
+    *m_mvpnArena.getElement<ModelViewProjNormalUBO>(_frameRegion, object.m_UBOoffsetIdx) = mvpnUBO;
+
+    // The instances are written later, once the draw order is known
+    m_instanceData.at(object.m_UBOoffsetIdx) = {mvpnUBO.modelView, mvpnUBO.normal};
+
+    // Bounding sphere to world space. The biggest scale axis keeps it conservative.
+    const size_t idx    = object.m_UBOoffsetIdx;
+    const Bounds bounds = mesh ? mesh->m_bounds : Bounds{};
+
+    const glm::vec3 center = glm::vec3( model * glm::vec4(bounds.sphereCenter, 1.0f) );
+    const float     scale  = std::max({glm::length(glm::vec3(model[0])),
+                                       glm::length(glm::vec3(model[1])),
+                                       glm::length(glm::vec3(model[2]))});
+
+    m_worldSpheres.x.at(idx)      = center.x;
+    m_worldSpheres.y.at(idx)      = center.y;
+    m_worldSpheres.z.at(idx)      = center.z;
+    m_worldSpheres.radius.at(idx) = bounds.sphereRadius * scale;
+  }
+
+  m_mvpnArena.flushRegion(_frameRegion);
+}
+
+void Scene::cullObjects(const Camera& _camera)
+{
+  const Frustum frustum(_camera.getProjMat() * _camera.getViewMat());
+
+  m_culledCount = frustum.cullSpheres(m_worldSpheres, m_visibility);
+}
+
+void Scene::selectLods(const Camera& _camera)
+{
+  const glm::vec3& cameraPosition = _camera.getPosition();
+
+  for (size_t idx=0; idx<m_lodLevels.size(); ++idx)
+  {
+    if (m_visibility.at(idx) == 0) continue;
+
+    const auto mesh = this->getObjectMesh( m_renderableObjects.at(idx) );
+    if (!mesh) continue;
+
+    const glm::vec3 center(m_worldSpheres.x.at(idx), m_worldSpheres.y.at(idx), m_worldSpheres.z.at(idx));
+    const float     size = getProjectedSize(m_worldSpheres.radius.at(idx),
+                                            glm::distance(center, cameraPosition),
+                                            _camera.getFoV());
+
+    m_lodLevels.at(idx)      = static_cast<uint8_t>( selectLod(size, mesh->m_lods.size()) );
+    m_projectedSizes.at(idx) = size;
+  }
+}
+
+void Scene::streamTextures()
+{
+  m_textureStreamer.beginFrame();
+
+  for (size_t idx=0; idx<m_projectedSizes.size(); ++idx)
+  {
+    // Not drawn, so its textures can be evicted
+    if (m_visibility.at(idx) == 0 || m_projectedSizes.at(idx) <= 0.0f) continue;
+
+    // Assumes the texture spans the whole object once, like most of the models' UVs
+    const float        pixels    = m_projectedSizes.at(idx) * m_viewportHeight;
+    const StdMaterial& material  = *m_renderableObjects.at(idx).m_pMaterial;
+
+    m_textureStreamer.request(material.pTexture, pixels);
+    m_textureStreamer.request(material.pNormalMap, pixels);
+  }
+
+  std::vector<Image*>                 changedImages;
+  std::vector<std::unique_ptr<Image>> retiredImages;
+  m_textureStreamer.update(changedImages, retiredImages);
+
+  for (auto& pRetired : retiredImages)
+    m_retiredImages.push_back( RetiredImage{m_updateCount, std::move(pRetired)} );
+
+  if (changedImages.empty()) return;
+
+  // Same image and view handles for every object, they're just pointed at the new ones
+  for (auto& object : m_renderableObjects)
+  {
+    const StdMaterial& material = *object.m_pMaterial;
+
+    uint8_t flags = DescriptorFlags::NONE;
+    for (const Image* pImage : changedImages)
+    {
+      if (material.pTexture.get()   == pImage) flags |= DescriptorFlags::TEXTURE;
+      if (material.pNormalMap.get() == pImage) flags |= DescriptorFlags::NORMAL_MAP;
+    }
+
+    if (flags != DescriptorFlags::NONE) this->markDescriptorsStale(object, static_cast<DescriptorFlags>(flags));
+  }
+}
+
+void Scene::markDescriptorsStale(StdRenderableObject& _object, const DescriptorFlags _flags)
+{
+  for (auto& staleFlags : _object.m_staleDescriptors) staleFlags |= _flags;
+}
+
+void Scene::refreshDescriptors(const uint32_t _frameRegion)
+{
+  std::vector<VkBuffer> NOT_UPDATING_UBOS{};
+  const size_t NOT_UPDATING_LIGHTS = 0;
+
+  for (auto& object : m_renderableObjects)
+  {
+    if (_frameRegion >= object.m_staleDescriptors.size()) continue;
 
-    MemoryBufferManager::getInstance().copyToBufferMemory(&mvpnUBO,
-                                                          m_mvpnUBOMemory,
-                                                          sizeof(mvpnUBO),
-                                                          object.m_UBOoffsetIdx * sizeof(mvpnUBO));
+    uint8_t& staleFlags = object.m_staleDescriptors.at(_frameRegion);
+    if (staleFlags == DescriptorFlags::NONE) continue;
+
+    // Only the images, the buffers don't change
+    m_pRenderPipelineManager->updateObjDescriptorSet(NOT_UPDATING_UBOS,
+                                                     NOT_UPDATING_LIGHTS,
+                                                     static_cast<DescriptorFlags>(staleFlags),
+                                                     &object,
+                                                     _frameRegion);
+    staleFlags           = DescriptorFlags::NONE;
+    m_descriptorsChanged = true;
+  }
+}
+
+void Scene::releaseRetiredImages()
+{
+  // Replaced during update N: the regions recorded from N on use the new ones, and by update N + regions
+  // every frame recorded before N has finished
+  while (!m_retiredImages.empty() &&
+         m_retiredImages.front().updateIdx + m_uniformRegionCount <= m_updateCount)
+  {
+    m_retiredImages.pop_front();
   }
 }
 } // namespace vpe
\ No newline at end of file
@@ -3,12 +3,23 @@
 
 #include <climits>
 #include <queue>
+#include <deque>
+#include <future>
+#include <chrono>
 
 #include "Managers/VPStdRenderPipelineManager.hpp"
 #include "VPCamera.hpp"
+#include "VPFrustum.hpp"
+#include "VPThreadPool.hpp"
+#include "VPImageDecoder.hpp"
+#include "VPTextureRegistry.hpp"
+#include "VPTextureStreamer.hpp"
 
 namespace vpe
 {
+// Imports are mostly IO and Assimp's post processing, a few threads are enough
+constexpr size_t MAX_LOADING_THREADS = 4;
+
 struct ObjInitData
 {
   ObjInitData() = delete;
@@ -39,11 +50,19 @@ struct ObjChangesData
   std::function<void(const float, Transform&)> updateCallback;
 };
 
+// Replaced images (or a streamed image's previous mips), alive until no frame in flight can use them
+struct RetiredImage
+{
+  uint64_t               updateIdx; // When it was replaced
+  std::shared_ptr<Image> pImage;
+};
+
 struct MaterialChangesData
 {
   uint32_t        idx;
   DescriptorFlags type;
-  const char*     texturePath;
+  std::string     path; // Being decoded, unless the TextureRegistry already has it
+  bool            isSuperseded; // A later change to the same image was already applied
 };
 
 class Scene
@@ -51,8 +70,10 @@ class Scene
 public:
   Scene()
   {
-    m_lightsUBO = VK_NULL_HANDLE;
-    m_mvpnUBO   = VK_NULL_HANDLE;
+    m_lightsUBO          = VK_NULL_HANDLE;
+    m_uniformRegionCount = 1;
+    m_viewportHeight     = 1;
+    m_updateCount        = 0;
   };
 
   ~Scene()
@@ -68,12 +89,66 @@ public:
   inline size_t getLightCount()        { return m_lights.size(); }
   inline bool   anyDescriptorUpdated() { return m_descriptorsChanged; }
 
+  // Offset of the frame's region in the (dynamic) matrices UBO
+  inline uint32_t getMVPNDynamicOffset(const uint32_t _frameRegion) const
+  {
+    return m_mvpnArena.getDynamicOffset(_frameRegion);
+  }
+
+  // Result of the last update's frustum culling
+  inline bool   isObjectVisible(const uint32_t _objIdx) const { return m_visibility.at(_objIdx) != 0; }
+  inline size_t getCulledCount()                        const { return m_culledCount; }
+
+  // Picked by the last update from the object's size on screen
+  inline uint32_t getObjectLod(const uint32_t _objIdx) const { return m_lodLevels.at(_objIdx); }
+
+  // In pixels, turns the objects' sizes on screen into their textures' footprints
+  inline void setViewportHeight(const uint32_t _height) { m_viewportHeight = std::max(_height, 1u); }
+
+  inline void setTextureBudget(const VkDeviceSize _budget) { m_textureStreamer.setBudget(_budget); }
+  inline const TextureStreamingStats& getTextureStreamingStats() const { return m_textureStreamer.getStats(); }
+
+  inline uint32_t getInstancesDynamicOffset(const uint32_t _frameRegion) const
+  {
+    return m_instanceArena.getDynamicOffset(_frameRegion);
+  }
+
+  // Copies the object's matrices of the last update into the _instanceIdx slot of the frame's region
+  inline void writeInstance(const uint32_t _frameRegion, const uint32_t _instanceIdx, const uint32_t _objIdx)
+  {
+    *m_instanceArena.getElement<InstanceData>(_frameRegion, _instanceIdx) = m_instanceData.at(_objIdx);
+  }
+
+  inline void flushInstances(const uint32_t _frameRegion) { m_instanceArena.flushRegion(_frameRegion); }
+
+  // One region per command buffer that can be in flight at the same time
+  inline void setUniformRegionCount(const uint32_t _count)
+  {
+    if (_count == m_uniformRegionCount) return;
+
+    m_uniformRegionCount = _count;
+
+    if (m_renderableObjects.empty()) return;
+
+    vkDeviceWaitIdle(*MemoryBufferManager::getInstance().m_pLogicalDevice);
+
+    this->createArenas();
+    this->recreateSceneDescriptors();
+
+    m_descriptorsChanged = true;
+  }
+
+  // The meshes are loaded once per vertex format, each material reads a single one
+  static inline std::string getMeshKey(const std::string& _path, const VertexFormat _format)
+  {
+    return _format == VertexFormat::PACKED ? _path + "#packed" : _path;
+  }
+
+  // In the format of the object's material. nullptr while it's loading.
   inline std::shared_ptr<Mesh> getObjectMesh(const StdRenderableObject& _obj)
   {
-    if (m_pMeshes.count(_obj.m_meshPath) != 0)
-      return m_pMeshes.at(_obj.m_meshPath);
-    else
-      return nullptr;
+    const auto it = m_pMeshes.find( getMeshKey(_obj.m_meshPath, _obj.m_pMaterial->vertexFormat) );
+    return it != m_pMeshes.end() ? it->second : nullptr;
   }
 
   inline void setRenderPipelineManager(std::shared_ptr<StdRenderPipelineManager>& _manager)
@@ -120,21 +195,46 @@ public:
     return m_pMaterials.size() - 1;
   }
 
-  inline void addMesh(const char* _path)
+  // The import runs in a loading thread. The mesh is added (and uploaded) at the start of the first
+  // update after it's done. Until then, the objects using it are skipped.
+  inline void addMesh(const char* _path, const VertexFormat _format)
   {
-    if (m_pMeshes.count(_path) > 0) return;
+    const std::string key = getMeshKey(_path, _format);
+    if (m_pMeshes.count(key) > 0 || m_pendingMeshes.count(key) > 0) return;
 
-    Mesh* mesh = new Mesh(_path);
+    if (m_pLoadingThreadPool == nullptr)
+    {
+      m_pLoadingThreadPool = std::make_unique<ThreadPool>( std::min(ThreadPool::getDefaultThreadCount(),
+                                                                    MAX_LOADING_THREADS) );
+    }
 
-    if (mesh->m_isValid)
-      m_pMeshes.emplace( _path, mesh );
-    else
+    const std::string path(_path);
+    m_pendingMeshes.emplace(key, m_pLoadingThreadPool->submit([path, _format]()
     {
-      std::cout << "ERROR: Scene::addMesh - Mesh not added." << std::endl;
-      delete mesh;
+      return resourcesLoader::loadModel(path.c_str(), _format);
+    }));
+  }
+
+  inline size_t getPendingMeshCount()  const { return m_pendingMeshes.size(); }
+  inline size_t getPendingImageCount() const { return m_pendingMaterialChanges.size(); }
+
+  // Blocks until every requested mesh and image is loaded and added
+  inline void waitForPendingLoads()
+  {
+    for (auto& pathAndFuture : m_pendingMeshes) pathAndFuture.second.wait();
+    this->addLoadedMeshes();
+
+    // Decoders may be waiting for the memory of the decoded images, so they have to be consumed as they come
+    while (!m_pendingMaterialChanges.empty())
+    {
+      if (!m_pendingImages.empty()) m_pendingImages.begin()->second.wait_for(std::chrono::milliseconds(1));
+      this->addLoadedImages();
     }
   }
 
+  // Applies the scheduled light and object creations now instead of at the next update
+  inline void applyScheduledCreations() { this->scheduledCreations(); }
+
   inline uint32_t scheduleLightCreation(Light& _light)
   {
     m_scheduledLightCreationData.emplace(_light);
@@ -143,6 +243,10 @@ public:
 
   inline uint32_t scheduleObjCreation(const char* _meshPath)
   {
+    // Start importing right away, the object can be created without it. Objects start with the default material.
+    this->addMesh(_meshPath, m_pMaterials.empty() ? resourcesLoader::getDefaultVertexFormat() :
+                                                    m_pMaterials.front()->vertexFormat);
+
     m_scheduledObjCreationMeshes.emplace(_meshPath);
     return m_renderableObjects.size() + m_scheduledObjCreationMeshes.size() - 1;
   }
@@ -154,42 +258,62 @@ public:
     m_scheduledObjChangesData.push(changes);
   }
 
+  // The image is decoded in the background and swapped in at the start of the first update after that.
+  // Images already in use, or being decoded for another material, are shared instead.
   inline void scheduleMaterialImageChange(const uint32_t _matIdx,
                                           const char* _texPath,
                                           const DescriptorFlags _type)
   {
-    m_scheduledMaterialChangesData.push( MaterialChangesData{_matIdx, _type, _texPath} );
+    m_pendingMaterialChanges.push_back( MaterialChangesData{_matIdx, _type, _texPath, false} );
+
+    if (TextureRegistry::getInstance().find(_texPath) == nullptr) this->requestImage(_texPath);
   }
 
-  inline void update(const Camera& _camera, float _deltaTime)
+  // Only _frameRegion of the per frame data is written. The GPU must be done with it.
+  inline void update(const Camera& _camera, float _deltaTime, const uint32_t _frameRegion)
   {
     m_descriptorsChanged = false;
+    ++m_updateCount;
 
+    releaseRetiredImages();
+
+    // Frame boundary, so nothing recorded so far refers to the new meshes and images
+    addLoadedMeshes();
+    addLoadedImages();
     scheduledCreations();
     scheduledChanges();
 
-    updateObjects(_camera, _deltaTime);
+    updateObjects(_camera, _deltaTime, _frameRegion);
+    cullObjects(_camera);
+    selectLods(_camera);
+    streamTextures();
+    refreshDescriptors(_frameRegion);
     //TODO: updateLights(_deltaTime);
   }
 
   inline void cleanUp()
   {
-    auto logicalDevice = *MemoryBufferManager::getInstance().m_pLogicalDevice;
+    auto& bufferManager = MemoryBufferManager::getInstance();
+
+    // Lets the running imports and decodes finish, their results are just dropped
+    m_pLoadingThreadPool.reset();
+    m_pendingMeshes.clear();
+
+    m_pImageDecoder.reset();
+    for (auto& pathAndImage : m_pendingImages) stbi_image_free( pathAndImage.second.get().pPixels );
+    m_pendingImages.clear();
+    m_pendingMaterialChanges.clear();
+
+    m_textureStreamer.cleanUp();
+    m_retiredImages.clear();
 
     for (auto& obj         : m_renderableObjects) obj.cleanUp();
     for (auto& pathAndMesh : m_pMeshes)           pathAndMesh.second.reset();
     for (auto& mat         : m_pMaterials)        mat.reset();
 
-    if (!m_lights.empty())
-    {
-      vkDestroyBuffer(logicalDevice, m_lightsUBO, nullptr);
-      vkFreeMemory(logicalDevice, m_lightsUBOMemory, nullptr);
-    }
-    if (!m_renderableObjects.empty())
-    {
-      vkDestroyBuffer(logicalDevice, m_mvpnUBO, nullptr);
-      vkFreeMemory(logicalDevice, m_mvpnUBOMemory, nullptr);
-    }
+    if (!m_lights.empty())            bufferManager.destroyBuffer(m_lightsUBO, m_lightsUBOMemory);
+    m_mvpnArena.destroy();
+    m_instanceArena.destroy();
 
     m_pRenderPipelineManager.reset();
   }
@@ -200,31 +324,68 @@ private:
   std::vector<Light> m_lights; // TODO: Change for map
   std::unordered_map<std::string, std::shared_ptr<Mesh>> m_pMeshes;
 
+  std::unique_ptr<ThreadPool>                                             m_pLoadingThreadPool;
+  std::unordered_map<std::string, std::future<resourcesLoader::ModelData>> m_pendingMeshes;
+
   std::queue<Light>               m_scheduledLightCreationData;
   std::queue<const char*>         m_scheduledObjCreationMeshes;
   std::queue<ObjChangesData>      m_scheduledObjChangesData;
-  std::queue<MaterialChangesData> m_scheduledMaterialChangesData;
 
-  VkBuffer       m_mvpnUBO;
-  VkDeviceMemory m_mvpnUBOMemory;
-  VkBuffer       m_lightsUBO;
-  VkDeviceMemory m_lightsUBOMemory;
+  std::unique_ptr<ImageDecoder>   m_pImageDecoder;
+  std::deque<MaterialChangesData> m_pendingMaterialChanges; // In request order
+  std::unordered_map<std::string, std::future<resourcesLoader::ImageData>> m_pendingImages; // One decode per path
+
+  UniformArena     m_mvpnArena;
+  UniformArena     m_instanceArena; // SSBO, filled in draw order by the renderer
+  uint32_t         m_uniformRegionCount;
+
+  std::vector<InstanceData> m_instanceData; // Last update's matrices, indexed like m_renderableObjects
+
+  // World space bounding spheres, their visibility and their LODs, indexed like m_renderableObjects
+  SphereSoA            m_worldSpheres;
+  std::vector<uint8_t> m_visibility;
+  size_t               m_culledCount = 0;
+  std::vector<uint8_t> m_lodLevels;
+  std::vector<float>   m_projectedSizes; // Fraction of the screen's height, 0 if not visible
+  VkBuffer         m_lightsUBO;
+  MemoryAllocation m_lightsUBOMemory;
 
   std::shared_ptr<StdRenderPipelineManager> m_pRenderPipelineManager;
 
+  TextureStreamer          m_textureStreamer;
+  uint32_t                 m_viewportHeight;
+  uint64_t                 m_updateCount;
+  std::deque<RetiredImage> m_retiredImages; // Oldest first
+
+  void addLoadedMeshes();
+  void addLoadedImages();
+  // Starts decoding it, unless it's already being decoded
+  void requestImage(const std::string& _path);
   void scheduledCreations();
   void scheduledChanges();
 
   void createObject(const char* _meshPath);
   void addLight(Light& _light);
+  // The GPU must be done with the material's current image
   void changeMaterialImage(const uint32_t _materialIdx,
-                           const char* _texturePath,
+                           const std::shared_ptr<Image>& _pImage,
                            const DescriptorFlags _type);
 
   void changeObjectMaterial(const uint32_t _objectIdx, const uint32_t _materialIdx);
-  void updateObjects(const Camera& _camera, float _deltaTime);
+  void updateObjects(const Camera& _camera, float _deltaTime, const uint32_t _frameRegion);
+  void cullObjects(const Camera& _camera);
+  void selectLods(const Camera& _camera);
+  // Requests the mips of the visible objects' textures from their size on screen
+  void streamTextures();
+  // The object's sets of every region need _flags rewritten
+  void markDescriptorsStale(StdRenderableObject& _object, const DescriptorFlags _flags);
+  // Rewrites the stale descriptors of _frameRegion's sets
+  void refreshDescriptors(const uint32_t _frameRegion);
+  // Once every region was recorded again after their replacement, and that frame is done
+  void releaseRetiredImages();
   //void updateLights(float _deltaTime);
   void recreateSceneDescriptors();
+  void createArenas();
 };
 }
 #endif
\ No newline at end of file
@@ -15,6 +15,13 @@ struct alignas(32) ModelViewProjNormalUBO
   alignas(16) glm::mat4 normal;
 };
 
+// Per instance data of the instanced draws (std430, so tightly packed)
+struct InstanceData
+{
+  glm::mat4 modelView;
+  glm::mat4 normal;
+};
+
 class StdRenderableObject
 {
 friend class Scene;
@@ -27,7 +34,6 @@ private:
     m_UBOoffsetIdx(_idx),
     m_meshPath(_meshPath),
     m_pMaterial(_pMaterial),
-    m_descriptorSet(VK_NULL_HANDLE),
     m_updateCallback( [](const float, Transform&){} )
   {};
 
@@ -38,7 +44,11 @@ public:
   // Misc
   std::string m_meshPath;
   std::shared_ptr<StdMaterial> m_pMaterial; // TODO: Change this for its index?
-  VkDescriptorSet              m_descriptorSet;
+
+  // One per uniform region, so a region's set can be rewritten while the frames using the others are in flight
+  std::vector<VkDescriptorSet> m_descriptorSets;
+  // DescriptorFlags of each region's set that are out of date. Rewritten before the region is recorded again.
+  std::vector<uint8_t>         m_staleDescriptors;
 
   std::function<void(const float, Transform&)> m_updateCallback;
 
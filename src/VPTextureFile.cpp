@@ -0,0 +1,223 @@
+#include "VPTextureFile.hpp"
+#include "VPHash.hpp"
+#include "Managers/VPMemoryBufferManager.hpp"
+
+#include <iostream>
+#include <fstream>
+#include <filesystem>
+#include <algorithm>
+
+namespace vpe::textureFile
+{
+  namespace
+  {
+    constexpr uint64_t LEVEL_ALIGNMENT = 16;
+
+    inline uint64_t alignUp(const uint64_t _value)
+    {
+      return (_value + LEVEL_ALIGNMENT - 1) / LEVEL_ALIGNMENT * LEVEL_ALIGNMENT;
+    }
+
+  }
+
+  BlockInfo getBlockInfo(const VkFormat _format)
+  {
+    switch (_format)
+    {
+      case VK_FORMAT_R8G8B8A8_UNORM:
+      case VK_FORMAT_R8G8B8A8_SRGB:       return BlockInfo{1, 4};
+      case VK_FORMAT_BC1_RGB_UNORM_BLOCK: return BlockInfo{4, 8};
+      case VK_FORMAT_BC5_UNORM_BLOCK:
+      case VK_FORMAT_BC7_UNORM_BLOCK:     return BlockInfo{4, 16};
+      default:                            return BlockInfo{0, 0};
+    }
+  }
+
+  bool isFormatUsable(const VkFormat _format)
+  {
+    // Without a device (the offline tools) there's nothing to check
+    const auto* pPhysicalDevice = MemoryBufferManager::getInstance().m_pPhysicalDevice;
+    if (pPhysicalDevice == nullptr) return true;
+
+    VkFormatProperties properties{};
+    vkGetPhysicalDeviceFormatProperties(*pPhysicalDevice, _format, &properties);
+
+    const VkFormatFeatureFlags required = VK_FORMAT_FEATURE_SAMPLED_IMAGE_BIT |
+                                          VK_FORMAT_FEATURE_SAMPLED_IMAGE_FILTER_LINEAR_BIT;
+    return (properties.optimalTilingFeatures & required) == required;
+  }
+
+  std::string getPath(const char* _sourcePath)
+  {
+    return std::filesystem::path(_sourcePath).replace_extension(TEXTURE_FILE_EXTENSION).string();
+  }
+
+  std::string findFor(const char* _sourcePath)
+  {
+    const std::string path = getPath(_sourcePath);
+
+    std::error_code error;
+    const auto textureTime = std::filesystem::last_write_time(path, error);
+    if (error) return std::string();
+
+    // Otherwise the source was edited after converting it
+    const auto sourceTime = std::filesystem::last_write_time(_sourcePath, error);
+    if (!error && sourceTime > textureTime) return std::string();
+
+    return path;
+  }
+
+  bool load(const char* _path, resourcesLoader::ImageData& _result)
+  {
+    auto pFile = std::make_shared<MappedFile>(_path);
+    if (!pFile->isValid() || pFile->size() < sizeof(Header)) return false;
+
+    Header header;
+    memcpy(&header, pFile->data(), sizeof(Header));
+
+    const auto      format = static_cast<VkFormat>(header.format);
+    const BlockInfo block  = getBlockInfo(format);
+
+    if (header.magic       != TEXTURE_FILE_MAGIC   ||
+        header.version     != TEXTURE_FILE_VERSION ||
+        header.mipLevels   == 0                    ||
+        header.mipLevels   >  MAX_TEXTURE_MIPS     ||
+        block.extent       == 0                    ||
+        header.blockExtent != block.extent         ||
+        header.blockSize   != block.size)
+    {
+      std::cout << "WARNING: textureFile::load - " << _path << " isn't a valid texture. Ignoring it." << std::endl;
+      return false;
+    }
+
+    if (!isFormatUsable(format))
+    {
+      std::cout << "NOTE: textureFile::load - The device can't sample the format of " << _path << std::endl;
+      return false;
+    }
+
+    _result = resourcesLoader::ImageData{};
+    _result.width       = header.width;
+    _result.heigth      = header.height;
+    _result.mipLevels   = header.mipLevels;
+    _result.format      = format;
+    _result.blockExtent = block.extent;
+    _result.blockSize   = block.size;
+
+    for (uint32_t m=0; m<header.mipLevels; ++m)
+    {
+      const MipLevel& mip = header.mips[m];
+
+      if (mip.width  != std::max(header.width  >> m, 1u) ||
+          mip.height != std::max(header.height >> m, 1u) ||
+          mip.size   != getLevelSize(block, mip.width, mip.height)   ||
+          mip.offset + mip.size > pFile->size())
+      {
+        std::cout << "WARNING: textureFile::load - " << _path << " is truncated or corrupt. Ignoring it." << std::endl;
+        _result = resourcesLoader::ImageData{};
+        return false;
+      }
+
+      VkBufferImageCopy region{};
+      region.bufferOffset                    = mip.offset;
+      region.imageSubresource.aspectMask     = VK_IMAGE_ASPECT_COLOR_BIT;
+      region.imageSubresource.mipLevel       = m;
+      region.imageSubresource.baseArrayLayer = 0;
+      region.imageSubresource.layerCount     = 1;
+      region.imageOffset                     = {0, 0, 0};
+      region.imageExtent                     = {mip.width, mip.height, 1};
+      _result.mips.push_back(region);
+    }
+
+    _result.contentHash = header.contentHash;
+    _result.pFile       = std::move(pFile);
+
+    return true;
+  }
+
+  bool save(const std::string&                    _path,
+            const VkFormat                        _format,
+            const uint32_t                        _width,
+            const uint32_t                        _height,
+            const std::vector<std::vector<char>>& _levels)
+  {
+    const BlockInfo block = getBlockInfo(_format);
+
+    if (_levels.empty() || _levels.size() > MAX_TEXTURE_MIPS || block.extent == 0)
+    {
+      std::cout << "WARNING: textureFile::save - Unsupported format or mip count for " << _path << std::endl;
+      return false;
+    }
+
+    Header header{};
+    header.magic     = TEXTURE_FILE_MAGIC;
+    header.version   = TEXTURE_FILE_VERSION;
+    header.format      = static_cast<uint32_t>(_format);
+    header.blockExtent = block.extent;
+    header.blockSize   = block.size;
+    header.width       = _width;
+    header.height      = _height;
+    header.mipLevels   = static_cast<uint32_t>(_levels.size());
+    // The same levels at another extent or format are another image
+    header.contentHash = fnv1a(header.mipLevels, fnv1a(header.height, fnv1a(header.width, fnv1a(header.format))));
+
+    uint64_t offset = alignUp(sizeof(Header));
+    for (uint32_t m=0; m<header.mipLevels; ++m)
+    {
+      MipLevel& mip = header.mips[m];
+      mip.width  = std::max(_width  >> m, 1u);
+      mip.height = std::max(_height >> m, 1u);
+      mip.size   = getLevelSize(block, mip.width, mip.height);
+      mip.offset = offset;
+
+      if (_levels[m].size() != mip.size)
+      {
+        std::cout << "WARNING: textureFile::save - Mip " << m << " doesn't match its extent." << std::endl;
+        return false;
+      }
+
+      offset = alignUp(offset + mip.size);
+      header.contentHash = fnv1a(_levels[m].data(), _levels[m].size(), header.contentHash);
+    }
+
+    // Written aside and renamed, like the mesh cache
+    std::error_code   error;
+    const std::string tmpPath = _path + ".tmp";
+    {
+      std::ofstream file(tmpPath, std::ios::binary | std::ios::trunc);
+      if (!file.is_open())
+      {
+        std::cout << "WARNING: textureFile::save - Couldn't open " << tmpPath << std::endl;
+        return false;
+      }
+
+      const char padding[LEVEL_ALIGNMENT] = {};
+
+      file.write(reinterpret_cast<const char*>(&header), sizeof(Header));
+      uint64_t written = sizeof(Header);
+
+      for (uint32_t m=0; m<header.mipLevels; ++m)
+      {
+        file.write(padding, header.mips[m].offset - written);
+        file.write(_levels[m].data(), header.mips[m].size);
+        written = header.mips[m].offset + header.mips[m].size;
+      }
+
+      if (!file.good())
+      {
+        std::cout << "WARNING: textureFile::save - Failed writing " << tmpPath << std::endl;
+        return false;
+      }
+    }
+
+    std::filesystem::rename(tmpPath, _path, error);
+    if (error)
+    {
+      std::cout << "WARNING: textureFile::save - Couldn't move " << tmpPath << ": " << error.message() << std::endl;
+      std::filesystem::remove(tmpPath, error);
+      return false;
+    }
+
+    return true;
+  }
+} // namespace vpe::textureFile
@@ -0,0 +1,91 @@
+#ifndef VP_TEXTURE_FILE_HPP
+#define VP_TEXTURE_FILE_HPP
+
+#include <string>
+#include <vector>
+#include <type_traits>
+
+#include "VPResourcesLoader.hpp"
+
+namespace vpe
+{
+// The engine's texture container, made offline by VPTextureConverter
+const char* const TEXTURE_FILE_EXTENSION = ".vptex";
+
+constexpr uint32_t TEXTURE_FILE_MAGIC   = 0x58545056; // "VPTX"
+constexpr uint32_t TEXTURE_FILE_VERSION = 4;
+constexpr uint32_t MAX_TEXTURE_MIPS     = 16; // Up to 32768x32768
+} // namespace vpe
+
+namespace vpe::textureFile
+{
+  struct MipLevel
+  {
+    uint64_t offset; // From the start of the file
+    uint64_t size;
+    uint32_t width;
+    uint32_t height;
+  };
+
+  // Followed by every mip level, biggest first, tightly packed and ready for vkCmdCopyBufferToImage
+  struct Header
+  {
+    uint32_t magic;
+    uint32_t version;
+    uint32_t format;      // VkFormat
+    uint32_t blockExtent; // Texels per side of each block, 1 for the uncompressed formats
+    uint32_t blockSize;   // In bytes
+    uint32_t width;
+    uint32_t height;
+    uint32_t mipLevels;
+    uint64_t contentHash; // Of the format, extent and every level's data, so loading doesn't have to read (and page in) them
+    MipLevel mips[MAX_TEXTURE_MIPS];
+  };
+  static_assert(std::is_trivially_copyable<Header>::value, "The header is written and read as raw bytes");
+
+  struct BlockInfo
+  {
+    uint32_t extent; // 0 if the format isn't supported
+    uint32_t size;
+  };
+
+  // Only the formats the converter writes
+  BlockInfo getBlockInfo(const VkFormat _format);
+
+  inline uint64_t getLevelSize(const BlockInfo& _block, const uint32_t _width, const uint32_t _height)
+  {
+    return uint64_t((_width  + _block.extent - 1) / _block.extent) *
+                   ((_height + _block.extent - 1) / _block.extent) * _block.size;
+  }
+
+  // The device can sample it with linear filtering. The block compressed formats are optional.
+  bool isFormatUsable(const VkFormat _format);
+
+  // Next to the source, with the container's extension
+  std::string getPath(const char* _sourcePath);
+
+  inline bool isTextureFile(const char* _path)
+  {
+    const std::string path(_path);
+    const size_t      extensionLength = strlen(TEXTURE_FILE_EXTENSION);
+
+    return path.size() >= extensionLength &&
+           path.compare(path.size() - extensionLength, extensionLength, TEXTURE_FILE_EXTENSION) == 0;
+  }
+
+  // The container made from _sourcePath, if there's one at least as new as the source. Empty otherwise.
+  std::string findFor(const char* _sourcePath);
+
+  // The result keeps the file mapped and its mips point into it, nothing is copied.
+  // Only the header is read, the levels are paged in once they're uploaded.
+  // Fails if the device can't use its format.
+  bool load(const char* _path, resourcesLoader::ImageData& _result);
+
+  // _levels: the tightly packed texels (or blocks) of each mip, biggest first
+  bool save(const std::string&                    _path,
+            const VkFormat                        _format,
+            const uint32_t                        _width,
+            const uint32_t                        _height,
+            const std::vector<std::vector<char>>& _levels);
+} // namespace vpe::textureFile
+#endif
@@ -0,0 +1,82 @@
+#include "VPTextureRegistry.hpp"
+
+namespace vpe
+{
+std::shared_ptr<Image> TextureRegistry::find(const std::string& _path)
+{
+  const auto pathIt = m_hashesByPath.find(_path);
+  if (pathIt == m_hashesByPath.end()) return nullptr;
+
+  const auto imageIt = m_images.find(pathIt->second);
+  if (imageIt == m_images.end()) return nullptr;
+
+  return imageIt->second.lock();
+}
+
+std::shared_ptr<Image> TextureRegistry::load(const char* _path)
+{
+  ++m_requestCount;
+
+  auto pImage = this->find(_path);
+  if (pImage != nullptr) return pImage;
+
+  auto imageData = resourcesLoader::loadImage(_path);
+
+  return this->insert(_path, imageData);
+}
+
+std::shared_ptr<Image> TextureRegistry::add(const std::string& _path, resourcesLoader::ImageData& _imageData)
+{
+  ++m_requestCount;
+
+  return this->insert(_path, _imageData);
+}
+
+std::shared_ptr<Image> TextureRegistry::insert(const std::string& _path, resourcesLoader::ImageData& _imageData)
+{
+  const uint64_t hash = _imageData.contentHash;
+  m_hashesByPath[_path] = hash;
+
+  // Same contents under another path, or decoded twice before the first one was added
+  auto& pWeakImage = m_images[hash];
+  auto  pImage     = pWeakImage.lock();
+  if (pImage != nullptr)
+  {
+    stbi_image_free(_imageData.pPixels);
+    _imageData.pPixels = nullptr;
+    return pImage;
+  }
+
+  // Records the upload and frees the pixels.
+  // The registry forgets it with the last reference, unless another image took its place already.
+  pImage = std::shared_ptr<Image>(new Image(_imageData), [this, hash](Image* _pImage)
+  {
+    const auto it = m_images.find(hash);
+    if (it != m_images.end() && it->second.expired()) m_images.erase(it);
+    delete _pImage;
+  });
+  pWeakImage = pImage;
+  ++m_uploadCount;
+
+  return pImage;
+}
+
+void TextureRegistry::cleanUp()
+{
+  if (m_requestCount > 0)
+  {
+    std::cout << "NOTE: TextureRegistry - " << m_requestCount << " texture requests, "
+              << m_uploadCount << " uploads." << std::endl;
+  }
+
+  size_t inUse = 0;
+  for (const auto& hashAndImage : m_images) inUse += hashAndImage.second.expired() ? 0 : 1;
+  if (inUse > 0)
+    std::cout << "WARNING: TextureRegistry::cleanUp - " << inUse << " textures are still in use!" << std::endl;
+
+  m_images.clear();
+  m_hashesByPath.clear();
+  m_requestCount = 0;
+  m_uploadCount  = 0;
+}
+}
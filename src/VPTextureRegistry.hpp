@@ -0,0 +1,56 @@
+#ifndef VP_TEXTURE_REGISTRY_HPP
+#define VP_TEXTURE_REGISTRY_HPP
+
+#include <string>
+#include <memory>
+#include <unordered_map>
+
+#include "VPImage.hpp"
+#include "VPResourcesLoader.hpp"
+
+namespace vpe
+{
+// Shares the textures between materials: one decode, one upload and one allocation per distinct image.
+// Looked up by path first and then by the contents, so copies of a file under other paths are shared too.
+// The materials own the images, which are destroyed as soon as the last one lets go of them.
+// Not thread safe, the images are added on the main thread.
+class TextureRegistry
+{
+public:
+  TextureRegistry(TextureRegistry const&) = delete;
+  void operator=(TextureRegistry const&) = delete;
+
+  static inline TextureRegistry& getInstance()
+  {
+    static TextureRegistry instance;
+    return instance;
+  }
+
+  // nullptr if nobody is using the image at _path
+  std::shared_ptr<Image> find(const std::string& _path);
+
+  // Decodes and uploads the image only if it isn't already in use
+  std::shared_ptr<Image> load(const char* _path);
+
+  // For images decoded somewhere else. Takes the pixels, which are freed right away if it's already in use.
+  std::shared_ptr<Image> add(const std::string& _path, resourcesLoader::ImageData& _imageData);
+
+  inline size_t getUploadCount()   const { return m_uploadCount; }
+  inline size_t getResidentCount() const { return m_images.size(); }
+
+  // The images still in use stay alive, but they aren't shared anymore
+  void cleanUp();
+
+private:
+  TextureRegistry() : m_requestCount(0), m_uploadCount(0) {}
+  ~TextureRegistry() {}
+
+  std::unordered_map<std::string, uint64_t>           m_hashesByPath; // Stale once the image is gone
+  std::unordered_map<uint64_t, std::weak_ptr<Image>>  m_images;       // By content hash
+  size_t                                              m_requestCount;
+  size_t                                              m_uploadCount;
+
+  std::shared_ptr<Image> insert(const std::string& _path, resourcesLoader::ImageData& _imageData);
+};
+}
+#endif
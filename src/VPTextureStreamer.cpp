@@ -0,0 +1,149 @@
+#include "VPTextureStreamer.hpp"
+
+#include <algorithm>
+
+namespace vpe
+{
+void TextureStreamer::request(const std::shared_ptr<Image>& _pImage, const float _pixels)
+{
+  if (_pImage == nullptr || !_pImage->isStreamed()) return;
+
+  const uint32_t mip = _pImage->getMipForFootprint(_pixels);
+
+  auto it = m_entries.find(_pImage.get());
+  if (it == m_entries.end())
+  {
+    m_entries.emplace( _pImage.get(), Entry{_pImage, mip, m_frame} );
+    return;
+  }
+
+  // First request of the frame, or another image at the address of a destroyed one
+  Entry& entry = it->second;
+  if (entry.lastUsedFrame != m_frame || entry.pImage.expired())
+  {
+    entry = Entry{_pImage, mip, m_frame};
+    return;
+  }
+
+  entry.wantedMip = std::min(entry.wantedMip, mip);
+}
+
+void TextureStreamer::update(std::vector<Image*>&                 _changedImages,
+                             std::vector<std::unique_ptr<Image>>& _retiredImages)
+{
+  struct Candidate
+  {
+    Image*       pImage;
+    const Entry* pEntry;
+    uint32_t     targetMip;
+  };
+  std::vector<Candidate> evictions;
+  std::vector<Candidate> loads;
+
+  VkDeviceSize residentSize = 0;
+  size_t       aliveCount   = 0;
+
+  for (auto it = m_entries.begin(); it != m_entries.end();)
+  {
+    if (it->second.pImage.expired())
+    {
+      it = m_entries.erase(it);
+      continue;
+    }
+
+    Image*         pImage      = it->first;
+    const Entry&   entry       = it->second;
+    const uint32_t residentMip = pImage->getResidentMip();
+    const bool     isUsed      = entry.lastUsedFrame == m_frame;
+
+    residentSize += pImage->getLevelsSize(residentMip);
+    ++aliveCount;
+
+    // The mips the last frame didn't sample, or all of them if it isn't drawn anymore
+    const uint32_t unusedFrom = isUsed ? entry.wantedMip : pImage->getMinResidentMip();
+    if (unusedFrom > residentMip) evictions.push_back( Candidate{pImage, &entry, unusedFrom} );
+
+    if (isUsed && entry.wantedMip < residentMip) loads.push_back( Candidate{pImage, &entry, entry.wantedMip} );
+
+    ++it;
+  }
+
+  // Least recently used first
+  std::sort(evictions.begin(), evictions.end(), [](const Candidate& _a, const Candidate& _b)
+  {
+    return _a.pEntry->lastUsedFrame < _b.pEntry->lastUsedFrame;
+  });
+
+  // The blurriest first
+  std::sort(loads.begin(), loads.end(), [](const Candidate& _a, const Candidate& _b)
+  {
+    return _a.pImage->getResidentMip() - _a.targetMip > _b.pImage->getResidentMip() - _b.targetMip;
+  });
+
+  m_stats.uploadedSize = 0;
+
+  auto changeMip = [&](Image* _pImage, const uint32_t _mip)
+  {
+    const VkDeviceSize newSize = _pImage->getLevelsSize(_mip);
+
+    residentSize -= _pImage->getLevelsSize( _pImage->getResidentMip() );
+    residentSize += newSize;
+
+    _retiredImages.push_back( _pImage->changeResidentMip(_mip) );
+    _changedImages.push_back(_pImage);
+
+    m_stats.uploadedSize += newSize;
+  };
+
+  size_t nextEviction = 0;
+  auto evictDownTo = [&](const VkDeviceSize _size)
+  {
+    while (residentSize > _size && nextEviction < evictions.size())
+    {
+      const Candidate& eviction = evictions.at(nextEviction++);
+      changeMip(eviction.pImage, eviction.targetMip);
+      ++m_stats.evictionCount;
+    }
+  };
+
+  // The budget was lowered
+  evictDownTo(m_budget);
+
+  for (const auto& load : loads)
+  {
+    if (m_stats.uploadedSize >= STREAMING_UPLOAD_LIMIT) break;
+
+    Image*             pImage      = load.pImage;
+    const uint32_t     residentMip = pImage->getResidentMip();
+    const VkDeviceSize currentSize = pImage->getLevelsSize(residentMip);
+
+    const VkDeviceSize growth = pImage->getLevelsSize(load.targetMip) - currentSize;
+    if (growth <= m_budget) evictDownTo(m_budget - growth);
+
+    // As detailed as the budget allows, even if it's not all it wanted
+    uint32_t mip = load.targetMip;
+    while (mip < residentMip && residentSize - currentSize + pImage->getLevelsSize(mip) > m_budget) ++mip;
+
+    if (mip == residentMip) continue;
+
+    changeMip(pImage, mip);
+    ++m_stats.loadCount;
+  }
+
+  m_stats.streamedCount = aliveCount;
+  m_stats.residentSize  = residentSize;
+}
+
+void TextureStreamer::cleanUp()
+{
+  if (m_stats.loadCount > 0 || m_stats.evictionCount > 0)
+  {
+    std::cout << "NOTE: TextureStreamer - " << m_stats.loadCount << " loads, " << m_stats.evictionCount
+              << " evictions. " << m_stats.residentSize / (1024 * 1024) << "MiB of "
+              << m_budget / (1024 * 1024) << "MiB in use." << std::endl;
+  }
+
+  m_entries.clear();
+  m_stats = TextureStreamingStats{};
+}
+}
@@ -0,0 +1,68 @@
+#ifndef VP_TEXTURE_STREAMER_HPP
+#define VP_TEXTURE_STREAMER_HPP
+
+#include <vector>
+#include <memory>
+#include <unordered_map>
+
+#include "VPImage.hpp"
+
+namespace vpe
+{
+constexpr VkDeviceSize DEFAULT_TEXTURE_BUDGET = 256 * 1024 * 1024;
+// Bytes staged per frame, so a camera cut spreads its loads instead of stalling one frame.
+// The first load of each frame goes through anyway, so a single huge image can't starve.
+constexpr VkDeviceSize STREAMING_UPLOAD_LIMIT = 32 * 1024 * 1024;
+
+struct TextureStreamingStats
+{
+  size_t       streamedCount = 0; // Images alive with mips to stream
+  VkDeviceSize residentSize  = 0; // Of those images
+  VkDeviceSize uploadedSize  = 0; // Last update
+  size_t       loadCount     = 0; // Since the start
+  size_t       evictionCount = 0;
+};
+
+// Keeps the streamed images' (see Image::isStreamed) mips in memory according to their size on screen.
+// Each frame the scene requests the images it's drawing with their footprints, and the update loads the mips
+// missing. Once the budget is exceeded, the mips nothing needs are evicted, least recently used first.
+// Changing the mips replaces the image and its view. The caller updates the descriptors and keeps the old ones
+// alive until the frames using them are done.
+class TextureStreamer
+{
+public:
+  TextureStreamer() : m_budget(DEFAULT_TEXTURE_BUDGET), m_frame(0) {}
+  ~TextureStreamer() {}
+
+  // Only the streamed images count towards it. Lowering it evicts in the next update.
+  inline void         setBudget(const VkDeviceSize _budget) { m_budget = _budget; }
+  inline VkDeviceSize getBudget() const                     { return m_budget; }
+
+  inline const TextureStreamingStats& getStats() const { return m_stats; }
+
+  // Forgets the last frame's requests
+  inline void beginFrame() { ++m_frame; }
+
+  // _pixels: the image's footprint on screen. The biggest request of the frame wins.
+  void request(const std::shared_ptr<Image>& _pImage, const float _pixels);
+
+  // Records the uploads. _changedImages: their views changed. _retiredImages: their previous resources.
+  void update(std::vector<Image*>& _changedImages, std::vector<std::unique_ptr<Image>>& _retiredImages);
+
+  void cleanUp();
+
+private:
+  struct Entry
+  {
+    std::weak_ptr<Image> pImage;
+    uint32_t             wantedMip;
+    uint64_t             lastUsedFrame;
+  };
+
+  std::unordered_map<Image*, Entry> m_entries;
+  VkDeviceSize                      m_budget;
+  uint64_t                          m_frame;
+  TextureStreamingStats             m_stats;
+};
+}
+#endif
@@ -0,0 +1,99 @@
+#ifndef VP_THREAD_POOL_HPP
+#define VP_THREAD_POOL_HPP
+
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <functional>
+#include <future>
+#include <memory>
+#include <queue>
+#include <vector>
+
+namespace vpe
+{
+// Fixed amount of worker threads consuming a FIFO of tasks
+class ThreadPool
+{
+public:
+  ThreadPool() = delete;
+  ThreadPool(ThreadPool const&)    = delete;
+  void operator=(ThreadPool const&) = delete;
+
+  explicit ThreadPool(const size_t _threadCount) : m_stop(false)
+  {
+    const size_t threadCount = std::max(_threadCount, size_t(1));
+
+    m_workers.reserve(threadCount);
+    for (size_t i=0; i<threadCount; ++i)
+      m_workers.emplace_back( [this](){ this->workerLoop(); } );
+  }
+
+  // Finishes the pending tasks before joining
+  ~ThreadPool()
+  {
+    {
+      std::lock_guard<std::mutex> lock(m_mutex);
+      m_stop = true;
+    }
+    m_condition.notify_all();
+
+    for (auto& worker : m_workers)
+      worker.join();
+  }
+
+  // Leaves one core for the main thread
+  static inline size_t getDefaultThreadCount()
+  {
+    const size_t cores = std::thread::hardware_concurrency();
+    return cores > 1 ? cores - 1 : 1;
+  }
+
+  inline size_t getThreadCount() const { return m_workers.size(); }
+
+  template<typename F>
+  auto submit(F&& _task) -> std::future<decltype(_task())>
+  {
+    using ReturnType = decltype(_task());
+
+    // std::function needs to be copyable, std::packaged_task isn't
+    auto pTask = std::make_shared<std::packaged_task<ReturnType()>>( std::forward<F>(_task) );
+    std::future<ReturnType> result = pTask->get_future();
+
+    {
+      std::lock_guard<std::mutex> lock(m_mutex);
+      m_tasks.emplace( [pTask](){ (*pTask)(); } );
+    }
+    m_condition.notify_one();
+
+    return result;
+  }
+
+private:
+  std::vector<std::thread>          m_workers;
+  std::queue<std::function<void()>> m_tasks;
+
+  std::mutex              m_mutex;
+  std::condition_variable m_condition;
+  bool                    m_stop;
+
+  inline void workerLoop()
+  {
+    while (true)
+    {
+      std::function<void()> task;
+      {
+        std::unique_lock<std::mutex> lock(m_mutex);
+        m_condition.wait(lock, [this](){ return m_stop || !m_tasks.empty(); });
+
+        if (m_stop && m_tasks.empty()) return;
+
+        task = std::move(m_tasks.front());
+        m_tasks.pop();
+      }
+      task();
+    }
+  }
+};
+}
+#endif
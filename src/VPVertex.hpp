@@ -8,16 +8,30 @@
 #include <vulkan/vulkan.h>
 #include <glm/glm.hpp>
 #include <glm/gtx/hash.hpp>
+#include <glm/gtc/packing.hpp>
+
+#include <vector>
+#include <cstdint>
+#include <cmath>
 
 namespace vpe
 {
+enum class VertexFormat : uint32_t
+{
+  FULL,  // Vertex
+  PACKED // PackedVertex
+};
+
 struct Vertex
 {
   bool operator==(const Vertex& other) const
   {
-    return pos      == other.pos    &&
-           normal   == other.normal &&
-           texCoord == other.texCoord;
+    // Every attribute, or welding would merge vertices with different tangent frames
+    return pos       == other.pos       &&
+           normal    == other.normal    &&
+           tangent   == other.tangent   &&
+           bitangent == other.bitangent &&
+           texCoord  == other.texCoord;
   }
 
   glm::vec2 texCoord;
@@ -69,6 +83,136 @@ struct Vertex
     return descriptions;
   }
 };
+
+// Object space position = offset + scale * quantized position
+struct Quantization
+{
+  glm::vec3 scale  = glm::vec3(1);
+  glm::vec3 offset = glm::vec3(0);
+
+  // Fits the quantized [0,1] range to the AABB
+  static inline Quantization fromAABB(const glm::vec3& _min, const glm::vec3& _max)
+  {
+    Quantization result{};
+    result.offset = _min;
+    result.scale  = glm::max(_max - _min, glm::vec3(1e-6f)); // Flat meshes still need a valid scale
+
+    return result;
+  }
+};
+
+// 20 bytes instead of Vertex's 56. Decoded in BlinnPhong.vert when compiled with PACKED_VERTEX.
+struct PackedVertex
+{
+  uint16_t position[4]; // UNORM, see Quantization. w is the bitangent's sign: 0 for -1, 1 for +1.
+  int16_t  normal[2];   // Octahedral, SNORM
+  int16_t  tangent[2];  // Octahedral, SNORM. The bitangent is cross(normal, tangent) * sign.
+  uint16_t texCoord[2]; // Half floats
+
+  static inline PackedVertex pack(const Vertex& _vertex, const Quantization& _quantization)
+  {
+    PackedVertex result{};
+
+    const glm::vec3 normalized = (_vertex.pos - _quantization.offset) / _quantization.scale;
+    for (int i=0; i<3; ++i)
+      result.position[i] = static_cast<uint16_t>( std::lround(glm::clamp(normalized[i], 0.0f, 1.0f) * 65535.0f) );
+
+    const bool isMirrored = glm::dot(glm::cross(_vertex.normal, _vertex.tangent), _vertex.bitangent) < 0.0f;
+    result.position[3] = isMirrored ? 0 : 65535;
+
+    encodeOctahedral(_vertex.normal,  result.normal);
+    encodeOctahedral(_vertex.tangent, result.tangent);
+
+    result.texCoord[0] = glm::packHalf1x16(_vertex.texCoord.x);
+    result.texCoord[1] = glm::packHalf1x16(_vertex.texCoord.y);
+
+    return result;
+  }
+
+  // Projects the unit sphere onto an octahedron, unfolded into the [-1,1] square
+  static inline void encodeOctahedral(const glm::vec3& _direction, int16_t _result[2])
+  {
+    const float l1Norm = std::abs(_direction.x) + std::abs(_direction.y) + std::abs(_direction.z);
+    if (l1Norm == 0.0f)
+    {
+      _result[0] = 0;
+      _result[1] = 0;
+      return;
+    }
+
+    float x = _direction.x / l1Norm;
+    float y = _direction.y / l1Norm;
+
+    // Lower hemisphere, fold it over the diagonals
+    if (_direction.z < 0.0f)
+    {
+      const float foldedX = (1.0f - std::abs(y)) * (x >= 0.0f ? 1.0f : -1.0f);
+      const float foldedY = (1.0f - std::abs(x)) * (y >= 0.0f ? 1.0f : -1.0f);
+      x = foldedX;
+      y = foldedY;
+    }
+
+    _result[0] = static_cast<int16_t>( std::lround(glm::clamp(x, -1.0f, 1.0f) * 32767.0f) );
+    _result[1] = static_cast<int16_t>( std::lround(glm::clamp(y, -1.0f, 1.0f) * 32767.0f) );
+  }
+
+  static inline VkVertexInputBindingDescription getBindingDescription()
+  {
+    VkVertexInputBindingDescription bd = {};
+    bd.binding   = 0;
+    bd.stride    = sizeof(PackedVertex);
+    bd.inputRate = VK_VERTEX_INPUT_RATE_VERTEX;
+
+    return bd;
+  }
+
+  // Same locations as Vertex's, minus the bitangent (3)
+  static inline std::vector<VkVertexInputAttributeDescription> getAttributeDescriptions()
+  {
+    std::vector<VkVertexInputAttributeDescription> descriptions{};
+    descriptions.resize(4);
+
+    descriptions[0].binding  = 0;
+    descriptions[0].location = 0;
+    descriptions[0].format   = VK_FORMAT_R16G16B16A16_UNORM;
+    descriptions[0].offset   = offsetof(PackedVertex, position);
+
+    descriptions[1].binding  = 0;
+    descriptions[1].location = 1;
+    descriptions[1].format   = VK_FORMAT_R16G16_SNORM;
+    descriptions[1].offset   = offsetof(PackedVertex, normal);
+
+    descriptions[2].binding  = 0;
+    descriptions[2].location = 2;
+    descriptions[2].format   = VK_FORMAT_R16G16_SNORM;
+    descriptions[2].offset   = offsetof(PackedVertex, tangent);
+
+    descriptions[3].binding  = 0;
+    descriptions[3].location = 4;
+    descriptions[3].format   = VK_FORMAT_R16G16_SFLOAT;
+    descriptions[3].offset   = offsetof(PackedVertex, texCoord);
+
+    return descriptions;
+  }
+};
+static_assert(sizeof(PackedVertex) == 20, "PackedVertex must be tightly packed");
+
+inline uint32_t getVertexStride(const VertexFormat _format)
+{
+  return _format == VertexFormat::PACKED ? sizeof(PackedVertex) : sizeof(Vertex);
+}
+
+inline VkVertexInputBindingDescription getBindingDescription(const VertexFormat _format)
+{
+  return _format == VertexFormat::PACKED ? PackedVertex::getBindingDescription() :
+                                           Vertex::getBindingDescription();
+}
+
+inline std::vector<VkVertexInputAttributeDescription> getAttributeDescriptions(const VertexFormat _format)
+{
+  return _format == VertexFormat::PACKED ? PackedVertex::getAttributeDescriptions() :
+                                           Vertex::getAttributeDescriptions();
+}
 } // namespace vpe
 
 namespace std